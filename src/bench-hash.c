@@ -0,0 +1,63 @@
+/*
+ * Benchmark for Hash Functions
+ * This measures the throughput of all hash functions across a range of key
+ * lengths, and prints one line per hash function and key length.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "c-hash.h"
+#include "c-macro.h"
+#include "c-usec.h"
+
+#define BENCH_BYTES (64UL * 1024UL * 1024UL)
+
+static void bench_report(const char *name, size_t n, uint64_t usec, uint64_t acc) {
+        size_t n_ops = BENCH_BYTES / n;
+
+        printf("%-8s %6zu B  %8.2f ns/op  %8.1f MB/s  (%016llx)\n",
+               name,
+               n,
+               (double)usec * 1000 / n_ops,
+               usec ? (double)(n_ops * n) / usec : 0,
+               (unsigned long long)acc);
+}
+
+static void bench_length(const unsigned char *buf, size_t n) {
+        unsigned char key[C_HASH_SIP_KEY_SIZE] = {};
+        size_t i, n_ops = BENCH_BYTES / n;
+        uint64_t ts, acc;
+
+        /* fold every result into the next input, so nothing is elided */
+        acc = 0;
+        ts = c_usec_from_clock(CLOCK_MONOTONIC);
+        for (i = 0; i < n_ops; ++i) {
+                key[0] = acc;
+                acc ^= c_hash_sip(key, buf + (i & 63), n);
+        }
+        bench_report("sip13", n, c_usec_from_clock(CLOCK_MONOTONIC) - ts, acc);
+
+        acc = 0;
+        ts = c_usec_from_clock(CLOCK_MONOTONIC);
+        for (i = 0; i < n_ops; ++i)
+                acc ^= c_hash_fast(acc, buf + (i & 63), n);
+        bench_report("fast", n, c_usec_from_clock(CLOCK_MONOTONIC) - ts, acc);
+}
+
+int main(int argc, char **argv) {
+        static const size_t lengths[] = { 4, 8, 16, 24, 32, 64, 128, 256, 1024, 4096, 65536 };
+        _c_cleanup_(c_freep) unsigned char *buf = NULL;
+        size_t i;
+
+        buf = malloc(65536 + 64);
+        assert(buf);
+
+        for (i = 0; i < 65536 + 64; ++i)
+                buf[i] = i * 7;
+
+        for (i = 0; i < C_ARRAY_SIZE(lengths); ++i)
+                bench_length(buf, lengths[i]);
+
+        return 0;
+}
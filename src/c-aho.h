@@ -0,0 +1,390 @@
+#pragma once
+
+/*
+ * Multi-Pattern Search
+ *
+ * This implements the Aho-Corasick algorithm to search for a static set of
+ * patterns in a string. The patterns are compiled once into a deterministic
+ * automaton, which then reports all occurrences of all patterns in a single
+ * pass over the input. This replaces repeated strstr() calls, whose cost
+ * grows linearly with the number of patterns.
+ *
+ * The automaton is a dense transition table indexed by state and byte class,
+ * with failure transitions folded in, so each input byte costs exactly one
+ * table lookup. Bytes that occur in no pattern share a single class. While
+ * the automaton sits in its root state, a vectorized prefilter skips ahead to
+ * the next byte that starts any pattern, so input that rarely matches is
+ * scanned at memchr() speed.
+ *
+ * Once created, an automaton is never modified, hence searches can be run
+ * from any number of threads in parallel, without any synchronization.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <c-macro.h>
+#include <c-string.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct CAho CAho;
+
+/**
+ * CAhoFn - match callback
+ * @userdata:           userdata as passed to the search
+ * @id:                 ID of the matching pattern
+ * @offset:             offset of the first byte of the match in the input
+ *
+ * Return: 0 to continue the search, anything else to stop it.
+ */
+typedef int (*CAhoFn) (void *userdata, size_t id, size_t offset);
+
+#define C_INTERNAL_AHO_ROOT 0
+#define C_INTERNAL_AHO_NONE UINT32_MAX
+
+/**
+ * struct CAho - compiled multi-pattern automaton
+ * @n_states:           number of states
+ * @n_classes:          number of byte classes
+ * @n_patterns:         number of patterns
+ * @classes:            map from bytes to byte classes
+ * @first:              set of bytes that start any pattern
+ *
+ * The transition table (@n_states rows of @n_classes + 1 entries), the match
+ * table (@n_states entries), the link table (@n_states entries), and the
+ * length table (@n_patterns entries) directly follow this structure in
+ * memory. Each transition row contains the offset of the target row for each
+ * byte class, followed by the index of the state itself if any pattern ends
+ * in it or on its failure path, or C_INTERNAL_AHO_ROOT. Storing row offsets
+ * rather than indices keeps multiplications out of the search loop. Each
+ * match entry contains the ID of the pattern ending in that state, or
+ * C_INTERNAL_AHO_NONE. Each link entry contains the closest state on the
+ * failure path that has a match, or C_INTERNAL_AHO_ROOT. All members are
+ * private to the implementation.
+ */
+struct CAho {
+        size_t n_states;
+        size_t n_classes;
+        size_t n_patterns;
+        uint8_t classes[256];
+        CInternalStringByteset first;
+};
+
+static inline uint32_t *c_internal_aho_transitions(const CAho *aho) {
+        return (uint32_t *)(aho + 1);
+}
+
+static inline uint32_t *c_internal_aho_matches(const CAho *aho) {
+        return c_internal_aho_transitions(aho) + aho->n_states * (aho->n_classes + 1);
+}
+
+static inline uint32_t *c_internal_aho_links(const CAho *aho) {
+        return c_internal_aho_matches(aho) + aho->n_states;
+}
+
+static inline uint32_t *c_internal_aho_lengths(const CAho *aho) {
+        return c_internal_aho_links(aho) + aho->n_states;
+}
+
+static inline int c_internal_aho_compile(CAho *aho,
+                                         const char * const *patterns,
+                                         uint32_t *next,
+                                         uint32_t *matches,
+                                         uint32_t *links,
+                                         uint32_t *lengths) {
+        size_t i, j, c, n_classes = aho->n_classes, n_states = 1;
+        uint32_t s, t, *queue, *fail;
+        unsigned char b;
+
+        for (i = 0; i < aho->n_states; ++i)
+                matches[i] = C_INTERNAL_AHO_NONE;
+
+        /*
+         * Build the goto-function as plain trie. The root is never the target
+         * of a goto-transition, so we use it to mark missing ones.
+         */
+        for (i = 0; i < aho->n_patterns; ++i) {
+                s = C_INTERNAL_AHO_ROOT;
+
+                for (j = 0; patterns[i][j]; ++j) {
+                        t = next[s * n_classes + aho->classes[(unsigned char)patterns[i][j]]];
+                        if (t == C_INTERNAL_AHO_ROOT) {
+                                t = n_states++;
+                                next[s * n_classes + aho->classes[(unsigned char)patterns[i][j]]] = t;
+                        }
+                        s = t;
+                }
+
+                if (matches[s] == C_INTERNAL_AHO_NONE)
+                        matches[s] = i;
+                lengths[i] = j;
+        }
+
+        aho->n_states = n_states;
+
+        queue = malloc(2 * n_states * sizeof(uint32_t));
+        if (!queue)
+                return -ENOMEM;
+
+        fail = queue + n_states;
+
+        /*
+         * Fold the failure function into the transition table, in
+         * breadth-first order. The children of the root fail to the root,
+         * everything else fails to where its parent's failure state
+         * transitions to. Missing transitions are copied from the failure
+         * state, whose row is already complete since it is less deep.
+         */
+        for (i = 0, j = 0, c = 0; c < n_classes; ++c) {
+                t = next[C_INTERNAL_AHO_ROOT * n_classes + c];
+                if (t != C_INTERNAL_AHO_ROOT) {
+                        fail[t] = C_INTERNAL_AHO_ROOT;
+                        links[t] = C_INTERNAL_AHO_ROOT;
+                        queue[j++] = t;
+                }
+        }
+
+        while (i < j) {
+                s = queue[i++];
+
+                for (c = 0; c < n_classes; ++c) {
+                        t = next[s * n_classes + c];
+                        if (t == C_INTERNAL_AHO_ROOT) {
+                                next[s * n_classes + c] = next[fail[s] * n_classes + c];
+                        } else {
+                                fail[t] = next[fail[s] * n_classes + c];
+                                links[t] = (matches[fail[t]] != C_INTERNAL_AHO_NONE) ? fail[t] : links[fail[t]];
+                                queue[j++] = t;
+                        }
+                }
+        }
+
+        for (c = 0; c < 256; ++c) {
+                b = c;
+                if (next[C_INTERNAL_AHO_ROOT * n_classes + aho->classes[b]] == C_INTERNAL_AHO_ROOT)
+                        continue;
+
+                c_internal_string_byteset_add(&aho->first, b);
+        }
+
+        free(queue);
+        return 0;
+}
+
+/**
+ * c_aho_new() - compile multi-pattern automaton
+ * @ahop:               output argument for the new automaton
+ * @patterns:           array of zero-terminated patterns
+ * @n_patterns:         number of entries in @patterns
+ *
+ * This compiles the patterns given in @patterns into a new automaton. The ID
+ * of a pattern is its index in @patterns. If a pattern is given multiple
+ * times, only the lowest ID is reported. Patterns must not be empty.
+ *
+ * The automaton does not reference @patterns, so the caller is free to
+ * release it once this function returns.
+ *
+ * Return: 0 on success, -EINVAL if a pattern is empty, or too many or too
+ *         long patterns are given, -ENOMEM on allocation failure.
+ */
+static inline int c_aho_new(CAho **ahop, const char * const *patterns, size_t n_patterns) {
+        _c_cleanup_(c_freep) uint32_t *scratch = NULL;
+        uint8_t classes[256] = {};
+        size_t i, j, l, n_classes = 1, n_max = 1, n_table;
+        uint32_t *transitions, *next;
+        CAho *aho, *grown;
+        int r;
+
+        if (n_patterns >= C_INTERNAL_AHO_NONE)
+                return -EINVAL;
+
+        /*
+         * Assign byte classes in order of first appearance, and compute an
+         * upper bound on the number of states, assuming no patterns share a
+         * common head.
+         */
+        for (i = 0; i < n_patterns; ++i) {
+                l = strlen(patterns[i]);
+                if (!l || l >= C_INTERNAL_AHO_NONE - n_max)
+                        return -EINVAL;
+
+                n_max += l;
+                for (j = 0; j < l; ++j)
+                        if (!classes[(unsigned char)patterns[i][j]])
+                                classes[(unsigned char)patterns[i][j]] = n_classes++;
+        }
+
+        /* row offsets must fit into the transition table entries */
+        if (n_max >= C_INTERNAL_AHO_NONE / (n_classes + 2))
+                return -EINVAL;
+
+        /* the automaton is built in scratch space, then copied over */
+        scratch = calloc(n_max * (n_classes + 2) + n_patterns, sizeof(uint32_t));
+        if (!scratch)
+                return -ENOMEM;
+
+        aho = calloc(1, sizeof(*aho));
+        if (!aho)
+                return -ENOMEM;
+
+        aho->n_states = n_max;
+        aho->n_classes = n_classes;
+        aho->n_patterns = n_patterns;
+        memcpy(aho->classes, classes, sizeof(classes));
+
+        r = c_internal_aho_compile(aho,
+                                   patterns,
+                                   scratch,
+                                   scratch + n_max * n_classes,
+                                   scratch + n_max * (n_classes + 1),
+                                   scratch + n_max * (n_classes + 2));
+        if (r) {
+                free(aho);
+                return r;
+        }
+
+        n_table = aho->n_states * (n_classes + 3) + n_patterns;
+        grown = realloc(aho, sizeof(*aho) + n_table * sizeof(uint32_t));
+        if (!grown) {
+                free(aho);
+                return -ENOMEM;
+        }
+
+        aho = grown;
+        transitions = c_internal_aho_transitions(aho);
+        for (i = 0; i < aho->n_states; ++i) {
+                next = scratch + i * n_classes;
+                for (j = 0; j < n_classes; ++j)
+                        transitions[i * (n_classes + 1) + j] = next[j] * (n_classes + 1);
+
+                if (scratch[n_max * n_classes + i] != C_INTERNAL_AHO_NONE ||
+                    scratch[n_max * (n_classes + 1) + i] != C_INTERNAL_AHO_ROOT)
+                        transitions[i * (n_classes + 1) + n_classes] = i;
+                else
+                        transitions[i * (n_classes + 1) + n_classes] = C_INTERNAL_AHO_ROOT;
+        }
+
+        memcpy(c_internal_aho_matches(aho), scratch + n_max * n_classes, aho->n_states * sizeof(uint32_t));
+        memcpy(c_internal_aho_links(aho), scratch + n_max * (n_classes + 1), aho->n_states * sizeof(uint32_t));
+        memcpy(c_internal_aho_lengths(aho), scratch + n_max * (n_classes + 2), n_patterns * sizeof(uint32_t));
+
+        *ahop = aho;
+        return 0;
+}
+
+/**
+ * c_aho_free() - destroy multi-pattern automaton
+ * @aho:                automaton to destroy, or NULL
+ *
+ * This destroys @aho and releases all its resources. If NULL is passed, this
+ * is a no-op.
+ *
+ * Return: NULL is returned.
+ */
+static inline CAho *c_aho_free(CAho *aho) {
+        free(aho);
+        return NULL;
+}
+
+C_DEFINE_CLEANUP(CAho *, c_aho_free);
+
+#define C_INTERNAL_AHO_SKIP_MIN 16
+#define C_INTERNAL_AHO_SKIP_BACKOFF 256
+
+/**
+ * c_aho_search() - search buffer for patterns
+ * @aho:                automaton to use
+ * @str:                buffer to search
+ * @n:                  length of @str in bytes
+ * @fn:                 callback to invoke for each match
+ * @userdata:           userdata to pass to @fn
+ *
+ * This searches @str for all occurrences of all patterns compiled into @aho,
+ * including overlapping ones. For each match, @fn is invoked with the ID of
+ * the pattern and the offset of the match in @str. Matches are reported in
+ * order of their end offset, longer matches first if several patterns end at
+ * the same offset. If @fn returns non-zero, the search is stopped and that
+ * value is returned.
+ *
+ * @str may contain zero-bytes, which are treated like any other byte.
+ *
+ * Return: 0 if the search completed, otherwise the non-zero value returned
+ *         by @fn.
+ */
+static inline int c_aho_search(const CAho *aho, const char *str, size_t n, CAhoFn fn, void *userdata) {
+        size_t (*skip) (const CInternalStringByteset *set, const char *str, size_t n) = c_internal_string_byteset_find_scalar;
+        const uint32_t *transitions = c_internal_aho_transitions(aho);
+        const uint32_t *matches = c_internal_aho_matches(aho);
+        const uint32_t *links = c_internal_aho_links(aho);
+        const uint32_t *lengths = c_internal_aho_lengths(aho);
+        const uint8_t *classes = aho->classes;
+        size_t i = 0, k, end = 0, n_classes = aho->n_classes;
+        uint32_t s = C_INTERNAL_AHO_ROOT, m;
+        int r;
+
+#if C_INTERNAL_STRING_X86
+        if (__builtin_cpu_supports("avx2"))
+                skip = c_internal_string_byteset_find_avx2;
+        else if (__builtin_cpu_supports("ssse3"))
+                skip = c_internal_string_byteset_find_ssse3;
+#endif
+
+        while (i < n) {
+                /*
+                 * Whenever the root is reached, skip ahead to the next byte
+                 * that starts a pattern. If the prefilter fails to skip a
+                 * reasonable distance, the input is dense with candidates,
+                 * so stick to the plain automaton for a while, without
+                 * checking for the root after every byte.
+                 */
+                if (i >= end && s == C_INTERNAL_AHO_ROOT) {
+                        k = skip(&aho->first, str + i, n - i);
+                        i += k;
+                        if (i >= n)
+                                break;
+                        if (k < C_INTERNAL_AHO_SKIP_MIN)
+                                end = i + C_INTERNAL_AHO_SKIP_BACKOFF;
+                }
+
+                s = transitions[s + classes[(unsigned char)str[i++]]];
+
+                m = transitions[s + n_classes];
+                if (_c_unlikely_(m != C_INTERNAL_AHO_ROOT)) {
+                        if (matches[m] == C_INTERNAL_AHO_NONE)
+                                m = links[m];
+
+                        do {
+                                r = fn(userdata, matches[m], i - lengths[matches[m]]);
+                                if (r)
+                                        return r;
+
+                                m = links[m];
+                        } while (m != C_INTERNAL_AHO_ROOT);
+                }
+        }
+
+        return 0;
+}
+
+/**
+ * c_aho_search_str() - search string for patterns
+ * @aho:                automaton to use
+ * @str:                zero-terminated string to search
+ * @fn:                 callback to invoke for each match
+ * @userdata:           userdata to pass to @fn
+ *
+ * This is the same as c_aho_search(), but operates on a zero-terminated
+ * string.
+ *
+ * Return: 0 if the search completed, otherwise the non-zero value returned
+ *         by @fn.
+ */
+static inline int c_aho_search_str(const CAho *aho, const char *str, CAhoFn fn, void *userdata) {
+        return c_aho_search(aho, str, strlen(str), fn, userdata);
+}
+
+#ifdef __cplusplus
+}
+#endif
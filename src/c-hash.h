@@ -0,0 +1,421 @@
+#pragma once
+
+/*
+ * Hash Functions
+ *
+ * This provides two 64-bit hash functions over byte strings, each with a
+ * one-shot and a streaming API. Both produce the same result regardless of
+ * how the input is split across streaming updates, and regardless of the
+ * endianness of the machine, so hashes can be shared across components and
+ * processes.
+ *
+ * SipHash-1-3 is keyed with a 128-bit secret. As long as the key is not
+ * known to an attacker, they cannot predict hash values, and thus cannot
+ * trigger worst-case behavior in hash tables fed with untrusted input.
+ *
+ * The fast hash is considerably faster, particularly on short keys, but
+ * offers no such protection. It is meant for trusted input. It follows the
+ * construction of wyhash: input words are combined with secret constants and
+ * mixed by folding their full 128-bit product. Its output is fixed by the
+ * test-suite, but it makes no claim of compatibility with other wyhash
+ * implementations.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <c-macro.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct CHashSip CHashSip;
+typedef struct CHashFast CHashFast;
+
+#define C_HASH_SIP_KEY_SIZE 16
+
+/**
+ * struct CHashSip - SipHash streaming state
+ *
+ * All members are private to the implementation.
+ */
+struct CHashSip {
+        uint64_t v0;
+        uint64_t v1;
+        uint64_t v2;
+        uint64_t v3;
+        uint64_t tail;
+        size_t len;
+};
+
+/**
+ * struct CHashFast - fast hash streaming state
+ *
+ * All members are private to the implementation.
+ */
+struct CHashFast {
+        uint64_t seed;
+        uint64_t see1;
+        uint64_t see2;
+        size_t len;
+        size_t n_pending;
+        unsigned char buffer[64];
+};
+
+static inline uint64_t c_internal_hash_read64(const unsigned char *p) {
+        return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+               (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 | (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+static inline uint64_t c_internal_hash_read32(const unsigned char *p) {
+        return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24;
+}
+
+static inline uint64_t c_internal_hash_rotl(uint64_t x, unsigned int b) {
+        return (x << b) | (x >> (64 - b));
+}
+
+static inline void c_internal_hash_sip_round(CHashSip *state) {
+        state->v0 += state->v1;
+        state->v1 = c_internal_hash_rotl(state->v1, 13);
+        state->v1 ^= state->v0;
+        state->v0 = c_internal_hash_rotl(state->v0, 32);
+        state->v2 += state->v3;
+        state->v3 = c_internal_hash_rotl(state->v3, 16);
+        state->v3 ^= state->v2;
+        state->v0 += state->v3;
+        state->v3 = c_internal_hash_rotl(state->v3, 21);
+        state->v3 ^= state->v0;
+        state->v2 += state->v1;
+        state->v1 = c_internal_hash_rotl(state->v1, 17);
+        state->v1 ^= state->v2;
+        state->v2 = c_internal_hash_rotl(state->v2, 32);
+}
+
+/*
+ * The SipHash helpers are parameterized on the number of compression and
+ * finalization rounds. Only SipHash-1-3 is exposed, but the test-suite
+ * verifies these against the reference vectors of SipHash-2-4.
+ */
+
+static inline void c_internal_hash_sip_init(CHashSip *state, const void *key) {
+        uint64_t k0 = c_internal_hash_read64(key);
+        uint64_t k1 = c_internal_hash_read64((const unsigned char *)key + 8);
+
+        *state = (CHashSip){
+                .v0 = k0 ^ UINT64_C(0x736f6d6570736575),
+                .v1 = k1 ^ UINT64_C(0x646f72616e646f6d),
+                .v2 = k0 ^ UINT64_C(0x6c7967656e657261),
+                .v3 = k1 ^ UINT64_C(0x7465646279746573),
+        };
+}
+
+static inline void c_internal_hash_sip_compress(CHashSip *state, uint64_t m, unsigned int c) {
+        unsigned int i;
+
+        state->v3 ^= m;
+        for (i = 0; i < c; ++i)
+                c_internal_hash_sip_round(state);
+        state->v0 ^= m;
+}
+
+static inline void c_internal_hash_sip_update(CHashSip *state, const void *data, size_t n, unsigned int c) {
+        const unsigned char *p = data;
+        unsigned int shift;
+
+        /* complete a partial word from a previous update */
+        shift = (state->len % 8) * 8;
+        state->len += n;
+
+        if (shift) {
+                for ( ; n && shift < 64; --n, shift += 8)
+                        state->tail |= (uint64_t)*p++ << shift;
+                if (shift < 64)
+                        return;
+
+                c_internal_hash_sip_compress(state, state->tail, c);
+                state->tail = 0;
+        }
+
+        for ( ; n >= 8; n -= 8, p += 8)
+                c_internal_hash_sip_compress(state, c_internal_hash_read64(p), c);
+
+        for (shift = 0; n; --n, shift += 8)
+                state->tail |= (uint64_t)*p++ << shift;
+}
+
+static inline uint64_t c_internal_hash_sip_final(CHashSip *state, unsigned int c, unsigned int d) {
+        unsigned int i;
+
+        c_internal_hash_sip_compress(state, state->tail | (uint64_t)state->len << 56, c);
+
+        state->v2 ^= 0xff;
+        for (i = 0; i < d; ++i)
+                c_internal_hash_sip_round(state);
+
+        return state->v0 ^ state->v1 ^ state->v2 ^ state->v3;
+}
+
+/**
+ * c_hash_sip_init() - initialize SipHash-1-3 state
+ * @state:              state to initialize
+ * @key:                secret key of C_HASH_SIP_KEY_SIZE bytes
+ *
+ * This initializes @state for a new streaming hash operation, keyed with
+ * @key. The key should be generated randomly, and kept secret.
+ */
+static inline void c_hash_sip_init(CHashSip *state, const void *key) {
+        c_internal_hash_sip_init(state, key);
+}
+
+/**
+ * c_hash_sip_update() - feed data into SipHash-1-3 state
+ * @state:              state to operate on
+ * @data:               data to hash
+ * @n:                  length of @data in bytes
+ *
+ * This feeds @n bytes from @data into the hash operation on @state. Data can
+ * be split across any number of updates, without affecting the final hash.
+ */
+static inline void c_hash_sip_update(CHashSip *state, const void *data, size_t n) {
+        c_internal_hash_sip_update(state, data, n, 1);
+}
+
+/**
+ * c_hash_sip_final() - finalize SipHash-1-3 state
+ * @state:              state to finalize
+ *
+ * This finalizes the hash operation on @state. The state must be
+ * re-initialized before it can be used again.
+ *
+ * Return: The hash of all data fed into @state.
+ */
+static inline uint64_t c_hash_sip_final(CHashSip *state) {
+        return c_internal_hash_sip_final(state, 1, 3);
+}
+
+/**
+ * c_hash_sip() - hash data with SipHash-1-3
+ * @key:                secret key of C_HASH_SIP_KEY_SIZE bytes
+ * @data:               data to hash
+ * @n:                  length of @data in bytes
+ *
+ * This is equivalent to a single streaming update.
+ *
+ * Return: The hash of @data keyed with @key.
+ */
+static inline uint64_t c_hash_sip(const void *key, const void *data, size_t n) {
+        CHashSip state;
+
+        c_hash_sip_init(&state, key);
+        c_hash_sip_update(&state, data, n);
+        return c_hash_sip_final(&state);
+}
+
+static const uint64_t c_internal_hash_fast_secret[4] = {
+        UINT64_C(0x2d358dccaa6c78a5),
+        UINT64_C(0x8bb84b93962eacc9),
+        UINT64_C(0x4b33a62ed433d4a3),
+        UINT64_C(0x4d5a2da51de1aa47),
+};
+
+/*
+ * Computes the full 128-bit product of *@a and *@b, and returns the low half
+ * in @a and the high half in @b. This is the fallback for compilers without
+ * 128-bit integers.
+ */
+static inline void c_internal_hash_fast_mum_portable(uint64_t *a, uint64_t *b) {
+        uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+        uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+        uint64_t t = rl + (rm0 << 32), c = t < rl, lo, hi;
+
+        lo = t + (rm1 << 32);
+        c += lo < t;
+        hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+
+        *a = lo;
+        *b = hi;
+}
+
+static inline void c_internal_hash_fast_mum(uint64_t *a, uint64_t *b) {
+#if defined(__SIZEOF_INT128__)
+        unsigned __int128 r = (unsigned __int128)*a * *b;
+
+        *a = (uint64_t)r;
+        *b = (uint64_t)(r >> 64);
+#else
+        c_internal_hash_fast_mum_portable(a, b);
+#endif
+}
+
+static inline uint64_t c_internal_hash_fast_mix(uint64_t a, uint64_t b) {
+        c_internal_hash_fast_mum(&a, &b);
+        return a ^ b;
+}
+
+static inline uint64_t c_internal_hash_fast_seed(uint64_t seed) {
+        return seed ^ c_internal_hash_fast_mix(seed ^ c_internal_hash_fast_secret[0], c_internal_hash_fast_secret[1]);
+}
+
+static inline void c_internal_hash_fast_block(CHashFast *state, const unsigned char *p) {
+        const uint64_t *s = c_internal_hash_fast_secret;
+
+        state->seed = c_internal_hash_fast_mix(c_internal_hash_read64(p) ^ s[1], c_internal_hash_read64(p + 8) ^ state->seed);
+        state->see1 = c_internal_hash_fast_mix(c_internal_hash_read64(p + 16) ^ s[2], c_internal_hash_read64(p + 24) ^ state->see1);
+        state->see2 = c_internal_hash_fast_mix(c_internal_hash_read64(p + 32) ^ s[3], c_internal_hash_read64(p + 40) ^ state->see2);
+}
+
+/*
+ * This hashes the last @n bytes at @p, after all 48-byte blocks were
+ * consumed. If there were any blocks, @n is smaller than 48 and the 16 bytes
+ * preceding @p must be readable, since the final read may overlap the last
+ * block.
+ */
+static inline uint64_t c_internal_hash_fast_tail(uint64_t seed, uint64_t see1, uint64_t see2, size_t len, const unsigned char *p, size_t n) {
+        const uint64_t *s = c_internal_hash_fast_secret;
+        uint64_t a, b;
+
+        if (len <= 16) {
+                if (len >= 4) {
+                        a = (c_internal_hash_read32(p) << 32) | c_internal_hash_read32(p + ((len >> 3) << 2));
+                        b = (c_internal_hash_read32(p + len - 4) << 32) | c_internal_hash_read32(p + len - 4 - ((len >> 3) << 2));
+                } else if (len > 0) {
+                        a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+                        b = 0;
+                } else {
+                        a = b = 0;
+                }
+        } else {
+                if (len >= 48)
+                        seed ^= see1 ^ see2;
+
+                for ( ; n > 16; n -= 16, p += 16)
+                        seed = c_internal_hash_fast_mix(c_internal_hash_read64(p) ^ s[1], c_internal_hash_read64(p + 8) ^ seed);
+
+                a = c_internal_hash_read64(p + n - 16);
+                b = c_internal_hash_read64(p + n - 8);
+        }
+
+        a ^= s[1];
+        b ^= seed;
+        c_internal_hash_fast_mum(&a, &b);
+        return c_internal_hash_fast_mix(a ^ s[0] ^ len, b ^ s[1]);
+}
+
+/**
+ * c_hash_fast_init() - initialize fast hash state
+ * @state:              state to initialize
+ * @seed:               seed to use
+ *
+ * This initializes @state for a new streaming hash operation. Different seeds
+ * yield unrelated hash functions, but the seed is no secret.
+ */
+static inline void c_hash_fast_init(CHashFast *state, uint64_t seed) {
+        seed = c_internal_hash_fast_seed(seed);
+
+        state->seed = seed;
+        state->see1 = seed;
+        state->see2 = seed;
+        state->len = 0;
+        state->n_pending = 0;
+}
+
+/**
+ * c_hash_fast_update() - feed data into fast hash state
+ * @state:              state to operate on
+ * @data:               data to hash
+ * @n:                  length of @data in bytes
+ *
+ * This feeds @n bytes from @data into the hash operation on @state. Data can
+ * be split across any number of updates, without affecting the final hash.
+ */
+static inline void c_hash_fast_update(CHashFast *state, const void *data, size_t n) {
+        const unsigned char *p = data;
+        size_t k;
+
+        /*
+         * The buffer keeps the last 16 consumed bytes in front of the up to
+         * 48 pending bytes, since the finalization might need them.
+         */
+        state->len += n;
+
+        if (state->n_pending) {
+                k = c_min(n, 48 - state->n_pending);
+                memcpy(state->buffer + 16 + state->n_pending, p, k);
+                state->n_pending += k;
+                p += k;
+                n -= k;
+
+                if (state->n_pending < 48)
+                        return;
+
+                c_internal_hash_fast_block(state, state->buffer + 16);
+                memcpy(state->buffer, state->buffer + 48, 16);
+                state->n_pending = 0;
+        }
+
+        if (n >= 48) {
+                do {
+                        c_internal_hash_fast_block(state, p);
+                        p += 48;
+                        n -= 48;
+                } while (n >= 48);
+
+                memcpy(state->buffer, p - 16, 16);
+        }
+
+        memcpy(state->buffer + 16, p, n);
+        state->n_pending = n;
+}
+
+/**
+ * c_hash_fast_final() - finalize fast hash state
+ * @state:              state to finalize
+ *
+ * This finalizes the hash operation on @state. The state must be
+ * re-initialized before it can be used again.
+ *
+ * Return: The hash of all data fed into @state.
+ */
+static inline uint64_t c_hash_fast_final(CHashFast *state) {
+        return c_internal_hash_fast_tail(state->seed,
+                                       state->see1,
+                                       state->see2,
+                                       state->len,
+                                       state->buffer + 16,
+                                       state->n_pending);
+}
+
+/**
+ * c_hash_fast() - hash data with the fast hash
+ * @seed:               seed to use
+ * @data:               data to hash
+ * @n:                  length of @data in bytes
+ *
+ * This is equivalent to a single streaming update, but avoids buffering.
+ *
+ * Return: The hash of @data with seed @seed.
+ */
+static inline uint64_t c_hash_fast(uint64_t seed, const void *data, size_t n) {
+        const unsigned char *p = data;
+        CHashFast state;
+
+        seed = c_internal_hash_fast_seed(seed);
+        state = (CHashFast){ .seed = seed, .see1 = seed, .see2 = seed };
+
+        if (n > 16) {
+                for ( ; n - (p - (const unsigned char *)data) >= 48; p += 48)
+                        c_internal_hash_fast_block(&state, p);
+        }
+
+        return c_internal_hash_fast_tail(state.seed,
+                                       state.see1,
+                                       state.see2,
+                                       n,
+                                       p,
+                                       n - (p - (const unsigned char *)data));
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,446 @@
+#pragma once
+
+/*
+ * String Interning
+ *
+ * This implements a string interning table. It maps each distinct string to a
+ * canonical copy, so strings that went through the table can be compared for
+ * equality by comparing their pointers, rather than their contents.
+ *
+ * Canonical copies are allocated from an arena owned by the table, and stay
+ * valid until the table is destroyed. They are indexed by an open-addressing
+ * hash table with linear probing. Lookups are lock-free: they never block,
+ * and can run from any number of threads in parallel with each other and
+ * with insertions. Insertions are serialized by a mutex. The index is never
+ * modified in place when it grows. Instead, a new one is published and the
+ * old one is retained until the table is destroyed, so concurrent lookups
+ * can always finish on the index they started on.
+ *
+ * Interned strings usually come from untrusted peers. Hashes are therefore
+ * computed with SipHash, keyed with a random key taken from the kernel when
+ * the table is created. Without the key, an attacker cannot choose strings
+ * that collide in the index, so probe lengths stay statistical. The probe
+ * lengths are reported by c_intern_get_stats().
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <c-hash.h>
+#include <c-macro.h>
+#include <c-syscall.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/auxv.h>
+
+typedef struct CIntern CIntern;
+typedef struct CInternStats CInternStats;
+
+typedef struct CInternEntry CInternEntry;
+typedef struct CInternIndex CInternIndex;
+typedef struct CInternChunk CInternChunk;
+
+#define C_INTERNAL_INTERN_CHUNK_SIZE (64UL * 1024UL)
+#define C_INTERNAL_INTERN_INDEX_MIN 64
+
+#ifndef GRND_NONBLOCK
+#  define GRND_NONBLOCK 0x0001
+#endif
+
+/**
+ * struct CInternStats - interning table statistics
+ * @n_entries:          number of distinct strings in the table
+ * @n_bytes:            number of bytes allocated for the arena
+ * @n_bytes_used:       number of arena bytes used by entries
+ * @n_slots:            number of slots in the index
+ * @n_probes:           total number of probes needed to find all entries
+ * @max_probes:         maximum number of probes needed to find an entry
+ *
+ * A lookup of an entry in the table inspects a number of index slots, which
+ * is called its probe length. A probe length of 1 means the entry was found
+ * in its home slot. @n_probes / @n_entries is the average probe length of
+ * successful lookups.
+ */
+struct CInternStats {
+        size_t n_entries;
+        size_t n_bytes;
+        size_t n_bytes_used;
+        size_t n_slots;
+        size_t n_probes;
+        size_t max_probes;
+};
+
+struct CInternEntry {
+        uint64_t hash;
+        size_t len;
+        char str[];
+};
+
+struct CInternIndex {
+        CInternIndex *retired;
+        size_t n_slots;
+        _Atomic(CInternEntry *) slots[];
+};
+
+struct CInternChunk {
+        CInternChunk *next;
+        size_t size;
+        size_t used;
+        _c_alignas_(CInternEntry) char data[];
+};
+
+/**
+ * struct CIntern - string interning table
+ *
+ * All members are private to the implementation.
+ */
+struct CIntern {
+        _Atomic(CInternIndex *) index;
+        pthread_mutex_t lock;
+        CInternChunk *chunks;
+        CInternStats stats;
+        uint8_t key[C_HASH_SIP_KEY_SIZE];
+};
+
+static inline uint64_t c_internal_intern_hash(CIntern *intern, const char *str, size_t n) {
+        return c_hash_sip(intern->key, str, n);
+}
+
+/*
+ * c_internal_intern_random() - generate hash key
+ *
+ * This takes the key from getrandom(2), without blocking, so tables can be
+ * created in early-boot processes before the kernel entropy pool is
+ * initialized. If that fails, or if getrandom(2) is not supported or is
+ * filtered, the key is derived from the random bytes the kernel passes to
+ * every process in AT_RANDOM, and from a counter, so every table still gets a
+ * distinct key, unknown to an attacker.
+ */
+static inline int c_internal_intern_random(uint8_t *key) {
+        static _Atomic(uint64_t) counter;
+        const void *at_random;
+        uint64_t v, words[2];
+        int r;
+
+        do {
+                r = c_syscall_getrandom(key, C_HASH_SIP_KEY_SIZE, GRND_NONBLOCK);
+        } while (r < 0 && errno == EINTR);
+
+        if (r == C_HASH_SIP_KEY_SIZE)
+                return 0;
+        if (r < 0 && errno != EAGAIN && errno != ENOSYS && errno != EPERM)
+                return -errno;
+
+        at_random = (const void *)getauxval(AT_RANDOM);
+        if (!at_random)
+                return -ENOSYS;
+
+        /* AT_RANDOM is 16 bytes, so it can key SipHash itself */
+        v = 2 * atomic_fetch_add_explicit(&counter, 1, memory_order_relaxed);
+        words[0] = c_hash_sip(at_random, &v, sizeof(v));
+        ++v;
+        words[1] = c_hash_sip(at_random, &v, sizeof(v));
+        memcpy(key, words, sizeof(words));
+        return 0;
+}
+
+/**
+ * c_intern_new() - create interning table
+ * @internp:            output argument for the new table
+ *
+ * This creates a new, empty interning table, with a random hash key.
+ *
+ * Return: 0 on success, -ENOMEM on allocation failure, or a negative error
+ *         code if no random key can be obtained.
+ */
+static inline int c_intern_new(CIntern **internp) {
+        CInternIndex *index;
+        CIntern *intern;
+        uint8_t key[C_HASH_SIP_KEY_SIZE];
+        size_t i;
+        int r;
+
+        r = c_internal_intern_random(key);
+        if (r)
+                return r;
+
+        intern = calloc(1, sizeof(*intern));
+        if (!intern)
+                return -ENOMEM;
+
+        index = malloc(sizeof(*index) + C_INTERNAL_INTERN_INDEX_MIN * sizeof(*index->slots));
+        if (!index) {
+                free(intern);
+                return -ENOMEM;
+        }
+
+        index->retired = NULL;
+        index->n_slots = C_INTERNAL_INTERN_INDEX_MIN;
+        for (i = 0; i < index->n_slots; ++i)
+                atomic_init(&index->slots[i], NULL);
+
+        atomic_init(&intern->index, index);
+        pthread_mutex_init(&intern->lock, NULL);
+        intern->stats.n_slots = index->n_slots;
+        memcpy(intern->key, key, sizeof(key));
+
+        *internp = intern;
+        return 0;
+}
+
+/**
+ * c_intern_free() - destroy interning table
+ * @intern:             table to destroy, or NULL
+ *
+ * This destroys @intern and releases all its resources, including all
+ * canonical strings. The caller must make sure no other thread accesses the
+ * table anymore. If NULL is passed, this is a no-op.
+ *
+ * Return: NULL is returned.
+ */
+static inline CIntern *c_intern_free(CIntern *intern) {
+        CInternIndex *index;
+        CInternChunk *chunk;
+
+        if (!intern)
+                return NULL;
+
+        while ((index = atomic_load_explicit(&intern->index, memory_order_relaxed))) {
+                atomic_store_explicit(&intern->index, index->retired, memory_order_relaxed);
+                free(index);
+        }
+
+        while ((chunk = intern->chunks)) {
+                intern->chunks = chunk->next;
+                free(chunk);
+        }
+
+        pthread_mutex_destroy(&intern->lock);
+        free(intern);
+        return NULL;
+}
+
+C_DEFINE_CLEANUP(CIntern *, c_intern_free);
+
+static inline CInternEntry *c_internal_intern_find(CInternIndex *index, const char *str, size_t n, uint64_t hash, size_t *slotp) {
+        CInternEntry *entry;
+        size_t i, mask = index->n_slots - 1;
+
+        for (i = hash & mask; ; i = (i + 1) & mask) {
+                entry = atomic_load_explicit(&index->slots[i], memory_order_acquire);
+                if (!entry || (entry->hash == hash && entry->len == n && !memcmp(entry->str, str, n)))
+                        break;
+        }
+
+        if (slotp)
+                *slotp = i;
+        return entry;
+}
+
+/**
+ * c_intern_lookup() - look up canonical string
+ * @intern:             table to operate on
+ * @str:                string to look up
+ * @n:                  length of @str in bytes
+ *
+ * This looks up the canonical copy of the string given as @str and @n. The
+ * table is not modified. This never blocks, and is safe to call in parallel to
+ * any other operation on the table but c_intern_free().
+ *
+ * Return: Pointer to the zero-terminated canonical copy of @str, or NULL if
+ *         it was not interned, yet.
+ */
+static inline const char *c_intern_lookup(CIntern *intern, const char *str, size_t n) {
+        CInternIndex *index;
+        CInternEntry *entry;
+
+        index = atomic_load_explicit(&intern->index, memory_order_acquire);
+        entry = c_internal_intern_find(index, str, n, c_internal_intern_hash(intern, str, n), NULL);
+        return entry ? entry->str : NULL;
+}
+
+static inline CInternEntry *c_internal_intern_alloc(CIntern *intern, size_t n) {
+        CInternChunk *chunk = intern->chunks;
+        CInternEntry *entry;
+        size_t size, chunk_size;
+
+        if (n > SIZE_MAX - sizeof(*chunk) - sizeof(*entry) - _Alignof(CInternEntry))
+                return NULL;
+
+        size = sizeof(*entry) + n + 1;
+        size = (size + _Alignof(CInternEntry) - 1) & ~(_Alignof(CInternEntry) - 1);
+
+        if (!chunk || chunk->size - chunk->used < size) {
+                chunk_size = c_max(size, C_INTERNAL_INTERN_CHUNK_SIZE - sizeof(*chunk));
+                chunk = malloc(sizeof(*chunk) + chunk_size);
+                if (!chunk)
+                        return NULL;
+
+                chunk->size = chunk_size;
+                chunk->used = 0;
+
+                /*
+                 * Oversized entries get a chunk of their own, which is queued
+                 * behind the current chunk, so its free space is not lost.
+                 */
+                if (chunk_size > C_INTERNAL_INTERN_CHUNK_SIZE - sizeof(*chunk) && intern->chunks) {
+                        chunk->next = intern->chunks->next;
+                        intern->chunks->next = chunk;
+                } else {
+                        chunk->next = intern->chunks;
+                        intern->chunks = chunk;
+                }
+
+                intern->stats.n_bytes += chunk_size;
+        }
+
+        entry = (CInternEntry *)(chunk->data + chunk->used);
+        chunk->used += size;
+        intern->stats.n_bytes_used += size;
+        return entry;
+}
+
+static inline int c_internal_intern_grow(CIntern *intern, CInternIndex *index, CInternIndex **newp) {
+        CInternIndex *grown;
+        CInternEntry *entry;
+        size_t i, slot, probes;
+
+        if (index->n_slots > (SIZE_MAX - sizeof(*grown)) / sizeof(*grown->slots) / 2)
+                return -ENOMEM;
+
+        grown = malloc(sizeof(*grown) + 2 * index->n_slots * sizeof(*grown->slots));
+        if (!grown)
+                return -ENOMEM;
+
+        grown->retired = index;
+        grown->n_slots = 2 * index->n_slots;
+        for (i = 0; i < grown->n_slots; ++i)
+                atomic_init(&grown->slots[i], NULL);
+
+        intern->stats.n_slots = grown->n_slots;
+        intern->stats.n_probes = 0;
+        intern->stats.max_probes = 0;
+
+        /*
+         * The new index is not visible to anyone, yet, so entries can be
+         * inserted without any ordering. Publishing the index then orders
+         * all of them.
+         */
+        for (i = 0; i < index->n_slots; ++i) {
+                entry = atomic_load_explicit(&index->slots[i], memory_order_relaxed);
+                if (!entry)
+                        continue;
+
+                c_internal_intern_find(grown, entry->str, entry->len, entry->hash, &slot);
+                atomic_store_explicit(&grown->slots[slot], entry, memory_order_relaxed);
+
+                probes = 1 + ((slot - entry->hash) & (grown->n_slots - 1));
+                intern->stats.n_probes += probes;
+                intern->stats.max_probes = c_max(intern->stats.max_probes, probes);
+        }
+
+        atomic_store_explicit(&intern->index, grown, memory_order_release);
+        *newp = grown;
+        return 0;
+}
+
+/**
+ * c_intern_string() - intern string
+ * @intern:             table to operate on
+ * @str:                string to intern
+ * @n:                  length of @str in bytes
+ * @canonicalp:         output argument for the canonical copy
+ *
+ * This looks up the canonical copy of the string given as @str and @n, and
+ * creates it if it does not exist, yet. The canonical copy is zero-terminated
+ * and stays valid until @intern is destroyed. Two strings have the same
+ * canonical copy if, and only if, they are equal. @str may contain
+ * zero-bytes.
+ *
+ * If the string was already interned, this does not take any locks.
+ *
+ * Return: 0 on success, -ENOMEM on allocation failure.
+ */
+static inline int c_intern_string(CIntern *intern, const char *str, size_t n, const char **canonicalp) {
+        CInternIndex *index;
+        CInternEntry *entry;
+        size_t slot, probes;
+        uint64_t hash;
+        int r;
+
+        hash = c_internal_intern_hash(intern, str, n);
+
+        index = atomic_load_explicit(&intern->index, memory_order_acquire);
+        entry = c_internal_intern_find(index, str, n, hash, NULL);
+        if (entry) {
+                *canonicalp = entry->str;
+                return 0;
+        }
+
+        pthread_mutex_lock(&intern->lock);
+
+        /* the string might have been interned since the lookup, so retry */
+        index = atomic_load_explicit(&intern->index, memory_order_relaxed);
+        entry = c_internal_intern_find(index, str, n, hash, &slot);
+        if (entry) {
+                *canonicalp = entry->str;
+                r = 0;
+                goto exit;
+        }
+
+        /* keep the load factor below 3/4 */
+        if (4 * (intern->stats.n_entries + 1) > 3 * index->n_slots) {
+                r = c_internal_intern_grow(intern, index, &index);
+                if (r)
+                        goto exit;
+
+                c_internal_intern_find(index, str, n, hash, &slot);
+        }
+
+        entry = c_internal_intern_alloc(intern, n);
+        if (!entry) {
+                r = -ENOMEM;
+                goto exit;
+        }
+
+        entry->hash = hash;
+        entry->len = n;
+        memcpy(entry->str, str, n);
+        entry->str[n] = 0;
+
+        /* publishing the entry orders its initialization */
+        atomic_store_explicit(&index->slots[slot], entry, memory_order_release);
+
+        probes = 1 + ((slot - hash) & (index->n_slots - 1));
+        ++intern->stats.n_entries;
+        intern->stats.n_probes += probes;
+        intern->stats.max_probes = c_max(intern->stats.max_probes, probes);
+
+        *canonicalp = entry->str;
+        r = 0;
+
+exit:
+        pthread_mutex_unlock(&intern->lock);
+        return r;
+}
+
+/**
+ * c_intern_get_stats() - query interning table statistics
+ * @intern:             table to query
+ * @statsp:             output argument for the statistics
+ *
+ * This returns a consistent snapshot of the statistics of @intern. See
+ * `struct CInternStats` for details.
+ */
+static inline void c_intern_get_stats(CIntern *intern, CInternStats *statsp) {
+        pthread_mutex_lock(&intern->lock);
+        *statsp = intern->stats;
+        pthread_mutex_unlock(&intern->lock);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,264 @@
+#pragma once
+
+/*
+ * Line Reader
+ *
+ * This implements a reader that splits the content of a file descriptor into
+ * lines, and yields each line as a string view, without copying it. Regular
+ * files are mapped into memory in their entirety and advised for sequential
+ * access, so lines point straight into the page cache and reading costs no
+ * syscalls at all. Anything that cannot be mapped (pipes, sockets, character
+ * devices, or files on file systems without mmap support) is read into a
+ * large buffer instead, which only copies each byte once. Newlines are
+ * located with memchr(), which is vectorized by all common C libraries.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <c-macro.h>
+#include <c-string.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct CLines CLines;
+
+#define C_INTERNAL_LINES_BUFFER_SIZE (128UL * 1024UL)
+#define C_INTERNAL_LINES_VERIFY_SIZE (64UL * 1024UL)
+
+enum {
+        C_LINES_VERIFY_UTF8             = (1U << 0),
+};
+
+/**
+ * struct CLines - line reader
+ *
+ * All members are private to the implementation.
+ */
+struct CLines {
+        int fd;
+        unsigned int flags;
+        bool eof;
+        char *map;
+        char *buf;
+        size_t size;
+        size_t start;
+        size_t scanned;
+        size_t verified;
+        size_t end;
+};
+
+/**
+ * c_lines_new() - create line reader
+ * @linesp:             output argument for the new reader
+ * @fd:                 file descriptor to read from
+ * @flags:              C_LINES_* flags
+ *
+ * This creates a new line reader for @fd. If @fd refers to a non-empty
+ * regular file, the file is mapped from its current position to its end.
+ * Otherwise, it is read from its current position until end-of-file. The
+ * reader does not take ownership of @fd, but the caller must keep it open
+ * until the reader is destroyed. A mapped file must not be truncated while
+ * the reader exists, since accessing the lost pages raises SIGBUS.
+ *
+ * If C_LINES_VERIFY_UTF8 is given, every line is verified with
+ * c_string_verify_utf8() before it is yielded.
+ *
+ * Return: 0 on success, -ENOMEM on allocation failure, or a negative error
+ *         code if @fd cannot be queried.
+ */
+static inline int c_lines_new(CLines **linesp, int fd, unsigned int flags) {
+        CLines *lines;
+        struct stat st;
+        off_t offset;
+        void *map;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        lines = calloc(1, sizeof(*lines));
+        if (!lines)
+                return -ENOMEM;
+
+        lines->fd = fd;
+        lines->flags = flags;
+
+        /*
+         * Map regular files, and fall back to reading if that is not
+         * possible. The mapping must start at a page boundary, so the
+         * part before the current position is skipped after mapping.
+         */
+        offset = S_ISREG(st.st_mode) ? lseek(fd, 0, SEEK_CUR) : -1;
+        if (offset >= 0 && st.st_size > offset && (uintmax_t)st.st_size <= SIZE_MAX) {
+                map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (map != MAP_FAILED) {
+                        madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+                        lines->map = map;
+                        lines->size = st.st_size;
+                        lines->start = offset;
+                        lines->scanned = offset;
+                        lines->end = st.st_size;
+                        lines->eof = true;
+                }
+        }
+
+        *linesp = lines;
+        return 0;
+}
+
+/**
+ * c_lines_free() - destroy line reader
+ * @lines:              reader to destroy, or NULL
+ *
+ * This destroys @lines and releases all its resources. All lines yielded by
+ * it become invalid. The file descriptor is not closed. If NULL is passed,
+ * this is a no-op.
+ *
+ * Return: NULL is returned.
+ */
+static inline CLines *c_lines_free(CLines *lines) {
+        if (!lines)
+                return NULL;
+
+        if (lines->map)
+                munmap(lines->map, lines->size);
+        free(lines->buf);
+        free(lines);
+        return NULL;
+}
+
+C_DEFINE_CLEANUP(CLines *, c_lines_free);
+
+/*
+ * c_internal_lines_fill() - read more data into the buffer
+ *
+ * This moves the unconsumed data to the front of the buffer, grows the buffer
+ * if it is full, and then reads as much as fits into it.
+ */
+static inline int c_internal_lines_fill(CLines *lines) {
+        size_t size;
+        ssize_t l;
+        char *buf;
+
+        if (lines->start) {
+                memmove(lines->buf, lines->buf + lines->start, lines->end - lines->start);
+                lines->end -= lines->start;
+                lines->scanned -= lines->start;
+                lines->verified = (lines->verified > lines->start) ? lines->verified - lines->start : 0;
+                lines->start = 0;
+        }
+
+        if (lines->end == lines->size) {
+                size = lines->size ? lines->size * 2 : C_INTERNAL_LINES_BUFFER_SIZE;
+                if (size < lines->size)
+                        return -ENOMEM;
+
+                buf = realloc(lines->buf, size);
+                if (!buf)
+                        return -ENOMEM;
+
+                lines->buf = buf;
+                lines->size = size;
+        }
+
+        do {
+                l = read(lines->fd, lines->buf + lines->end, lines->size - lines->end);
+        } while (l < 0 && errno == EINTR);
+
+        if (l < 0)
+                return -errno;
+        if (l == 0)
+                lines->eof = true;
+
+        lines->end += l;
+        return 0;
+}
+
+/**
+ * c_lines_next() - yield next line
+ * @lines:              reader to operate on
+ * @linep:              output argument for the line
+ *
+ * This yields the next line of @lines in @linep. Lines are terminated by a
+ * newline, which is not part of the line. A carriage return before it is
+ * kept. The final line of the input does not need a terminating newline.
+ * Once the input is exhausted, C_STRING_VIEW_NULL is yielded. Note that empty
+ * lines yield empty views, but never the NULL view.
+ *
+ * The yielded line is valid until the next call to c_lines_next() or
+ * c_lines_free(), whichever comes first.
+ *
+ * If the reader verifies UTF-8 and the line is invalid, -EILSEQ is returned.
+ * In that case, the invalid line is still yielded in @linep, so the caller
+ * can report, skip, or sanitize it, and continue with the next line.
+ *
+ * Return: 0 on success, -EILSEQ if the line is not valid UTF-8, -ENOMEM on
+ *         allocation failure, or a negative error code if reading fails.
+ */
+static inline int c_lines_next(CLines *lines, CStringView *linep) {
+        const char *data, *p;
+        size_t len, offset;
+        char *str;
+        int r;
+
+        for (;;) {
+                data = lines->map ? lines->map : lines->buf;
+                p = NULL;
+                if (lines->end > lines->scanned)
+                        p = memchr(data + lines->scanned, '\n', lines->end - lines->scanned);
+                if (p) {
+                        *linep = c_string_view(data + lines->start, p - data - lines->start);
+                        lines->start = p - data + 1;
+                        lines->scanned = lines->start;
+                        break;
+                }
+
+                lines->scanned = lines->end;
+
+                if (lines->eof) {
+                        if (lines->start == lines->end) {
+                                *linep = C_STRING_VIEW_NULL;
+                                return 0;
+                        }
+
+                        *linep = c_string_view(data + lines->start, lines->end - lines->start);
+                        lines->start = lines->end;
+                        break;
+                }
+
+                r = c_internal_lines_fill(lines);
+                if (r)
+                        return r;
+        }
+
+        /*
+         * Lines are usually short, so rather than verifying them one by one,
+         * verify a large block starting at the line, and remember how far it
+         * was valid. A line is valid if it lies entirely in that range. A
+         * block might end in the middle of a character, but this only stops
+         * the range short, so it never fails a valid line.
+         */
+        if (lines->flags & C_LINES_VERIFY_UTF8) {
+                offset = linep->str - data;
+                if (offset + linep->len > lines->verified) {
+                        str = (char *)linep->str;
+                        len = c_max(linep->len, c_min((size_t)C_INTERNAL_LINES_VERIFY_SIZE, lines->end - offset));
+                        c_string_verify_utf8(&str, &len);
+                        lines->verified = str - data;
+                }
+
+                if (offset + linep->len > lines->verified)
+                        return -EILSEQ;
+        }
+
+        return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -126,6 +126,7 @@ extern "C" {
 #define _c_public_ __attribute__((__visibility__("default")))
 #define _c_pure_ __attribute__((__pure__))
 #define _c_sentinel_ __attribute__((__sentinel__))
+#define _c_target_(_x) __attribute__((__target__(_x)))
 #define _c_unlikely_(_x) (__builtin_expect(!!(_x), 0))
 #define _c_unused_ __attribute__((__unused__))
 #define _c_weak_ __attribute__((__weak__))
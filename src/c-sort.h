@@ -0,0 +1,516 @@
+#pragma once
+
+/*
+ * String Sorting
+ *
+ * This implements sorting of string arrays in the order of c_string_compare().
+ * Rather than comparing entire strings with each other, the sort uses
+ * multikey quicksort (Bentley and Sedgewick), which partitions the array by a
+ * single key at a time, and then continues on the next key only for the
+ * strings that share the current one. Keys are 8-byte chunks of the strings,
+ * cached in a side array, so the partitioning loops run on integers rather
+ * than on scattered string data. The cost of sorting strings with long shared
+ * prefixes (like file-system paths) is thus proportional to their
+ * distinguishing prefixes, rather than to the number of comparisons times the
+ * length of the shared prefixes.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <c-macro.h>
+#include <c-string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* partitions up to this size are finished with an insertion sort */
+#define C_INTERNAL_SORT_INSERTION_MAX 16
+/* partitioning steps per key position, before falling back to qsort() */
+#define C_INTERNAL_SORT_LIMIT(_n) (2 * (size_t)c_log2((size_t)(_n)))
+
+/*
+ * c_internal_sort_key() - load sort key of a string
+ *
+ * This returns the first 8 bytes of @str as big-endian integer, padded with
+ * zeros if @str is shorter. Comparing two keys thus yields the same order as
+ * comparing the first 8 bytes of the strings. A key with a zero least
+ * significant byte belongs to a string that ends within it.
+ */
+_c_pure_ static inline uint64_t c_internal_sort_key(const char *str) {
+        uint64_t key = 0;
+        size_t i;
+
+        for (i = 0; i < 8 && str[i]; ++i)
+                key |= (uint64_t)(unsigned char)str[i] << (56 - 8 * i);
+
+        return key;
+}
+
+static inline void c_internal_sort_load(char **strv, uint64_t *keys, size_t n, size_t depth) {
+        size_t i;
+
+        for (i = 0; i < n; ++i)
+                keys[i] = c_internal_sort_key(strv[i] + depth);
+}
+
+static inline int c_internal_sort_compare_address(const void *a, const void *b) {
+        uintptr_t x = (uintptr_t)*(char * const *)a, y = (uintptr_t)*(char * const *)b;
+
+        return (x > y) - (x < y);
+}
+
+static inline void c_internal_sort_swap(char **strv, uint64_t *keys, size_t i, size_t j) {
+        char *s = strv[i];
+        uint64_t k = keys[i];
+
+        strv[i] = strv[j];
+        keys[i] = keys[j];
+        strv[j] = s;
+        keys[j] = k;
+}
+
+_c_const_ static inline uint64_t c_internal_sort_median3(uint64_t a, uint64_t b, uint64_t c) {
+        if (a < b)
+                return (b < c) ? b : (a < c) ? c : a;
+        else
+                return (a < c) ? a : (b < c) ? c : b;
+}
+
+/*
+ * c_internal_sort_insertion() - sort small array of strings
+ *
+ * This sorts the @n non-NULL strings at @strv, which are known to share
+ * their first @depth bytes, with an insertion sort. @keys must contain the
+ * keys of the strings at @depth, and is sorted along.
+ */
+static inline void c_internal_sort_insertion(char **strv, uint64_t *keys, size_t n, size_t depth) {
+        size_t i, j;
+        uint64_t k;
+        char *s;
+        int r;
+
+        for (i = 1; i < n; ++i) {
+                s = strv[i];
+                k = keys[i];
+
+                for (j = i; j > 0; --j) {
+                        if (keys[j - 1] < k)
+                                break;
+                        if (keys[j - 1] == k) {
+                                r = (k & 0xff) ? strcmp(strv[j - 1] + depth + 8, s + depth + 8) : 0;
+                                if (r < 0 || (r == 0 && (uintptr_t)strv[j - 1] < (uintptr_t)s))
+                                        break;
+                        }
+
+                        strv[j] = strv[j - 1];
+                        keys[j] = keys[j - 1];
+                }
+
+                strv[j] = s;
+                keys[j] = k;
+        }
+}
+
+static inline int c_internal_sort_compare(const void *a, const void *b) {
+        int r;
+
+        r = c_string_compare(*(char * const *)a, *(char * const *)b);
+        return r ? r : c_internal_sort_compare_address(a, b);
+}
+
+/*
+ * c_internal_sort_mkqs() - sort array of strings
+ *
+ * This sorts the @n non-NULL strings at @strv, which are known to share
+ * their first @depth bytes, with multikey quicksort. @keys must contain the
+ * keys of the strings at @depth, and is sorted along.
+ *
+ * Each step partitions the strings into those with a smaller, equal, or
+ * bigger key than the pivot. Only the strings with equal keys need their
+ * next key loaded, the other partitions continue on the keys at hand. Hence,
+ * every string is dereferenced once per 8 bytes of its distinguishing
+ * prefix, rather than once per comparison. The two smaller partitions are
+ * sorted recursively, the biggest one iteratively, which bounds the
+ * recursion depth to log2(@n).
+ *
+ * Like introsort, at most @limit partitioning steps are spent on the same
+ * key position. Once they are used up, the pivots are evidently bad, and the
+ * remainder is sorted with qsort() instead, which bounds the cost per key
+ * position to O(n log n). Moving on to the next key starts with a new limit,
+ * since the strings have then progressed by 8 bytes.
+ */
+static inline void c_internal_sort_mkqs(char **strv, uint64_t *keys, size_t n, size_t depth, size_t limit) {
+        size_t i, lt, gt, n_lt, n_eq, n_gt;
+        uint64_t pivot, k;
+
+        while (n > C_INTERNAL_SORT_INSERTION_MAX) {
+                if (!limit--) {
+                        qsort(strv, n, sizeof(*strv), c_internal_sort_compare);
+                        return;
+                }
+
+                pivot = c_internal_sort_median3(keys[0], keys[n / 2], keys[n - 1]);
+
+                for (i = 0, lt = 0, gt = n; i < gt; ) {
+                        k = keys[i];
+                        if (k < pivot)
+                                c_internal_sort_swap(strv, keys, lt++, i++);
+                        else if (k > pivot)
+                                c_internal_sort_swap(strv, keys, i, --gt);
+                        else
+                                ++i;
+                }
+
+                /* strings that end within the pivot are equal, order them by address */
+                n_lt = lt;
+                n_eq = gt - lt;
+                n_gt = n - gt;
+
+                if (!(pivot & 0xff)) {
+                        qsort(strv + lt, n_eq, sizeof(*strv), c_internal_sort_compare_address);
+                        n_eq = 0;
+                }
+
+                if (n_lt >= n_eq && n_lt >= n_gt) {
+                        c_internal_sort_load(strv + lt, keys + lt, n_eq, depth + 8);
+                        c_internal_sort_mkqs(strv + lt, keys + lt, n_eq, depth + 8, C_INTERNAL_SORT_LIMIT(n_eq));
+                        c_internal_sort_mkqs(strv + gt, keys + gt, n_gt, depth, limit);
+                        n = n_lt;
+                } else if (n_gt >= n_eq) {
+                        c_internal_sort_mkqs(strv, keys, n_lt, depth, limit);
+                        c_internal_sort_load(strv + lt, keys + lt, n_eq, depth + 8);
+                        c_internal_sort_mkqs(strv + lt, keys + lt, n_eq, depth + 8, C_INTERNAL_SORT_LIMIT(n_eq));
+                        strv += gt;
+                        keys += gt;
+                        n = n_gt;
+                } else {
+                        c_internal_sort_mkqs(strv, keys, n_lt, depth, limit);
+                        c_internal_sort_mkqs(strv + gt, keys + gt, n_gt, depth, limit);
+                        strv += lt;
+                        keys += lt;
+                        n = n_eq;
+                        depth += 8;
+                        limit = C_INTERNAL_SORT_LIMIT(n);
+                        c_internal_sort_load(strv, keys, n, depth);
+                }
+        }
+
+        c_internal_sort_insertion(strv, keys, n, depth);
+}
+
+/**
+ * c_sort_strings() - sort array of strings
+ * @strv:               array of strings to sort
+ * @n:                  number of entries in @strv
+ *
+ * This sorts the @n strings at @strv in place, in ascending order as defined
+ * by c_string_compare(). That is, NULL entries are allowed and sort before
+ * all other strings. Equal strings are ordered by their address, so the
+ * result is fully determined by the input.
+ *
+ * Unlike qsort() with a string comparator, this never compares bytes of a
+ * prefix that is known to be shared, which makes a big difference for keys
+ * with long common prefixes. It needs 8 bytes of temporary memory per string.
+ * If that cannot be allocated, this falls back to qsort().
+ */
+static inline void c_sort_strings(char **strv, size_t n) {
+        size_t i, n_null = 0;
+        uint64_t *keys;
+
+        if (n < 2)
+                return;
+
+        for (i = 0; i < n; ++i) {
+                if (!strv[i]) {
+                        strv[i] = strv[n_null];
+                        strv[n_null++] = NULL;
+                }
+        }
+
+        strv += n_null;
+        n -= n_null;
+
+        keys = malloc(n * sizeof(*keys) + 1);
+        if (!keys) {
+                qsort(strv, n, sizeof(*strv), c_internal_sort_compare);
+                return;
+        }
+
+        c_internal_sort_load(strv, keys, n, 0);
+        c_internal_sort_mkqs(strv, keys, n, 0, C_INTERNAL_SORT_LIMIT(n));
+        free(keys);
+}
+
+/* arrays smaller than this are not worth the threading overhead */
+#define C_INTERNAL_SORT_PARALLEL_MIN (1UL << 16)
+#define C_INTERNAL_SORT_THREADS_MAX 256
+/* buckets per thread, and samples per bucket */
+#define C_INTERNAL_SORT_OVERSPLIT 8
+#define C_INTERNAL_SORT_OVERSAMPLE 16
+
+typedef struct CInternalSortContext CInternalSortContext;
+typedef struct CInternalSortWorker CInternalSortWorker;
+
+struct CInternalSortContext {
+        char **strv;
+        char **tmp;
+        uint64_t *keys;
+        uint32_t *buckets;
+        size_t n;
+        size_t n_threads;
+        size_t n_buckets;
+        char **splitters;
+        uint64_t *splitter_keys;
+        size_t splitter_depth;
+        size_t *offsets;
+        size_t *starts;
+        _Atomic size_t next;
+        void (*fn) (CInternalSortContext *ctx, size_t idx);
+};
+
+struct CInternalSortWorker {
+        CInternalSortContext *ctx;
+        size_t idx;
+        pthread_t thread;
+        bool running;
+};
+
+static inline void *c_internal_sort_worker(void *userdata) {
+        CInternalSortWorker *worker = userdata;
+
+        worker->ctx->fn(worker->ctx, worker->idx);
+        return NULL;
+}
+
+/*
+ * c_internal_sort_run() - run a phase of the parallel sort
+ *
+ * This runs @fn once for every thread index, in parallel, and waits for all
+ * of them to finish. The calling thread takes index 0. If a thread cannot be
+ * started, its index is run by the calling thread instead, so the result
+ * never depends on the threads actually available.
+ */
+static inline void c_internal_sort_run(CInternalSortContext *ctx,
+                                       CInternalSortWorker *workers,
+                                       void (*fn) (CInternalSortContext *ctx, size_t idx)) {
+        size_t i;
+
+        ctx->fn = fn;
+
+        for (i = 1; i < ctx->n_threads; ++i) {
+                workers[i].ctx = ctx;
+                workers[i].idx = i;
+                workers[i].running = !pthread_create(&workers[i].thread, NULL, c_internal_sort_worker, &workers[i]);
+        }
+
+        fn(ctx, 0);
+
+        for (i = 1; i < ctx->n_threads; ++i) {
+                if (workers[i].running)
+                        pthread_join(workers[i].thread, NULL);
+                else
+                        fn(ctx, i);
+        }
+}
+
+/*
+ * c_internal_sort_classify() - assign strings to buckets
+ *
+ * This finds the bucket of each string in the slice of thread @idx with a
+ * binary search over the splitters. The splitters share their first
+ * splitter_depth bytes, so each string is compared against that prefix once,
+ * and strings outside of it go straight to the first or last bucket. The
+ * search itself runs on the cached 8-byte keys of the string and the
+ * splitters behind the prefix, so most steps compare two integers rather than
+ * touching the splitter strings. Only on equal keys are the strings compared
+ * past the key, and only if those are equal too, by address.
+ */
+static inline void c_internal_sort_classify(CInternalSortContext *ctx, size_t idx) {
+        size_t i, lo, hi, mid, depth = ctx->splitter_depth, *counts = ctx->offsets + idx * ctx->n_buckets;
+        uint64_t key;
+        char *str;
+        int r;
+
+        for (i = idx * ctx->n / ctx->n_threads; i < (idx + 1) * ctx->n / ctx->n_threads; ++i) {
+                str = ctx->strv[i];
+
+                /* find the first splitter bigger than the string */
+                lo = 0;
+                hi = ctx->n_buckets - 1;
+
+                r = strncmp(str, ctx->splitters[0], depth);
+                if (r < 0)
+                        hi = 0;
+                else if (r > 0)
+                        lo = hi;
+                else
+                        key = c_internal_sort_key(str + depth);
+
+                while (lo < hi) {
+                        mid = lo + (hi - lo) / 2;
+                        if (key != ctx->splitter_keys[mid]) {
+                                r = (key < ctx->splitter_keys[mid]) ? -1 : 1;
+                        } else {
+                                r = (key & 0xff) ? strcmp(str + depth + 8, ctx->splitters[mid] + depth + 8) : 0;
+                                if (!r)
+                                        r = c_internal_sort_compare_address(&str, &ctx->splitters[mid]);
+                        }
+
+                        if (r < 0)
+                                hi = mid;
+                        else
+                                lo = mid + 1;
+                }
+
+                ctx->buckets[i] = lo;
+                ++counts[lo];
+        }
+}
+
+static inline void c_internal_sort_scatter(CInternalSortContext *ctx, size_t idx) {
+        size_t i, *offsets = ctx->offsets + idx * ctx->n_buckets;
+
+        for (i = idx * ctx->n / ctx->n_threads; i < (idx + 1) * ctx->n / ctx->n_threads; ++i)
+                ctx->tmp[offsets[ctx->buckets[i]]++] = ctx->strv[i];
+}
+
+static inline void c_internal_sort_buckets(CInternalSortContext *ctx, size_t idx) {
+        size_t b, start, n;
+
+        while ((b = atomic_fetch_add_explicit(&ctx->next, 1, memory_order_relaxed)) < ctx->n_buckets) {
+                start = ctx->starts[b];
+                n = ctx->starts[b + 1] - start;
+
+                c_internal_sort_load(ctx->tmp + start, ctx->keys + start, n, 0);
+                c_internal_sort_mkqs(ctx->tmp + start, ctx->keys + start, n, 0, C_INTERNAL_SORT_LIMIT(n));
+                memcpy(ctx->strv + start, ctx->tmp + start, n * sizeof(*ctx->strv));
+        }
+}
+
+/**
+ * c_sort_strings_parallel() - sort array of strings on multiple threads
+ * @strv:               array of strings to sort
+ * @n:                  number of entries in @strv
+ * @n_threads:          maximum number of threads to use, or 0
+ *
+ * This sorts the @n strings at @strv in place, exactly like c_sort_strings(),
+ * but distributes the work across up to @n_threads threads, including the
+ * calling thread. If 0 is passed, one thread per online CPU is used. The
+ * result is identical to c_sort_strings(), regardless of the number of
+ * threads. Small arrays are sorted on the calling thread.
+ *
+ * This is a sample sort: splitters are picked from an evenly spaced sample of
+ * the input, all strings are distributed into the buckets between the
+ * splitters in parallel, and the buckets are then sorted in parallel. There
+ * are several buckets per thread, so uneven buckets are balanced out. Apart
+ * from the threads, this needs 20 bytes of temporary memory per string.
+ *
+ * Callers that never sort on multiple threads should use c_sort_strings(),
+ * which does not depend on pthreads at all.
+ *
+ * Return: 0 on success, -ENOMEM on allocation failure. On failure, @strv is
+ *         left as a permutation of the input.
+ */
+static inline int c_sort_strings_parallel(char **strv, size_t n, size_t n_threads) {
+        CInternalSortContext ctx = {};
+        CInternalSortWorker *workers = NULL;
+        size_t i, j, n_null = 0, n_samples, sum;
+        char **samples = NULL;
+        long n_cpus;
+        int r;
+
+        if (!n_threads) {
+                n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                n_threads = (n_cpus > 0) ? (size_t)n_cpus : 1;
+        }
+
+        n_threads = c_min(n_threads, (size_t)C_INTERNAL_SORT_THREADS_MAX);
+        if (n_threads < 2 || n < C_INTERNAL_SORT_PARALLEL_MIN) {
+                c_sort_strings(strv, n);
+                return 0;
+        }
+
+        for (i = 0; i < n; ++i) {
+                if (!strv[i]) {
+                        strv[i] = strv[n_null];
+                        strv[n_null++] = NULL;
+                }
+        }
+
+        if (n - n_null < C_INTERNAL_SORT_PARALLEL_MIN) {
+                c_sort_strings(strv + n_null, n - n_null);
+                return 0;
+        }
+
+        ctx.strv = strv + n_null;
+        ctx.n = n - n_null;
+        ctx.n_threads = n_threads;
+        ctx.n_buckets = n_threads * C_INTERNAL_SORT_OVERSPLIT;
+        n_samples = ctx.n_buckets * C_INTERNAL_SORT_OVERSAMPLE;
+
+        ctx.tmp = malloc(ctx.n * sizeof(*ctx.tmp));
+        ctx.keys = malloc(ctx.n * sizeof(*ctx.keys));
+        ctx.buckets = malloc(ctx.n * sizeof(*ctx.buckets));
+        ctx.offsets = calloc(n_threads * ctx.n_buckets, sizeof(*ctx.offsets));
+        ctx.starts = malloc((ctx.n_buckets + 1) * sizeof(*ctx.starts));
+        ctx.splitter_keys = malloc(ctx.n_buckets * sizeof(*ctx.splitter_keys));
+        samples = malloc(n_samples * sizeof(*samples));
+        workers = calloc(n_threads, sizeof(*workers));
+        if (!ctx.tmp || !ctx.keys || !ctx.buckets || !ctx.offsets || !ctx.starts ||
+            !ctx.splitter_keys || !samples || !workers) {
+                r = -ENOMEM;
+                goto exit;
+        }
+
+        /*
+         * Strings are bucketed by the same total order c_sort_strings()
+         * produces, including the tie-break on addresses. Hence, the
+         * concatenation of the sorted buckets is exactly the result of
+         * c_sort_strings(), no matter where the splitters fall. The sorted
+         * sample is compacted into the splitters in place.
+         */
+        for (i = 0; i < n_samples; ++i)
+                samples[i] = ctx.strv[i * (ctx.n / n_samples)];
+        c_sort_strings(samples, n_samples);
+        for (i = 0; i < ctx.n_buckets - 1; ++i)
+                samples[i] = samples[(i + 1) * C_INTERNAL_SORT_OVERSAMPLE];
+        ctx.splitters = samples;
+        c_string_compare_lcp(ctx.splitters[0], ctx.splitters[ctx.n_buckets - 2], &ctx.splitter_depth);
+        c_internal_sort_load(ctx.splitters, ctx.splitter_keys, ctx.n_buckets - 1, ctx.splitter_depth);
+
+        c_internal_sort_run(&ctx, workers, c_internal_sort_classify);
+
+        /* turn the per-thread counts into per-thread output offsets */
+        for (j = 0, sum = 0; j < ctx.n_buckets; ++j) {
+                ctx.starts[j] = sum;
+                for (i = 0; i < n_threads; ++i) {
+                        sum += ctx.offsets[i * ctx.n_buckets + j];
+                        ctx.offsets[i * ctx.n_buckets + j] = sum - ctx.offsets[i * ctx.n_buckets + j];
+                }
+        }
+        ctx.starts[ctx.n_buckets] = sum;
+
+        c_internal_sort_run(&ctx, workers, c_internal_sort_scatter);
+        c_internal_sort_run(&ctx, workers, c_internal_sort_buckets);
+
+        r = 0;
+
+exit:
+        free(workers);
+        free(samples);
+        free(ctx.splitter_keys);
+        free(ctx.starts);
+        free(ctx.offsets);
+        free(ctx.buckets);
+        free(ctx.keys);
+        free(ctx.tmp);
+        return r;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -13,8 +13,107 @@ extern "C" {
 #endif
 
 #include <c-macro.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+/*
+ * Some of the helpers below provide vectorized implementations in addition to
+ * their portable reference implementation. Those are compiled with per
+ * function target attributes, and selected at runtime based on the features
+ * of the running CPU. Hence, a single binary runs on all machines of the
+ * given architecture, regardless of the compiler flags used to build it.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#  define C_INTERNAL_STRING_X86 1
+#  include <immintrin.h>
+#else
+#  define C_INTERNAL_STRING_X86 0
+#endif
+
+typedef struct CStringBuf CStringBuf;
+typedef struct CStringSplit CStringSplit;
+typedef struct CStringView CStringView;
+typedef struct CStringUtf8State CStringUtf8State;
+typedef struct CStringUtf8Stats CStringUtf8Stats;
+
+/**
+ * struct CStringView - length-delimited string
+ * @str:                pointer to the first character, or NULL
+ * @len:                length of the string in bytes
+ *
+ * A string view references a string of known length, without owning it. The
+ * referenced string does not need to be zero-terminated, and may contain
+ * zero-bytes. A view with @str set to NULL is the NULL view, which behaves
+ * like a NULL string in c_string_compare() and friends. Views are meant to be
+ * passed by value.
+ */
+struct CStringView {
+        const char *str;
+        size_t len;
+};
+
+#define C_STRING_VIEW_NULL ((CStringView){})
+
+/**
+ * struct CStringUtf8State - state of an incremental UTF-8 verification
+ * @n_valid:            number of bytes verified so far
+ * @n_pending:          number of bytes in @pending
+ * @invalid:            whether invalid data was encountered
+ * @pending:            incomplete character at the end of the last chunk
+ *
+ * This object carries the state of an incremental UTF-8 verification across
+ * chunks. It must be initialized via C_STRING_UTF8_STATE_INIT. @n_valid and
+ * @invalid may be read by the caller, all other members are private.
+ */
+struct CStringUtf8State {
+        size_t n_valid;
+        uint8_t n_pending;
+        bool invalid;
+        unsigned char pending[4];
+};
+
+#define C_STRING_UTF8_STATE_INIT {}
+
+/**
+ * struct CStringUtf8Stats - statistics of a UTF-8 string
+ * @n_chars:            number of code points
+ * @n_lines:            number of newline characters
+ * @max_len:            length in bytes of the longest character, or 0
+ */
+struct CStringUtf8Stats {
+        size_t n_chars;
+        size_t n_lines;
+        unsigned int max_len;
+};
+
+#define C_STRING_BUF_SMALL 64
+
+/**
+ * struct CStringBuf - growable string buffer
+ * @heap:               heap allocated storage, or NULL
+ * @len:                length of the string in bytes
+ * @size:               size of @heap in bytes, or 0
+ * @small:              inline storage used until @heap is allocated
+ *
+ * A string buffer assembles a string piece by piece. Short strings are kept
+ * in the inline storage, so no allocation is needed for them at all. Longer
+ * strings move to the heap, whose size grows geometrically. The string is
+ * always zero-terminated, but may contain zero-bytes itself.
+ *
+ * String buffers must be initialized via C_STRING_BUF_INIT, and released via
+ * c_string_buf_deinit(). All members are private, use c_string_buf_str() and
+ * c_string_buf_len() to access the string.
+ */
+struct CStringBuf {
+        char *heap;
+        size_t len;
+        size_t size;
+        char small[C_STRING_BUF_SMALL];
+};
+
+#define C_STRING_BUF_INIT {}
+
 /**
  * c_string_compare() - compare two strings
  * @a:          first string to compare, or NULL
@@ -48,6 +147,37 @@ _c_pure_ static inline bool c_string_equal(const char *a, const char *b) {
         return (!a || !b) ? (a == b) : !strcmp(a, b);
 }
 
+/**
+ * c_string_compare_lcp() - compare two strings and measure their common prefix
+ * @a:          first string to compare, or NULL
+ * @b:          second string to compare, or NULL
+ * @lcpp:       output argument for the length of the common prefix
+ *
+ * Compare two strings, the same way c_string_compare() does it, and
+ * additionally store the length of their longest common prefix in @lcpp. Both
+ * are computed in a single pass. NULL shares no prefix with any string.
+ *
+ * Callers that compare one string against many similar ones (e.g., while
+ * merging or searching sorted data) can use the common prefix to skip bytes
+ * known to be equal in later comparisons.
+ *
+ * Return: Less than, greater than or equal to zero, as strcmp().
+ */
+static inline int c_string_compare_lcp(const char *a, const char *b, size_t *lcpp) {
+        size_t i;
+
+        if (!a || !b) {
+                *lcpp = 0;
+                return c_string_compare(a, b);
+        }
+
+        for (i = 0; a[i] == b[i] && a[i]; ++i)
+                ;
+
+        *lcpp = i;
+        return (unsigned char)a[i] - (unsigned char)b[i];
+}
+
 /**
  * c_string_prefix() - check prefix of a string
  * @str:        string to check
@@ -64,6 +194,278 @@ _c_pure_ static inline char *c_string_prefix(const char *str, const char *prefix
         return !strncmp(str, prefix, l) ? (char *)str + l : NULL;
 }
 
+/*
+ * Short literal prefixes are compared bytewise with a loop of constant trip
+ * count, which the compiler fully unrolls into compares against immediates.
+ * Each byte is only read if all previous bytes matched, hence we never read
+ * beyond the terminator of @str (a terminator never matches a prefix byte).
+ * Longer literals still save the strlen() call.
+ */
+#define C_INTERNAL_STRING_PREFIX_UNROLL_MAX 16
+
+static inline __attribute__((__always_inline__)) char *c_internal_string_prefix_const(const char *str, const char *prefix, size_t l) {
+        size_t i;
+
+        if (l > C_INTERNAL_STRING_PREFIX_UNROLL_MAX)
+                return !strncmp(str, prefix, l) ? (char *)str + l : NULL;
+
+#pragma GCC unroll 16
+        for (i = 0; i < l; ++i)
+                if (str[i] != prefix[i])
+                        return NULL;
+
+        return (char *)str + l;
+}
+
+/*
+ * If @prefix is a string literal, its length is known at compile time and
+ * the specialized comparison is used. Anything else uses the function. Use
+ * `(c_string_prefix)(...)` to explicitly call the function.
+ */
+#define c_string_prefix(_str, _prefix)                                                  \
+        __builtin_choose_expr(                                                          \
+                C_CC_IS_CONST(_prefix),                                                 \
+                c_internal_string_prefix_const((_str), (_prefix), __builtin_strlen(_prefix)), \
+                (c_string_prefix)((_str), (_prefix)))
+
+/**
+ * c_string_view() - create string view
+ * @str:        pointer to the string, or NULL
+ * @len:        length of @str in bytes
+ *
+ * Return: A string view of the @len bytes at @str.
+ */
+static inline CStringView c_string_view(const char *str, size_t len) {
+        return (CStringView){ .str = str, .len = len };
+}
+
+/**
+ * c_string_view_from() - create string view of a zero-terminated string
+ * @str:        zero-terminated string, or NULL
+ *
+ * Return: A string view of @str, or the NULL view if @str is NULL.
+ */
+static inline CStringView c_string_view_from(const char *str) {
+        return (CStringView){ .str = str, .len = str ? strlen(str) : 0 };
+}
+
+/**
+ * c_string_view_compare() - compare two string views
+ * @a:          first view to compare
+ * @b:          second view to compare
+ *
+ * Compare two string views, the same way c_string_compare() compares strings.
+ * That is, the NULL view compares equal to itself and smaller than any other
+ * view. Otherwise, the views are compared bytewise as unsigned characters,
+ * and a view is smaller than any longer view it is a prefix of.
+ *
+ * Return: Less than, greater than or equal to zero, as strcmp().
+ */
+_c_pure_ static inline int c_string_view_compare(CStringView a, CStringView b) {
+        int r;
+
+        if (!a.str || !b.str)
+                return (a.str == b.str) ? 0 : (a.str ? 1 : -1);
+
+        r = memcmp(a.str, b.str, c_min(a.len, b.len));
+        if (r)
+                return r;
+
+        return (a.len > b.len) - (a.len < b.len);
+}
+
+/**
+ * c_string_view_equal() - compare string views for equality
+ * @a:          first view to compare
+ * @b:          second view to compare
+ *
+ * Compare two string views for equality, the same way c_string_equal()
+ * compares strings. The NULL view compares equal to itself only.
+ *
+ * Return: True if both are equal, false if not.
+ */
+_c_pure_ static inline bool c_string_view_equal(CStringView a, CStringView b) {
+        if (!a.str || !b.str)
+                return a.str == b.str;
+
+        return a.len == b.len && !memcmp(a.str, b.str, a.len);
+}
+
+/**
+ * c_string_view_prefix() - check prefix of a string view
+ * @str:        view to check
+ * @prefix:     prefix to look for
+ *
+ * This checks whether @str starts with @prefix. This is the view-based
+ * equivalent of c_string_prefix(), but never scans for a terminator.
+ *
+ * Return: View of the remainder of @str behind the prefix, or the NULL view
+ *         if not found.
+ */
+_c_pure_ static inline CStringView c_string_view_prefix(CStringView str, CStringView prefix) {
+        if (!str.str || !prefix.str || str.len < prefix.len || memcmp(str.str, prefix.str, prefix.len))
+                return C_STRING_VIEW_NULL;
+
+        return c_string_view(str.str + prefix.len, str.len - prefix.len);
+}
+
+/**
+ * c_string_view_suffix() - check suffix of a string view
+ * @str:        view to check
+ * @suffix:     suffix to look for
+ *
+ * This checks whether @str ends with @suffix.
+ *
+ * Return: View of @str without the suffix, or the NULL view if not found.
+ */
+_c_pure_ static inline CStringView c_string_view_suffix(CStringView str, CStringView suffix) {
+        if (!str.str || !suffix.str || str.len < suffix.len ||
+            memcmp(str.str + str.len - suffix.len, suffix.str, suffix.len))
+                return C_STRING_VIEW_NULL;
+
+        return c_string_view(str.str, str.len - suffix.len);
+}
+
+/**
+ * c_string_view_find() - find substring in a string view
+ * @str:        view to search in
+ * @needle:     substring to look for
+ *
+ * This searches for the first occurrence of @needle in @str, the same way
+ * strstr() does it. An empty needle matches at the start of @str.
+ *
+ * Return: View of @str starting at the first occurrence of @needle, or the
+ *         NULL view if not found.
+ */
+_c_pure_ static inline CStringView c_string_view_find(CStringView str, CStringView needle) {
+        const char *p;
+
+        if (!str.str || !needle.str)
+                return C_STRING_VIEW_NULL;
+
+        p = memmem(str.str, str.len, needle.str, needle.len);
+        if (!p)
+                return C_STRING_VIEW_NULL;
+
+        return c_string_view(p, str.len - (p - str.str));
+}
+
+/**
+ * c_string_view_split() - split string view at separator
+ * @str:        view to split
+ * @sep:        separator to split at
+ * @headp:      output argument for the part before the separator, or NULL
+ * @tailp:      output argument for the part after the separator, or NULL
+ *
+ * This searches for the first occurrence of @sep in @str, and splits @str
+ * into the parts before and after it. The separator itself is part of
+ * neither. If @sep is not found, @headp is set to @str and @tailp to the NULL
+ * view.
+ *
+ * Return: True if @sep was found, false if not.
+ */
+static inline bool c_string_view_split(CStringView str, CStringView sep, CStringView *headp, CStringView *tailp) {
+        CStringView match;
+
+        match = c_string_view_find(str, sep);
+        if (!match.str) {
+                if (headp)
+                        *headp = str;
+                if (tailp)
+                        *tailp = C_STRING_VIEW_NULL;
+                return false;
+        }
+
+        if (headp)
+                *headp = c_string_view(str.str, match.str - str.str);
+        if (tailp)
+                *tailp = c_string_view(match.str + sep.len, match.len - sep.len);
+        return true;
+}
+
+/*
+ * c_internal_string_to_hex_scalar() - reference implementation
+ *
+ * This is the byte-wise reference implementation of c_string_to_hex() and
+ * c_string_to_hex_upper(). @table is the 16-character alphabet to use.
+ */
+static inline void c_internal_string_to_hex_scalar(const char *str, size_t n, char *hex, const char *table) {
+        while (n--) {
+                *hex++ = table[(*str >> 4) & 0x0f];
+                *hex++ = table[(*str++) & 0x0f];
+        }
+}
+
+#if C_INTERNAL_STRING_X86
+
+/*
+ * The vectorized hex encoders split each input byte into its two nibbles, map
+ * both through the alphabet via a byte-shuffle, and interleave the results.
+ */
+
+_c_target_("ssse3")
+static inline void c_internal_string_to_hex_ssse3(const char *str, size_t n, char *hex, const char *table) {
+        const __m128i alphabet = _mm_loadu_si128((const __m128i *)table);
+        const __m128i nibble = _mm_set1_epi8(0x0f);
+        __m128i input, high, low;
+
+        for ( ; n >= sizeof(input); n -= sizeof(input), str += sizeof(input), hex += 2 * sizeof(input)) {
+                input = _mm_loadu_si128((const __m128i *)str);
+                high = _mm_shuffle_epi8(alphabet, _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+                low = _mm_shuffle_epi8(alphabet, _mm_and_si128(input, nibble));
+
+                _mm_storeu_si128((__m128i *)hex, _mm_unpacklo_epi8(high, low));
+                _mm_storeu_si128((__m128i *)hex + 1, _mm_unpackhi_epi8(high, low));
+        }
+
+        c_internal_string_to_hex_scalar(str, n, hex, table);
+}
+
+_c_target_("avx2")
+static inline void c_internal_string_to_hex_avx2(const char *str, size_t n, char *hex, const char *table) {
+        const __m256i alphabet = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)table));
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+        __m256i input, high, low, first, second;
+
+        for ( ; n >= sizeof(input); n -= sizeof(input), str += sizeof(input), hex += 2 * sizeof(input)) {
+                input = _mm256_loadu_si256((const __m256i *)str);
+                high = _mm256_shuffle_epi8(alphabet, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+                low = _mm256_shuffle_epi8(alphabet, _mm256_and_si256(input, nibble));
+
+                /* unpacking works per lane, so fix up the lane order */
+                first = _mm256_unpacklo_epi8(high, low);
+                second = _mm256_unpackhi_epi8(high, low);
+
+                _mm256_storeu_si256((__m256i *)hex, _mm256_permute2x128_si256(first, second, 0x20));
+                _mm256_storeu_si256((__m256i *)hex + 1, _mm256_permute2x128_si256(first, second, 0x31));
+        }
+
+        c_internal_string_to_hex_ssse3(str, n, hex, table);
+}
+
+#endif /* C_INTERNAL_STRING_X86 */
+
+/*
+ * Inputs shorter than this are always encoded with the reference
+ * implementation, as the setup cost of the vectorized variants outweighs
+ * their gain.
+ */
+#define C_INTERNAL_STRING_HEX_SIMD_MIN 16
+
+static inline void c_internal_string_to_hex(const char *str, size_t n, char *hex, const char *table) {
+#if C_INTERNAL_STRING_X86
+        if (n >= 2 * C_INTERNAL_STRING_HEX_SIMD_MIN && __builtin_cpu_supports("avx2")) {
+                c_internal_string_to_hex_avx2(str, n, hex, table);
+                return;
+        }
+        if (n >= C_INTERNAL_STRING_HEX_SIMD_MIN && __builtin_cpu_supports("ssse3")) {
+                c_internal_string_to_hex_ssse3(str, n, hex, table);
+                return;
+        }
+#endif
+        c_internal_string_to_hex_scalar(str, n, hex, table);
+}
+
 /**
  * c_string_to_hex() - encode string as ascii-hex
  * @str:        string to encode from
@@ -71,29 +473,34 @@ _c_pure_ static inline char *c_string_prefix(const char *str, const char *prefix
  * @hex:        destination buffer
  *
  * This hex-encodes the source string into the destination buffer. The
- * destination buffer must be at least twice as big as the source.
+ * destination buffer must be at least twice as big as the source. Lower-case
+ * letters are used for the digits a-f.
  */
 static inline void c_string_to_hex(const char *str, size_t n, char *hex) {
-        static const char table[16] = "0123456789abcdef";
-
-        while (n--) {
-                *hex++ = table[(*str >> 4) & 0x0f];
-                *hex++ = table[(*str++) & 0x0f];
-        }
+        c_internal_string_to_hex(str, n, hex, "0123456789abcdef");
 }
 
 /**
- * c_string_from_hex() - decode ascii-hex string
- * @str:        string buffer to write into
+ * c_string_to_hex_upper() - encode string as upper-case ascii-hex
+ * @str:        string to encode from
  * @n:          length of @str in bytes
- * @hex:        hex encoded buffer to decode
+ * @hex:        destination buffer
  *
- * This hex-decodes @hex into the string buffer @str. Be aware that @hex must
- * be twice the size as @str / @n.
+ * This is the same as c_string_to_hex(), but uses upper-case letters for the
+ * digits A-F.
+ */
+static inline void c_string_to_hex_upper(const char *str, size_t n, char *hex) {
+        c_internal_string_to_hex(str, n, hex, "0123456789ABCDEF");
+}
+
+/*
+ * c_internal_string_hex_table() - hex decoding table
  *
- * Return: True if successful, false if invalid.
+ * This returns the table mapping the lower 7 bits of an ASCII character to the
+ * value of the hex digit, or to 0xff if it is not a hex digit. Callers must
+ * reject characters with the top bit set themselves.
  */
-static inline bool c_string_from_hex(char *str, size_t n, const char *hex) {
+static inline const uint8_t *c_internal_string_hex_table(void) {
         static const uint8_t table[128] = {
                  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
                  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
@@ -104,13 +511,30 @@ static inline bool c_string_from_hex(char *str, size_t n, const char *hex) {
                  -1, 0xa, 0xb, 0xc, 0xd, 0xe, 0xf,  -1, -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
                  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,
         };
+
+        return table;
+}
+
+/*
+ * c_internal_string_from_hex_scalar() - reference implementation
+ *
+ * This is the pair-wise reference implementation of c_string_from_hex_offset().
+ * The vectorized implementations fall back to it to decode the remaining tail,
+ * as well as to pinpoint invalid characters.
+ */
+static inline bool c_internal_string_from_hex_scalar(char *str, size_t n, const char *hex, size_t *offsetp) {
+        const uint8_t *table = c_internal_string_hex_table();
+        const char *start = hex;
         uint8_t v1, v2;
 
         for ( ; n; --n, hex += 2) {
                 v1 = table[hex[0] & 0x7f];
                 v2 = table[hex[1] & 0x7f];
-                if (_c_unlikely_((hex[0] | hex[1] | v1 | v2) & 0x80))
+                if (_c_unlikely_((hex[0] | hex[1] | v1 | v2) & 0x80)) {
+                        if (offsetp)
+                                *offsetp = hex - start + !((hex[0] | v1) & 0x80);
                         return false;
+                }
 
                 *str++ = (v1 << 4) | v2;
         }
@@ -118,147 +542,3864 @@ static inline bool c_string_from_hex(char *str, size_t n, const char *hex) {
         return true;
 }
 
-/**
- * c_string_verify_ascii() - verify that a scring is ASCII encoded
- * @strp:               pointer to string to verify
- * @lenp:               pointer to length of string
- *
- * The first @lenp bytes of the string pointed to by @strp is
- * verified to be ASCII encoded, and @strp and @lenp are updated to
- * point to the first non-ASCII character or the first NULL of the
- * sting, and the remaining number of bytes of the string, respectively.
+#if C_INTERNAL_STRING_X86
+
+/*
+ * The vectorized hex decoders compute the value of every character as both a
+ * decimal digit and a letter. Each character must be valid as exactly one of
+ * them, otherwise the block is handed over to the reference implementation.
+ * The nibbles are then merged pair-wise via a multiply-add with 16 and 1.
  */
-static inline void c_string_verify_ascii(char **strp, size_t *lenp) {
-        unsigned char *str = (unsigned char *) *strp;
-        size_t len = *lenp;
 
-        while (len > 0) {
-                if (_c_unlikely_(*str == 0x00 || *str > 0x7F))
+_c_target_("ssse3")
+static inline __m128i c_internal_string_from_hex_nibbles_ssse3(__m128i input, __m128i *invalid) {
+        __m128i digit, alpha, is_digit, is_alpha;
+
+        digit = _mm_sub_epi8(input, _mm_set1_epi8('0'));
+        alpha = _mm_sub_epi8(_mm_or_si128(input, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+        is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+        is_alpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(5)), alpha);
+
+        *invalid = _mm_or_si128(*invalid, _mm_andnot_si128(_mm_or_si128(is_digit, is_alpha), _mm_set1_epi8(-1)));
+
+        return _mm_maddubs_epi16(_mm_or_si128(_mm_and_si128(is_digit, digit),
+                                              _mm_and_si128(is_alpha, _mm_add_epi8(alpha, _mm_set1_epi8(10)))),
+                                 _mm_set1_epi16(0x0110));
+}
+
+_c_target_("ssse3")
+static inline bool c_internal_string_from_hex_ssse3(char *str, size_t n, const char *hex, size_t *offsetp) {
+        const char *start = hex;
+        __m128i first, second, invalid;
+        size_t offset;
+
+        for ( ; n >= sizeof(first); n -= sizeof(first), str += sizeof(first), hex += 2 * sizeof(first)) {
+                invalid = _mm_setzero_si128();
+                first = c_internal_string_from_hex_nibbles_ssse3(_mm_loadu_si128((const __m128i *)hex), &invalid);
+                second = c_internal_string_from_hex_nibbles_ssse3(_mm_loadu_si128((const __m128i *)hex + 1), &invalid);
+                if (_mm_movemask_epi8(invalid))
                         break;
 
-                ++str;
-                --len;
+                _mm_storeu_si128((__m128i *)str, _mm_packus_epi16(first, second));
         }
 
-        *strp = (char *) str;
-        *lenp = len;
+        if (_c_likely_(c_internal_string_from_hex_scalar(str, n, hex, &offset)))
+                return true;
+
+        if (offsetp)
+                *offsetp = hex - start + offset;
+        return false;
 }
 
-/**
- * c_string_verify_utf8() - verify that a scring is UTF-8 encoded
- * @strp:               pointer to string to verify
- * @lenp:               pointer to length of string
- *
- * Up to the first @lenp bytes of the string pointed to by @strp is
- * verified to be UTF-8 encoded, and @strp and @lenp are updated to
- * point to the first non-UTF-8 character or the first NULL of the
- * string, and the remaining number of bytes of the string,
- * respectively.
- */
-static inline void c_string_verify_utf8(char **strp, size_t *lenp) {
-        unsigned char *str = (unsigned char *)*strp;
-        size_t len = *lenp;
+_c_target_("avx2")
+static inline __m256i c_internal_string_from_hex_nibbles_avx2(__m256i input, __m256i *invalid) {
+        __m256i digit, alpha, is_digit, is_alpha;
 
-        /* See Unicode 9.0.0, Chapter 3, Section D92 */
+        digit = _mm256_sub_epi8(input, _mm256_set1_epi8('0'));
+        alpha = _mm256_sub_epi8(_mm256_or_si256(input, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+        is_digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+        is_alpha = _mm256_cmpeq_epi8(_mm256_min_epu8(alpha, _mm256_set1_epi8(5)), alpha);
 
-        while (len > 0) {
-                if (_c_unlikely_(*str == 0x00)) {
-                        break;
-                } else if (*str < 0x80) {
-                        ++str;
-                        --len;
-                } else if (_c_unlikely_(*str < 0xC2)) {
-                        break;
-                } else if (*str < 0xE0) {
-                        if (_c_unlikely_(len < 2))
-                                break;
-                        if (_c_unlikely_(*(str + 1) < 0x80 || *(str + 1) > 0xBF))
-                                break;
+        *invalid = _mm256_or_si256(*invalid, _mm256_andnot_si256(_mm256_or_si256(is_digit, is_alpha), _mm256_set1_epi8(-1)));
 
-                        str += 2;
-                        len -= 2;
-                } else if (*str < 0xE1) {
-                        if (_c_unlikely_(len < 3))
-                                break;
-                        if (_c_unlikely_(*(str + 1) < 0xA0 || *(str + 1) > 0xBF))
-                                break;
-                        if (_c_unlikely_(*(str + 2) < 0x80 || *(str + 2) > 0xBF))
-                                break;
+        return _mm256_maddubs_epi16(_mm256_or_si256(_mm256_and_si256(is_digit, digit),
+                                                    _mm256_and_si256(is_alpha, _mm256_add_epi8(alpha, _mm256_set1_epi8(10)))),
+                                    _mm256_set1_epi16(0x0110));
+}
 
-                        str += 3;
-                        len -= 3;
-                } else if (*str < 0xED) {
-                        if (_c_unlikely_(len < 3))
-                                break;
-                        if (_c_unlikely_(*(str + 1) < 0x80 || *(str + 1) > 0xBF))
-                                break;
-                        if (_c_unlikely_(*(str + 2) < 0x80 || *(str + 2) > 0xBF))
-                                break;
+_c_target_("avx2")
+static inline bool c_internal_string_from_hex_avx2(char *str, size_t n, const char *hex, size_t *offsetp) {
+        const char *start = hex;
+        __m256i first, second, invalid;
+        size_t offset;
 
-                        str += 3;
-                        len -= 3;
-                } else if (*str < 0xEE) {
-                        if (_c_unlikely_(len < 3))
-                                break;
-                        if (_c_unlikely_(*(str + 1) < 0x80 || *(str + 1) > 0x9F))
-                                break;
-                        if (_c_unlikely_(*(str + 2) < 0x80 || *(str + 2) > 0xBF))
-                                break;
+        for ( ; n >= sizeof(first); n -= sizeof(first), str += sizeof(first), hex += 2 * sizeof(first)) {
+                invalid = _mm256_setzero_si256();
+                first = c_internal_string_from_hex_nibbles_avx2(_mm256_loadu_si256((const __m256i *)hex), &invalid);
+                second = c_internal_string_from_hex_nibbles_avx2(_mm256_loadu_si256((const __m256i *)hex + 1), &invalid);
+                if (!_mm256_testz_si256(invalid, invalid))
+                        break;
 
-                        str += 3;
-                        len -= 3;
-                } else if (*str < 0xF0) {
-                        if (_c_unlikely_(len < 3))
-                                break;
-                        if (_c_unlikely_(*(str + 1) < 0x80 || *(str + 1) > 0xBF))
-                                break;
-                        if (_c_unlikely_(*(str + 2) < 0x80 || *(str + 2) > 0xBF))
-                                break;
+                /* packing works per lane, so fix up the lane order */
+                _mm256_storeu_si256((__m256i *)str, _mm256_permute4x64_epi64(_mm256_packus_epi16(first, second), 0xd8));
+        }
 
-                        str += 3;
-                        len -= 3;
-                } else if (*str < 0xF1) {
-                        if (_c_unlikely_(len < 4))
-                                break;
-                        if (_c_unlikely_(*(str + 1) < 0x90 || *(str + 1) > 0xBF))
-                                break;
-                        if (_c_unlikely_(*(str + 2) < 0x80 || *(str + 2) > 0xBF))
-                                break;
-                        if (_c_unlikely_(*(str + 3) < 0x80 || *(str + 3) > 0xBF))
-                                break;
+        if (_c_likely_(c_internal_string_from_hex_ssse3(str, n, hex, &offset)))
+                return true;
 
-                        str += 4;
-                        len -= 4;
-                } else if (*str < 0xF4) {
-                        if (_c_unlikely_(len < 4))
-                                break;
-                        if (_c_unlikely_(*(str + 1) < 0x80 || *(str + 1) > 0xBF))
-                                break;
-                        if (_c_unlikely_(*(str + 2) < 0x80 || *(str + 2) > 0xBF))
-                                break;
-                        if (_c_unlikely_(*(str + 3) < 0x80 || *(str + 3) > 0xBF))
-                                break;
+        if (offsetp)
+                *offsetp = hex - start + offset;
+        return false;
+}
 
-                        str += 4;
-                        len -= 4;
-                } else if (*str < 0xF5) {
-                        if (_c_unlikely_(len < 4))
-                                break;
-                        if (_c_unlikely_(*(str + 1) < 0x80 || *(str + 1) > 0x8F))
+#endif /* C_INTERNAL_STRING_X86 */
+
+/**
+ * c_string_from_hex_offset() - decode ascii-hex string and locate errors
+ * @str:        string buffer to write into
+ * @n:          length of @str in bytes
+ * @hex:        hex encoded buffer to decode
+ * @offsetp:    output argument for the offset of the first invalid character,
+ *              or NULL
+ *
+ * This is the same as c_string_from_hex(), but additionally reports the offset
+ * of the first invalid character in @hex on failure. @offsetp is left
+ * untouched on success. The content of @str is undefined on failure.
+ *
+ * Depending on the running CPU, this decodes 32 or 64 characters at a time.
+ *
+ * Return: True if successful, false if invalid.
+ */
+static inline bool c_string_from_hex_offset(char *str, size_t n, const char *hex, size_t *offsetp) {
+#if C_INTERNAL_STRING_X86
+        if (n >= 2 * C_INTERNAL_STRING_HEX_SIMD_MIN && __builtin_cpu_supports("avx2"))
+                return c_internal_string_from_hex_avx2(str, n, hex, offsetp);
+        if (n >= C_INTERNAL_STRING_HEX_SIMD_MIN && __builtin_cpu_supports("ssse3"))
+                return c_internal_string_from_hex_ssse3(str, n, hex, offsetp);
+#endif
+        return c_internal_string_from_hex_scalar(str, n, hex, offsetp);
+}
+
+/**
+ * c_string_from_hex() - decode ascii-hex string
+ * @str:        string buffer to write into
+ * @n:          length of @str in bytes
+ * @hex:        hex encoded buffer to decode
+ *
+ * This hex-decodes @hex into the string buffer @str. Be aware that @hex must
+ * be twice the size as @str / @n.
+ *
+ * Return: True if successful, false if invalid.
+ */
+static inline bool c_string_from_hex(char *str, size_t n, const char *hex) {
+        return c_string_from_hex_offset(str, n, hex, NULL);
+}
+
+/*
+ * c_internal_string_hex_pair() - decode a pair of hex digits
+ *
+ * This returns the value of the two hex digits at @hex, or a value above 0xff
+ * if either of them is invalid. It does not branch on the input, so callers
+ * can decode a fixed number of pairs and check the combined result once.
+ */
+static inline unsigned int c_internal_string_hex_pair(const char *hex) {
+        const uint8_t *table = c_internal_string_hex_table();
+        unsigned int v1, v2;
+
+        v1 = table[hex[0] & 0x7f];
+        v2 = table[hex[1] & 0x7f];
+        return ((v1 << 4) | v2) | (((hex[0] | hex[1] | v1 | v2) & 0x80) << 1);
+}
+
+static inline void c_internal_string_to_hex_sep(const char *str, size_t n, char *hex, char sep, const char *table) {
+        size_t i;
+
+        for (i = 0; i < n; ++i) {
+                hex[3 * i] = table[(str[i] >> 4) & 0x0f];
+                hex[3 * i + 1] = table[str[i] & 0x0f];
+        }
+        for (i = 1; i < n; ++i)
+                hex[3 * i - 1] = sep;
+}
+
+/**
+ * c_string_to_hex_sep() - encode string as separated ascii-hex
+ * @str:        string to encode from
+ * @n:          length of @str in bytes
+ * @hex:        destination buffer
+ * @sep:        separator to place between bytes
+ *
+ * This hex-encodes the source string into the destination buffer, like
+ * c_string_to_hex(), but places @sep between the digit pairs of consecutive
+ * bytes, as used for MAC addresses and key fingerprints. The destination
+ * buffer must be at least 3 * @n - 1 bytes big, unless @n is 0.
+ */
+static inline void c_string_to_hex_sep(const char *str, size_t n, char *hex, char sep) {
+        c_internal_string_to_hex_sep(str, n, hex, sep, "0123456789abcdef");
+}
+
+/**
+ * c_string_to_hex_sep_upper() - encode string as separated upper-case ascii-hex
+ * @str:        string to encode from
+ * @n:          length of @str in bytes
+ * @hex:        destination buffer
+ * @sep:        separator to place between bytes
+ *
+ * This is the same as c_string_to_hex_sep(), but uses upper-case letters for
+ * the digits A-F.
+ */
+static inline void c_string_to_hex_sep_upper(const char *str, size_t n, char *hex, char sep) {
+        c_internal_string_to_hex_sep(str, n, hex, sep, "0123456789ABCDEF");
+}
+
+/**
+ * c_string_from_hex_sep() - decode separated ascii-hex string
+ * @str:        string buffer to write into
+ * @n:          length of @str in bytes
+ * @hex:        hex encoded buffer to decode
+ * @sep:        separator between bytes
+ * @offsetp:    output argument for the offset of the first invalid character,
+ *              or NULL
+ *
+ * This reverses c_string_to_hex_sep(). @hex must consist of @n pairs of hex
+ * digits of either case, each but the last followed by @sep, so it must be
+ * 3 * @n - 1 bytes long, unless @n is 0. On failure, the offset of the first
+ * invalid character in @hex is returned in @offsetp, and the content of @str
+ * is undefined.
+ *
+ * All pairs are decoded without branching on the input, and checked at once.
+ *
+ * Return: True if successful, false if invalid.
+ */
+static inline bool c_string_from_hex_sep(char *str, size_t n, const char *hex, char sep, size_t *offsetp) {
+        unsigned int v, invalid = 0;
+        size_t i, offset;
+
+        for (i = 0; i < n; ++i) {
+                v = c_internal_string_hex_pair(hex + 3 * i);
+                invalid |= v;
+                str[i] = v;
+        }
+        for (i = 1; i < n; ++i)
+                invalid |= (unsigned char)(hex[3 * i - 1] ^ sep) << 8;
+
+        if (_c_likely_(invalid <= 0xff))
+                return true;
+
+        if (offsetp) {
+                for (i = 0; i < n; ++i) {
+                        if (!c_internal_string_from_hex_scalar(str, 1, hex + 3 * i, &offset)) {
+                                *offsetp = 3 * i + offset;
                                 break;
-                        if (_c_unlikely_(*(str + 2) < 0x80 || *(str + 2) > 0xBF))
+                        }
+                        if (i + 1 < n && hex[3 * i + 2] != sep) {
+                                *offsetp = 3 * i + 2;
                                 break;
-                        if (_c_unlikely_(*(str + 3) < 0x80 || *(str + 3) > 0xBF))
+                        }
+                }
+        }
+
+        return false;
+}
+
+/**
+ * C_STRING_UUID_LEN - length of a formatted UUID
+ *
+ * This is the length in bytes of a UUID in its canonical textual form, like
+ * "f81d4fae-7dec-11d0-a765-00a0c91e6bf6", excluding any terminating zero.
+ */
+#define C_STRING_UUID_LEN 36
+
+/**
+ * C_STRING_MAC_LEN - length of a formatted MAC address
+ *
+ * This is the length in bytes of a 6-byte MAC address in its textual form,
+ * like "00:1a:2b:3c:4d:5e", excluding any terminating zero.
+ */
+#define C_STRING_MAC_LEN 17
+
+/*
+ * c_internal_string_uuid_offsets() - digit offsets of a formatted UUID
+ *
+ * This returns the offsets of the 16 digit pairs in the canonical textual form
+ * of a UUID. The dashes are at the offsets 8, 13, 18, and 23.
+ */
+static inline const uint8_t *c_internal_string_uuid_offsets(void) {
+        static const uint8_t offsets[16] = {
+                0, 2, 4, 6, 9, 11, 14, 16, 19, 21, 24, 26, 28, 30, 32, 34,
+        };
+
+        return offsets;
+}
+
+/**
+ * c_string_to_uuid() - format UUID
+ * @uuid:       16-byte UUID to format
+ * @str:        destination buffer
+ *
+ * This formats @uuid in its canonical textual form of RFC 9562, using
+ * lower-case hex digits in groups of 8-4-4-4-12 digits, separated by dashes.
+ * Exactly C_STRING_UUID_LEN bytes are written to @str. No terminating zero is
+ * written.
+ */
+static inline void c_string_to_uuid(const char *uuid, char *str) {
+        static const char table[] = "0123456789abcdef";
+        const uint8_t *offsets = c_internal_string_uuid_offsets();
+        size_t i;
+
+        for (i = 0; i < 16; ++i) {
+                str[offsets[i]] = table[(uuid[i] >> 4) & 0x0f];
+                str[offsets[i] + 1] = table[uuid[i] & 0x0f];
+        }
+
+        str[8] = '-';
+        str[13] = '-';
+        str[18] = '-';
+        str[23] = '-';
+}
+
+/**
+ * c_string_from_uuid() - parse UUID
+ * @uuid:       16-byte buffer to write into
+ * @str:        string to parse
+ * @n:          length of @str in bytes
+ *
+ * This parses a UUID in its canonical textual form, as written by
+ * c_string_to_uuid(). Hex digits of either case are accepted. @str must be
+ * exactly C_STRING_UUID_LEN bytes long, and surrounding braces or a "urn:uuid:"
+ * prefix are not accepted. On failure, the content of @uuid is undefined.
+ *
+ * All digits are decoded without branching on the input, and checked at once.
+ *
+ * Return: True if successful, false if invalid.
+ */
+static inline bool c_string_from_uuid(char *uuid, const char *str, size_t n) {
+        const uint8_t *offsets = c_internal_string_uuid_offsets();
+        unsigned int v, invalid = 0;
+        size_t i;
+
+        if (n != C_STRING_UUID_LEN)
+                return false;
+
+        for (i = 0; i < 16; ++i) {
+                v = c_internal_string_hex_pair(str + offsets[i]);
+                invalid |= v;
+                uuid[i] = v;
+        }
+
+        invalid |= (unsigned char)(str[8] ^ '-') << 8;
+        invalid |= (unsigned char)(str[13] ^ '-') << 8;
+        invalid |= (unsigned char)(str[18] ^ '-') << 8;
+        invalid |= (unsigned char)(str[23] ^ '-') << 8;
+
+        return invalid <= 0xff;
+}
+
+/**
+ * c_string_to_mac() - format MAC address
+ * @mac:        6-byte MAC address to format
+ * @str:        destination buffer
+ *
+ * This formats @mac as six pairs of lower-case hex digits, separated by
+ * colons. Exactly C_STRING_MAC_LEN bytes are written to @str. No terminating
+ * zero is written.
+ */
+static inline void c_string_to_mac(const char *mac, char *str) {
+        c_string_to_hex_sep(mac, 6, str, ':');
+}
+
+/**
+ * c_string_from_mac() - parse MAC address
+ * @mac:        6-byte buffer to write into
+ * @str:        string to parse
+ * @n:          length of @str in bytes
+ *
+ * This parses a 6-byte MAC address given as six pairs of hex digits of either
+ * case, separated by either colons or dashes, but the same separator
+ * throughout. @str must be exactly C_STRING_MAC_LEN bytes long. On failure,
+ * the content of @mac is undefined.
+ *
+ * Return: True if successful, false if invalid.
+ */
+static inline bool c_string_from_mac(char *mac, const char *str, size_t n) {
+        if (n != C_STRING_MAC_LEN || (str[2] != ':' && str[2] != '-'))
+                return false;
+
+        return c_string_from_hex_sep(mac, 6, str, str[2], NULL);
+}
+
+/*
+ * Base64 Alphabets
+ *
+ * Every alphabet carries its encoding table, a decoding table which maps
+ * padding to 0xfd, whitespace to 0xfe and invalid characters to 0xff, and
+ * the nibble tables used by the vectorized implementations.
+ */
+typedef struct CInternalStringBase64 {
+        char encode[64];
+        uint8_t decode[256];
+        int8_t shift[16];
+        uint8_t lut_lo[16];
+        uint8_t lut_hi[16];
+        int8_t roll[16];
+        char c63;
+} CInternalStringBase64;
+
+enum {
+        C_STRING_BASE64_URL             = (1U << 0),
+        C_STRING_BASE64_NOPAD           = (1U << 1),
+        C_STRING_BASE64_LENIENT         = (1U << 2),
+};
+
+/**
+ * C_STRING_BASE64_MAX() - calculate maximum length of base64 encoded data
+ * @_n:         length of the data in bytes
+ *
+ * Return: Evaluates to the length in bytes of @_n bytes encoded as base64.
+ */
+#define C_STRING_BASE64_MAX(_n) (((_n) + 2) / 3 * 4)
+
+/**
+ * C_STRING_BASE64_DECODED_MAX() - calculate maximum length of base64 decoded data
+ * @_n:         length of the base64 encoded data in bytes
+ *
+ * Return: Evaluates to an upper bound of the length in bytes of @_n base64
+ *         characters when decoded.
+ */
+#define C_STRING_BASE64_DECODED_MAX(_n) (((_n) + 3) / 4 * 3)
+
+static inline const CInternalStringBase64 *c_internal_string_base64(unsigned int flags) {
+        static const CInternalStringBase64 standard = {
+                .encode = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/",
+                .decode = {
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xff, 0xff,
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                0xfe, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+                                0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0xfd, 0xff, 0xff,
+                                0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+                                0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+                                0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                },
+                .shift = { 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                           '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0 },
+                .lut_lo = { 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                            0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a },
+                .lut_hi = { 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 },
+                .roll = { 0, 0, 62 - '+', 52 - '0', 0 - 'A', 0 - 'A', 26 - 'a', 26 - 'a',
+                          0, 0, 63 - '/', 0, 0, 0, 0, 0 },
+                .c63 = '/',
+        };
+        static const CInternalStringBase64 url = {
+                .encode = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_",
+                .decode = {
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xff, 0xff,
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                0xfe, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff,
+                                0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0xfd, 0xff, 0xff,
+                                0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+                                0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0x3f,
+                                0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+                                0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                },
+                .shift = { 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                           '0' - 52, '0' - 52, '0' - 52, '-' - 62, '_' - 63, 'A', 0, 0 },
+                .lut_lo = { 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                            0x11, 0x11, 0x13, 0x3b, 0x3b, 0x3a, 0x3b, 0x33 },
+                .lut_hi = { 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x20,
+                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 },
+                .roll = { 0, 0, 62 - '-', 52 - '0', 0 - 'A', 0 - 'A', 26 - 'a', 26 - 'a',
+                          0, 0, 0, 0, 0, 63 - '_', 0, 0 },
+                .c63 = '_',
+        };
+
+        return (flags & C_STRING_BASE64_URL) ? &url : &standard;
+}
+
+/*
+ * c_internal_string_to_base64_scalar() - reference implementation
+ *
+ * This is the reference implementation of c_string_to_base64(). The
+ * vectorized implementations use it to encode the tail and the padding.
+ */
+static inline size_t c_internal_string_to_base64_scalar(const char *str,
+                                                        size_t n,
+                                                        char *b64,
+                                                        unsigned int flags,
+                                                        const CInternalStringBase64 *alphabet) {
+        const unsigned char *s = (const unsigned char *)str;
+        const char *table = alphabet->encode;
+        char *start = b64;
+
+        for ( ; n >= 3; n -= 3, s += 3) {
+                *b64++ = table[s[0] >> 2];
+                *b64++ = table[(s[0] & 0x03) << 4 | s[1] >> 4];
+                *b64++ = table[(s[1] & 0x0f) << 2 | s[2] >> 6];
+                *b64++ = table[s[2] & 0x3f];
+        }
+
+        if (n == 1) {
+                *b64++ = table[s[0] >> 2];
+                *b64++ = table[(s[0] & 0x03) << 4];
+                if (!(flags & C_STRING_BASE64_NOPAD)) {
+                        *b64++ = '=';
+                        *b64++ = '=';
+                }
+        } else if (n == 2) {
+                *b64++ = table[s[0] >> 2];
+                *b64++ = table[(s[0] & 0x03) << 4 | s[1] >> 4];
+                *b64++ = table[(s[1] & 0x0f) << 2];
+                if (!(flags & C_STRING_BASE64_NOPAD))
+                        *b64++ = '=';
+        }
+
+        return b64 - start;
+}
+
+/*
+ * c_internal_string_from_base64() - generic decoder
+ *
+ * This decodes base64 character by character, accumulating 4 characters
+ * before writing out 3 bytes. Whenever it is at a 4-character boundary, it
+ * hands over to @bulk (if non-NULL), which decodes as many blocks of input as
+ * it can. The bulk decoder must stop at anything but valid characters of the
+ * alphabet, so whitespace and padding are always handled here.
+ */
+static inline bool c_internal_string_from_base64(char *str,
+                                                 size_t *np,
+                                                 const char *b64,
+                                                 size_t n,
+                                                 unsigned int flags,
+                                                 size_t (*bulk) (char *str,
+                                                                 const char *b64,
+                                                                 size_t n,
+                                                                 const CInternalStringBase64 *alphabet)) {
+        const CInternalStringBase64 *alphabet = c_internal_string_base64(flags);
+        const unsigned char *s = (const unsigned char *)b64;
+        bool strict = !(flags & C_STRING_BASE64_LENIENT);
+        unsigned int n_acc = 0, n_pad = 0;
+        char *start = str;
+        uint32_t acc = 0;
+        size_t l;
+        uint8_t v;
+
+        while (n) {
+                if (bulk && !n_acc) {
+                        l = bulk(str, (const char *)s, n, alphabet);
+                        str += l / 4 * 3;
+                        s += l;
+                        n -= l;
+                        if (!n)
                                 break;
+                }
 
-                        str += 4;
-                        len -= 4;
-                } else
+                v = alphabet->decode[*s++];
+                --n;
+
+                if (_c_likely_(v < 64)) {
+                        if (_c_unlikely_(n_pad))
+                                return false;
+
+                        acc = acc << 6 | v;
+                        if (++n_acc == 4) {
+                                *str++ = acc >> 16;
+                                *str++ = acc >> 8;
+                                *str++ = acc;
+                                n_acc = 0;
+                        }
+                } else if (v == 0xfd) {
+                        if (n_acc < 2 || n_acc + ++n_pad > 4)
+                                return false;
+                } else if (v != 0xfe || strict) {
+                        return false;
+                }
+        }
+
+        if (n_pad) {
+                if (n_acc + n_pad != 4 || (strict && (flags & C_STRING_BASE64_NOPAD)))
+                        return false;
+        } else if (n_acc) {
+                if (strict && !(flags & C_STRING_BASE64_NOPAD))
+                        return false;
+        }
+
+        /* strict mode requires the unused bits to be zero */
+        if (n_acc == 1) {
+                return false;
+        } else if (n_acc == 2) {
+                if (strict && (acc & 0x0f))
+                        return false;
+                *str++ = acc >> 4;
+        } else if (n_acc == 3) {
+                if (strict && (acc & 0x03))
+                        return false;
+                *str++ = acc >> 10;
+                *str++ = acc >> 2;
+        }
+
+        *np = str - start;
+        return true;
+}
+
+#if C_INTERNAL_STRING_X86
+
+/*
+ * The vectorized base64 codecs follow "Base64 encoding and decoding at almost
+ * the speed of a memory copy" by Wojciech Muła and Daniel Lemire. Encoding
+ * shuffles 3-byte groups into 32-bit lanes, extracts the four 6-bit indices
+ * with multiplications, and maps them to ASCII by adding an offset looked up
+ * per index range. Decoding validates every character via a lookup of both
+ * nibbles, maps it back to its 6-bit value by adding an offset looked up via
+ * the high nibble, and merges the values with multiply-adds.
+ */
+
+_c_target_("ssse3")
+static inline __m128i c_internal_string_to_base64_block_ssse3(__m128i input, __m128i shift) {
+        __m128i indices, t;
+
+        input = _mm_shuffle_epi8(input, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+        indices = _mm_or_si128(_mm_mulhi_epu16(_mm_and_si128(input, _mm_set1_epi32(0x0fc0fc00)),
+                                               _mm_set1_epi32(0x04000040)),
+                               _mm_mullo_epi16(_mm_and_si128(input, _mm_set1_epi32(0x003f03f0)),
+                                               _mm_set1_epi32(0x01000010)));
+
+        t = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+        t = _mm_or_si128(t, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+
+        return _mm_add_epi8(_mm_shuffle_epi8(shift, t), indices);
+}
+
+_c_target_("ssse3")
+static inline size_t c_internal_string_to_base64_ssse3(const char *str, size_t n, char *b64, const CInternalStringBase64 *alphabet) {
+        const __m128i shift = _mm_loadu_si128((const __m128i *)alphabet->shift);
+        size_t i;
+
+        /* 12 bytes are consumed per block, but 16 are loaded */
+        for (i = 0; n - i >= 16; i += 12, b64 += 16)
+                _mm_storeu_si128((__m128i *)b64,
+                                 c_internal_string_to_base64_block_ssse3(_mm_loadu_si128((const __m128i *)(str + i)), shift));
+
+        return i;
+}
+
+_c_target_("avx2")
+static inline size_t c_internal_string_to_base64_avx2(const char *str, size_t n, char *b64, const CInternalStringBase64 *alphabet) {
+        const __m256i shift = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)alphabet->shift));
+        __m256i input, indices, t;
+        size_t i;
+
+        /* 24 bytes are consumed per block, but 28 are loaded */
+        for (i = 0; n - i >= 28; i += 24, b64 += 32) {
+                input = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(str + i))),
+                                                _mm_loadu_si128((const __m128i *)(str + i + 12)),
+                                                1);
+                input = _mm256_shuffle_epi8(input, _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                                                    1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+                indices = _mm256_or_si256(_mm256_mulhi_epu16(_mm256_and_si256(input, _mm256_set1_epi32(0x0fc0fc00)),
+                                                             _mm256_set1_epi32(0x04000040)),
+                                          _mm256_mullo_epi16(_mm256_and_si256(input, _mm256_set1_epi32(0x003f03f0)),
+                                                             _mm256_set1_epi32(0x01000010)));
+
+                t = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+                t = _mm256_or_si256(t, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices), _mm256_set1_epi8(13)));
+
+                _mm256_storeu_si256((__m256i *)b64, _mm256_add_epi8(_mm256_shuffle_epi8(shift, t), indices));
+        }
+
+        return i + c_internal_string_to_base64_ssse3(str + i, n - i, b64, alphabet);
+}
+
+_c_target_("ssse3")
+static inline size_t c_internal_string_from_base64_ssse3(char *str, const char *b64, size_t n, const CInternalStringBase64 *alphabet) {
+        const __m128i lut_lo = _mm_loadu_si128((const __m128i *)alphabet->lut_lo);
+        const __m128i lut_hi = _mm_loadu_si128((const __m128i *)alphabet->lut_hi);
+        const __m128i roll = _mm_loadu_si128((const __m128i *)alphabet->roll);
+        const __m128i nibble = _mm_set1_epi8(0x0f);
+        __m128i input, high;
+        uint32_t tail;
+        size_t i;
+
+        for (i = 0; n - i >= 16; i += 16, str += 12) {
+                input = _mm_loadu_si128((const __m128i *)(b64 + i));
+                high = _mm_and_si128(_mm_srli_epi16(input, 4), nibble);
+
+                if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(_mm_shuffle_epi8(lut_hi, high),
+                                                                   _mm_shuffle_epi8(lut_lo, _mm_and_si128(input, nibble))),
+                                                     _mm_setzero_si128())) != 0xffff)
                         break;
+
+                high = _mm_add_epi8(high, _mm_and_si128(_mm_cmpeq_epi8(input, _mm_set1_epi8(alphabet->c63)), _mm_set1_epi8(8)));
+                input = _mm_add_epi8(input, _mm_shuffle_epi8(roll, high));
+
+                input = _mm_madd_epi16(_mm_maddubs_epi16(input, _mm_set1_epi32(0x01400140)), _mm_set1_epi32(0x00011000));
+                input = _mm_shuffle_epi8(input, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+                /* store exactly 12 bytes, the caller might not have more */
+                _mm_storel_epi64((__m128i *)str, input);
+                tail = _mm_cvtsi128_si32(_mm_srli_si128(input, 8));
+                memcpy(str + 8, &tail, sizeof(tail));
         }
 
-        *strp = (char *)str;
-        *lenp = len;
+        return i;
+}
+
+_c_target_("avx2")
+static inline size_t c_internal_string_from_base64_avx2(char *str, const char *b64, size_t n, const CInternalStringBase64 *alphabet) {
+        const __m256i lut_lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)alphabet->lut_lo));
+        const __m256i lut_hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)alphabet->lut_hi));
+        const __m256i roll = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)alphabet->roll));
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+        __m256i input, high;
+        size_t i;
+
+        for (i = 0; n - i >= 32; i += 32, str += 24) {
+                input = _mm256_loadu_si256((const __m256i *)(b64 + i));
+                high = _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble);
+
+                if (!_mm256_testz_si256(_mm256_shuffle_epi8(lut_hi, high),
+                                        _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(input, nibble))))
+                        break;
+
+                high = _mm256_add_epi8(high, _mm256_and_si256(_mm256_cmpeq_epi8(input, _mm256_set1_epi8(alphabet->c63)),
+                                                              _mm256_set1_epi8(8)));
+                input = _mm256_add_epi8(input, _mm256_shuffle_epi8(roll, high));
+
+                input = _mm256_madd_epi16(_mm256_maddubs_epi16(input, _mm256_set1_epi32(0x01400140)),
+                                          _mm256_set1_epi32(0x00011000));
+                input = _mm256_shuffle_epi8(input, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                                    2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+                input = _mm256_permutevar8x32_epi32(input, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+
+                /* store exactly 24 bytes, the caller might not have more */
+                _mm_storeu_si128((__m128i *)str, _mm256_castsi256_si128(input));
+                _mm_storel_epi64((__m128i *)(str + 16), _mm256_extracti128_si256(input, 1));
+        }
+
+        return i + c_internal_string_from_base64_ssse3(str, b64 + i, n - i, alphabet);
+}
+
+#endif /* C_INTERNAL_STRING_X86 */
+
+/**
+ * c_string_to_base64() - encode string as base64
+ * @str:        string to encode from
+ * @n:          length of @str in bytes
+ * @b64:        destination buffer
+ * @flags:      C_STRING_BASE64_* flags
+ *
+ * This base64-encodes the source string into the destination buffer,
+ * according to RFC 4648. The destination buffer must be at least
+ * C_STRING_BASE64_MAX(@n) bytes big. No terminating zero is written.
+ *
+ * If C_STRING_BASE64_URL is given, the URL and filename safe alphabet is used.
+ * If C_STRING_BASE64_NOPAD is given, no padding is written.
+ *
+ * Return: Number of characters written to @b64.
+ */
+static inline size_t c_string_to_base64(const char *str, size_t n, char *b64, unsigned int flags) {
+        const CInternalStringBase64 *alphabet = c_internal_string_base64(flags);
+        size_t l = 0;
+
+#if C_INTERNAL_STRING_X86
+        if (n >= 28 && __builtin_cpu_supports("avx2"))
+                l = c_internal_string_to_base64_avx2(str, n, b64, alphabet);
+        else if (n >= 16 && __builtin_cpu_supports("ssse3"))
+                l = c_internal_string_to_base64_ssse3(str, n, b64, alphabet);
+#endif
+
+        return l / 3 * 4 + c_internal_string_to_base64_scalar(str + l, n - l, b64 + l / 3 * 4, flags, alphabet);
+}
+
+/**
+ * c_string_from_base64() - decode base64 string
+ * @str:        string buffer to write into
+ * @np:         output argument for the number of bytes written to @str
+ * @b64:        base64 encoded buffer to decode
+ * @n:          length of @b64 in bytes
+ * @flags:      C_STRING_BASE64_* flags
+ *
+ * This base64-decodes @b64 into the string buffer @str, according to RFC 4648.
+ * The string buffer must be at least C_STRING_BASE64_DECODED_MAX(@n) bytes
+ * big.
+ *
+ * By default, decoding is strict: any character outside of the alphabet is
+ * rejected, the input must be padded correctly, and unused bits in the final
+ * character must be zero. With C_STRING_BASE64_NOPAD, padding must be absent
+ * instead. C_STRING_BASE64_LENIENT skips whitespace, accepts both padded and
+ * unpadded input, and ignores unused bits. C_STRING_BASE64_URL selects the URL
+ * and filename safe alphabet.
+ *
+ * Return: True if successful, false if invalid.
+ */
+static inline bool c_string_from_base64(char *str, size_t *np, const char *b64, size_t n, unsigned int flags) {
+#if C_INTERNAL_STRING_X86
+        if (n >= 32 && __builtin_cpu_supports("avx2"))
+                return c_internal_string_from_base64(str, np, b64, n, flags, c_internal_string_from_base64_avx2);
+        if (n >= 16 && __builtin_cpu_supports("ssse3"))
+                return c_internal_string_from_base64(str, np, b64, n, flags, c_internal_string_from_base64_ssse3);
+#endif
+        return c_internal_string_from_base64(str, np, b64, n, flags, NULL);
+}
+
+/*
+ * c_internal_string_verify_ascii_scalar() - reference implementation
+ *
+ * This is the byte-by-byte reference implementation of
+ * c_string_verify_ascii(). The accelerated implementations use it to
+ * pinpoint the offending byte in their final word.
+ */
+static inline void c_internal_string_verify_ascii_scalar(char **strp, size_t *lenp) {
+        unsigned char *str = (unsigned char *) *strp;
+        size_t len = *lenp;
+
+        while (len > 0) {
+                if (_c_unlikely_(*str == 0x00 || *str > 0x7F))
+                        break;
+
+                ++str;
+                --len;
+        }
+
+        *strp = (char *) str;
+        *lenp = len;
+}
+
+/*
+ * c_internal_string_verify_ascii_swar() - word-at-a-time implementation
+ *
+ * A word contains a non-ASCII byte if any high-bit is set, and it contains a
+ * zero byte if subtracting 1 from every byte borrows into the high-bit of the
+ * lowest zero byte. Hence, a single combined mask detects both.
+ */
+static inline void c_internal_string_verify_ascii_swar(char **strp, size_t *lenp) {
+        char *str = *strp;
+        size_t len = *lenp;
+        uint64_t word;
+
+        while (len >= sizeof(word)) {
+                memcpy(&word, str, sizeof(word));
+                if (((word - UINT64_C(0x0101010101010101)) | word) & UINT64_C(0x8080808080808080))
+                        break;
+
+                str += sizeof(word);
+                len -= sizeof(word);
+        }
+
+        c_internal_string_verify_ascii_scalar(&str, &len);
+
+        *strp = str;
+        *lenp = len;
+}
+
+#if C_INTERNAL_STRING_X86
+
+_c_target_("sse2")
+static inline void c_internal_string_verify_ascii_sse2(char **strp, size_t *lenp) {
+        char *str = *strp;
+        size_t len = *lenp;
+        unsigned int mask;
+        __m128i input;
+
+        while (len >= sizeof(input)) {
+                input = _mm_loadu_si128((const __m128i *)str);
+                mask = _mm_movemask_epi8(_mm_or_si128(input, _mm_cmpeq_epi8(input, _mm_setzero_si128())));
+                if (mask) {
+                        str += __builtin_ctz(mask);
+                        len -= __builtin_ctz(mask);
+                        goto exit;
+                }
+
+                str += sizeof(input);
+                len -= sizeof(input);
+        }
+
+        c_internal_string_verify_ascii_swar(&str, &len);
+
+exit:
+        *strp = str;
+        *lenp = len;
+}
+
+_c_target_("avx2")
+static inline void c_internal_string_verify_ascii_avx2(char **strp, size_t *lenp) {
+        char *str = *strp;
+        size_t len = *lenp;
+        unsigned int mask;
+        __m256i input;
+
+        while (len >= sizeof(input)) {
+                input = _mm256_loadu_si256((const __m256i *)str);
+                mask = _mm256_movemask_epi8(_mm256_or_si256(input, _mm256_cmpeq_epi8(input, _mm256_setzero_si256())));
+                if (mask) {
+                        str += __builtin_ctz(mask);
+                        len -= __builtin_ctz(mask);
+                        goto exit;
+                }
+
+                str += sizeof(input);
+                len -= sizeof(input);
+        }
+
+        c_internal_string_verify_ascii_swar(&str, &len);
+
+exit:
+        *strp = str;
+        *lenp = len;
+}
+
+#endif /* C_INTERNAL_STRING_X86 */
+
+/**
+ * c_string_verify_ascii() - verify that a scring is ASCII encoded
+ * @strp:               pointer to string to verify
+ * @lenp:               pointer to length of string
+ *
+ * The first @lenp bytes of the string pointed to by @strp is
+ * verified to be ASCII encoded, and @strp and @lenp are updated to
+ * point to the first non-ASCII character or the first NULL of the
+ * sting, and the remaining number of bytes of the string, respectively.
+ *
+ * Depending on the running CPU, this checks 32, 16 or 8 bytes at a time.
+ */
+static inline void c_string_verify_ascii(char **strp, size_t *lenp) {
+#if C_INTERNAL_STRING_X86
+        if (*lenp >= 32 && __builtin_cpu_supports("avx2")) {
+                c_internal_string_verify_ascii_avx2(strp, lenp);
+                return;
+        }
+        if (*lenp >= 16 && __builtin_cpu_supports("sse2")) {
+                c_internal_string_verify_ascii_sse2(strp, lenp);
+                return;
+        }
+#endif
+        c_internal_string_verify_ascii_swar(strp, lenp);
+}
+
+_c_const_ static inline unsigned char c_internal_string_ascii_lower(unsigned char c) {
+        return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+/*
+ * c_internal_string_casecmp_scalar() - reference implementation
+ *
+ * This compares @n bytes of @a and @b, after folding ASCII upper-case letters
+ * to lower-case. All other bytes, including zero-bytes, are compared as
+ * unsigned characters. The return value is the difference of the first pair
+ * of folded bytes that differ, or 0. All accelerated implementations must
+ * return exactly the same.
+ */
+_c_pure_ static inline int c_internal_string_casecmp_scalar(const char *a, const char *b, size_t n) {
+        const unsigned char *ua = (const unsigned char *)a, *ub = (const unsigned char *)b;
+        size_t i;
+
+        for (i = 0; i < n; ++i)
+                if (c_internal_string_ascii_lower(ua[i]) != c_internal_string_ascii_lower(ub[i]))
+                        return c_internal_string_ascii_lower(ua[i]) - c_internal_string_ascii_lower(ub[i]);
+
+        return 0;
+}
+
+/*
+ * c_internal_string_case_scalar() - reference implementation
+ *
+ * This converts the @n bytes at @str in place. If @upper is false, ASCII
+ * upper-case letters are converted to lower-case, otherwise the other way
+ * around. All other bytes are left untouched.
+ */
+static inline void c_internal_string_case_scalar(char *str, size_t n, bool upper) {
+        unsigned char first = upper ? 'a' : 'A';
+        size_t i;
+
+        for (i = 0; i < n; ++i)
+                if ((unsigned char)((unsigned char)str[i] - first) < 26)
+                        str[i] ^= 0x20;
+}
+
+#if C_INTERNAL_STRING_X86
+
+/*
+ * The vectorized implementations detect letters of the range starting at
+ * @first by shifting it to the bottom of the signed range, so a single
+ * signed comparison suffices. Flipping bit 0x20 of the detected letters then
+ * switches their case.
+ */
+
+_c_target_("sse2")
+static inline __m128i c_internal_string_case_flip_sse2(__m128i v, char first) {
+        __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8((char)(0x80 - first)));
+        __m128i letters = _mm_cmplt_epi8(shifted, _mm_set1_epi8((char)(0x80 + 26)));
+
+        return _mm_xor_si128(v, _mm_and_si128(letters, _mm_set1_epi8(0x20)));
+}
+
+_c_target_("avx2")
+static inline __m256i c_internal_string_case_flip_avx2(__m256i v, char first) {
+        __m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8((char)(0x80 - first)));
+        __m256i letters = _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(0x80 + 26)), shifted);
+
+        return _mm256_xor_si256(v, _mm256_and_si256(letters, _mm256_set1_epi8(0x20)));
+}
+
+_c_target_("sse2")
+static inline int c_internal_string_casecmp_sse2(const char *a, const char *b, size_t n) {
+        __m128i va, vb;
+        unsigned int mask;
+        size_t i;
+
+        for (i = 0; i + sizeof(va) <= n; i += sizeof(va)) {
+                va = c_internal_string_case_flip_sse2(_mm_loadu_si128((const __m128i *)(a + i)), 'A');
+                vb = c_internal_string_case_flip_sse2(_mm_loadu_si128((const __m128i *)(b + i)), 'A');
+                mask = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ^ 0xffff;
+                if (mask) {
+                        i += __builtin_ctz(mask);
+                        return c_internal_string_casecmp_scalar(a + i, b + i, 1);
+                }
+        }
+
+        return c_internal_string_casecmp_scalar(a + i, b + i, n - i);
+}
+
+_c_target_("avx2")
+static inline int c_internal_string_casecmp_avx2(const char *a, const char *b, size_t n) {
+        __m256i va, vb;
+        unsigned int mask;
+        size_t i;
+
+        for (i = 0; i + sizeof(va) <= n; i += sizeof(va)) {
+                va = c_internal_string_case_flip_avx2(_mm256_loadu_si256((const __m256i *)(a + i)), 'A');
+                vb = c_internal_string_case_flip_avx2(_mm256_loadu_si256((const __m256i *)(b + i)), 'A');
+                mask = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+                if (mask) {
+                        i += __builtin_ctz(mask);
+                        return c_internal_string_casecmp_scalar(a + i, b + i, 1);
+                }
+        }
+
+        return c_internal_string_casecmp_scalar(a + i, b + i, n - i);
+}
+
+_c_target_("sse2")
+static inline void c_internal_string_case_sse2(char *str, size_t n, bool upper) {
+        char first = upper ? 'a' : 'A';
+        __m128i v;
+        size_t i;
+
+        for (i = 0; i + sizeof(v) <= n; i += sizeof(v)) {
+                v = _mm_loadu_si128((const __m128i *)(str + i));
+                _mm_storeu_si128((__m128i *)(str + i), c_internal_string_case_flip_sse2(v, first));
+        }
+
+        c_internal_string_case_scalar(str + i, n - i, upper);
+}
+
+_c_target_("avx2")
+static inline void c_internal_string_case_avx2(char *str, size_t n, bool upper) {
+        char first = upper ? 'a' : 'A';
+        __m256i v;
+        size_t i;
+
+        for (i = 0; i + sizeof(v) <= n; i += sizeof(v)) {
+                v = _mm256_loadu_si256((const __m256i *)(str + i));
+                _mm256_storeu_si256((__m256i *)(str + i), c_internal_string_case_flip_avx2(v, first));
+        }
+
+        c_internal_string_case_scalar(str + i, n - i, upper);
+}
+
+#endif /* C_INTERNAL_STRING_X86 */
+
+static inline int c_internal_string_casecmp(const char *a, const char *b, size_t n) {
+#if C_INTERNAL_STRING_X86
+        if (n >= 32 && __builtin_cpu_supports("avx2"))
+                return c_internal_string_casecmp_avx2(a, b, n);
+        if (n >= 16 && __builtin_cpu_supports("sse2"))
+                return c_internal_string_casecmp_sse2(a, b, n);
+#endif
+        return c_internal_string_casecmp_scalar(a, b, n);
+}
+
+static inline void c_internal_string_case(char *str, size_t n, bool upper) {
+#if C_INTERNAL_STRING_X86
+        if (n >= 32 && __builtin_cpu_supports("avx2")) {
+                c_internal_string_case_avx2(str, n, upper);
+                return;
+        }
+        if (n >= 16 && __builtin_cpu_supports("sse2")) {
+                c_internal_string_case_sse2(str, n, upper);
+                return;
+        }
+#endif
+        c_internal_string_case_scalar(str, n, upper);
+}
+
+/**
+ * c_string_compare_ascii_ci() - compare two strings ignoring ASCII case
+ * @a:          first string to compare, or NULL
+ * @b:          second string to compare, or NULL
+ *
+ * Compare two strings, the same way c_string_compare() does it, but treat
+ * ASCII upper-case letters as their lower-case counterparts. Unlike
+ * strcasecmp(), this is not affected by the locale: all bytes outside of the
+ * ranges A-Z and a-z are compared as they are.
+ *
+ * Most strings differ within their first few bytes, so those are compared
+ * one by one. Beyond that, the strings are compared in blocks: the length of
+ * each string is determined within the block, and the block is compared 16 or
+ * 32 bytes at a time. Blocks start at C_INTERNAL_STRING_CASECMP_BLOCK bytes
+ * and double in size, up to C_INTERNAL_STRING_CASECMP_BLOCK_MAX bytes. Hence,
+ * strings are scanned at most twice as far as the point where they differ,
+ * while long equal strings amortize the setup of each block.
+ *
+ * Return: Less than, greater than or equal to zero, as strcmp().
+ */
+#define C_INTERNAL_STRING_CASECMP_HEAD 16
+#define C_INTERNAL_STRING_CASECMP_BLOCK 64
+#define C_INTERNAL_STRING_CASECMP_BLOCK_MAX 4096
+
+_c_pure_ static inline int c_string_compare_ascii_ci(const char *a, const char *b) {
+        size_t i, la, lb, block = C_INTERNAL_STRING_CASECMP_BLOCK;
+        unsigned char ca, cb;
+        int r;
+
+        if (a == b)
+                return 0;
+        if (!a || !b)
+                return a ? 1 : -1;
+
+        for (i = 0; i < C_INTERNAL_STRING_CASECMP_HEAD; ++i) {
+                ca = c_internal_string_ascii_lower(a[i]);
+                cb = c_internal_string_ascii_lower(b[i]);
+                if (ca != cb)
+                        return ca - cb;
+                if (!ca)
+                        return 0;
+        }
+
+        a += C_INTERNAL_STRING_CASECMP_HEAD;
+        b += C_INTERNAL_STRING_CASECMP_HEAD;
+
+        for (;;) {
+                la = strnlen(a, block);
+                lb = strnlen(b, block);
+
+                r = c_internal_string_casecmp(a, b, c_min(la, lb));
+                if (r)
+                        return r;
+                if (la < block || lb < block)
+                        return (la > lb) - (la < lb);
+
+                a += block;
+                b += block;
+                block = c_min(2 * block, (size_t)C_INTERNAL_STRING_CASECMP_BLOCK_MAX);
+        }
+}
+
+/**
+ * c_string_equal_ascii_ci() - compare strings for equality ignoring ASCII case
+ * @a:          first string to compare, or NULL
+ * @b:          second string to compare, or NULL
+ *
+ * Compare two strings for equality, the same way c_string_equal() does it,
+ * but treat ASCII upper-case letters as their lower-case counterparts. See
+ * c_string_compare_ascii_ci() for details.
+ *
+ * Return: True if both are equal, false if not.
+ */
+_c_pure_ static inline bool c_string_equal_ascii_ci(const char *a, const char *b) {
+        return !c_string_compare_ascii_ci(a, b);
+}
+
+/**
+ * c_string_prefix_ascii_ci() - check prefix of a string ignoring ASCII case
+ * @str:        string to check
+ * @prefix:     prefix to look for
+ *
+ * This checks whether @str starts with @prefix, the same way
+ * c_string_prefix() does it, but treats ASCII upper-case letters as their
+ * lower-case counterparts.
+ *
+ * Return: Pointer directly behind the prefix in @str, or NULL if not found.
+ */
+_c_pure_ static inline char *c_string_prefix_ascii_ci(const char *str, const char *prefix) {
+        size_t l = strlen(prefix);
+
+        if (strnlen(str, l) < l || c_internal_string_casecmp(str, prefix, l))
+                return NULL;
+
+        return (char *)str + l;
+}
+
+/**
+ * c_string_ascii_lower() - convert string to ASCII lower-case
+ * @str:        string to convert
+ * @n:          length of @str in bytes
+ *
+ * This converts all ASCII upper-case letters in the first @n bytes of @str to
+ * lower-case, in place. All other bytes are left untouched. Unlike
+ * tolower(), this is not affected by the locale.
+ */
+static inline void c_string_ascii_lower(char *str, size_t n) {
+        c_internal_string_case(str, n, false);
+}
+
+/**
+ * c_string_ascii_upper() - convert string to ASCII upper-case
+ * @str:        string to convert
+ * @n:          length of @str in bytes
+ *
+ * This is the same as c_string_ascii_lower(), but converts lower-case letters
+ * to upper-case.
+ */
+static inline void c_string_ascii_upper(char *str, size_t n) {
+        c_internal_string_case(str, n, true);
+}
+
+/**
+ * struct CInternalStringByteset - set of byte values
+ * @bitmap:             bitmap of all bytes in the set
+ * @lo:                 @bitmap for bytes 0x00-0x7f, indexed by low nibble
+ * @hi:                 @bitmap for bytes 0x80-0xff, indexed by low nibble
+ *
+ * Each entry of @lo and @hi is the bitmap of the high nibbles (modulo 8) that
+ * form a member of the set together with that low nibble. This allows the
+ * vectorized implementations to test membership of 16 or 32 bytes at once.
+ */
+typedef struct CInternalStringByteset {
+        uint8_t bitmap[32];
+        uint8_t lo[16];
+        uint8_t hi[16];
+} CInternalStringByteset;
+
+static inline void c_internal_string_byteset_add(CInternalStringByteset *set, unsigned char b) {
+        set->bitmap[b / 8] |= 1 << (b % 8);
+        if (b < 0x80)
+                set->lo[b & 0xf] |= 1 << (b >> 4);
+        else
+                set->hi[b & 0xf] |= 1 << ((b >> 4) & 0x7);
+}
+
+static inline void c_internal_string_byteset_remove(CInternalStringByteset *set, unsigned char b) {
+        set->bitmap[b / 8] &= ~(1 << (b % 8));
+        if (b < 0x80)
+                set->lo[b & 0xf] &= ~(1 << (b >> 4));
+        else
+                set->hi[b & 0xf] &= ~(1 << ((b >> 4) & 0x7));
+}
+
+_c_pure_ static inline bool c_internal_string_byteset_contains(const CInternalStringByteset *set, unsigned char b) {
+        return set->bitmap[b / 8] & (1 << (b % 8));
+}
+
+/*
+ * c_internal_string_byteset_find_scalar() - reference implementation
+ *
+ * This returns the offset of the first byte in @str that is a member of @set,
+ * or @n if there is none. All accelerated implementations must behave exactly
+ * the same.
+ */
+_c_pure_ static inline size_t c_internal_string_byteset_find_scalar(const CInternalStringByteset *set, const char *str, size_t n) {
+        size_t i;
+
+        for (i = 0; i < n; ++i)
+                if (c_internal_string_byteset_contains(set, str[i]))
+                        break;
+
+        return i;
+}
+
+#if C_INTERNAL_STRING_X86
+
+/*
+ * The vectorized implementations test set membership with two table lookups:
+ * the low nibble of each byte selects a bitmap of high nibbles from @lo (for
+ * bytes below 0x80) or @hi (for all others), which is then tested against the
+ * bit of the actual high nibble. PSHUFB yields 0 for indices with the top bit
+ * set, so each table lookup silently drops the bytes of the other half.
+ */
+
+_c_target_("ssse3")
+static inline size_t c_internal_string_byteset_find_ssse3(const CInternalStringByteset *set, const char *str, size_t n) {
+        const __m128i lo = _mm_loadu_si128((const __m128i *)set->lo);
+        const __m128i hi = _mm_loadu_si128((const __m128i *)set->hi);
+        const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+        __m128i input, member, bit;
+        unsigned int mask;
+        size_t i;
+
+        for (i = 0; i + sizeof(input) <= n; i += sizeof(input)) {
+                input = _mm_loadu_si128((const __m128i *)(str + i));
+                member = _mm_or_si128(_mm_shuffle_epi8(lo, input),
+                                      _mm_shuffle_epi8(hi, _mm_xor_si128(input, _mm_set1_epi8(-128))));
+                bit = _mm_shuffle_epi8(bits, _mm_and_si128(_mm_srli_epi16(input, 4), _mm_set1_epi8(0x0f)));
+                mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(member, bit), _mm_setzero_si128())) ^ 0xffff;
+                if (mask)
+                        return i + __builtin_ctz(mask);
+        }
+
+        return i + c_internal_string_byteset_find_scalar(set, str + i, n - i);
+}
+
+_c_target_("avx2")
+static inline size_t c_internal_string_byteset_find_avx2(const CInternalStringByteset *set, const char *str, size_t n) {
+        const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)set->lo));
+        const __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)set->hi));
+        const __m256i bits = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                                              1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+        __m256i input, member, bit;
+        unsigned int mask;
+        size_t i;
+
+        for (i = 0; i + sizeof(input) <= n; i += sizeof(input)) {
+                input = _mm256_loadu_si256((const __m256i *)(str + i));
+                member = _mm256_or_si256(_mm256_shuffle_epi8(lo, input),
+                                         _mm256_shuffle_epi8(hi, _mm256_xor_si256(input, _mm256_set1_epi8(-128))));
+                bit = _mm256_shuffle_epi8(bits, _mm256_and_si256(_mm256_srli_epi16(input, 4), _mm256_set1_epi8(0x0f)));
+                mask = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(member, bit), _mm256_setzero_si256()));
+                if (mask)
+                        return i + __builtin_ctz(mask);
+        }
+
+        return i + c_internal_string_byteset_find_scalar(set, str + i, n - i);
+}
+
+#endif /* C_INTERNAL_STRING_X86 */
+
+static inline size_t c_internal_string_byteset_find(const CInternalStringByteset *set, const char *str, size_t n) {
+#if C_INTERNAL_STRING_X86
+        if (n >= 32 && __builtin_cpu_supports("avx2"))
+                return c_internal_string_byteset_find_avx2(set, str, n);
+        if (n >= 16 && __builtin_cpu_supports("ssse3"))
+                return c_internal_string_byteset_find_ssse3(set, str, n);
+#endif
+        return c_internal_string_byteset_find_scalar(set, str, n);
+}
+
+enum {
+        C_STRING_SPLIT_COALESCE         = (1U << 0),
+        C_STRING_SPLIT_QUOTES           = (1U << 1),
+};
+
+/**
+ * struct CStringSplit - string splitter
+ *
+ * This is the state of an iteration over the tokens of a string, as created
+ * by c_string_split(). All members are private to the implementation.
+ */
+struct CStringSplit {
+        CStringView rest;
+        unsigned int flags;
+        bool done;
+        CInternalStringByteset stops;
+};
+
+/**
+ * c_string_split() - create string splitter
+ * @str:        string to split
+ * @n:          length of @str in bytes
+ * @delimiters: zero-terminated set of delimiter bytes
+ * @flags:      C_STRING_SPLIT_* flags
+ *
+ * This creates a splitter which yields the tokens of the @n bytes at @str,
+ * separated by any of the bytes in @delimiters, via c_string_split_next(). The
+ * input is neither copied nor modified, and must stay valid while the
+ * splitter is used. Unlike strtok_r(), a splitter does not need the input to
+ * be zero-terminated.
+ *
+ * By default, every delimiter ends a token, so adjacent delimiters yield empty
+ * tokens, and an empty string yields a single empty token. With
+ * C_STRING_SPLIT_COALESCE, empty tokens are skipped instead, which makes runs
+ * of delimiters act as one and ignores leading and trailing delimiters. This
+ * is usually what you want for whitespace.
+ *
+ * With C_STRING_SPLIT_QUOTES, delimiters inside of single or double quotes,
+ * or following a backslash, do not end a token. Quoting follows the rules of
+ * a POSIX shell, so backslashes are literal inside of single quotes. An
+ * unterminated quote extends to the end of the string. Tokens are yielded as
+ * they are, including their quotes and backslashes. Quote characters and
+ * backslashes cannot be used as delimiters in this mode.
+ *
+ * Return: The new splitter is returned.
+ */
+static inline CStringSplit c_string_split(const char *str, size_t n, const char *delimiters, unsigned int flags) {
+        CStringSplit split = {
+                .rest = c_string_view(str, n),
+                .flags = flags,
+        };
+
+        for ( ; *delimiters; ++delimiters)
+                c_internal_string_byteset_add(&split.stops, *delimiters);
+
+        if (flags & C_STRING_SPLIT_QUOTES) {
+                c_internal_string_byteset_add(&split.stops, '\'');
+                c_internal_string_byteset_add(&split.stops, '"');
+                c_internal_string_byteset_add(&split.stops, '\\');
+        }
+
+        return split;
+}
+
+static inline size_t c_internal_string_split_token(CStringSplit *split, const char *str, size_t n) {
+        const char *p;
+        size_t i = 0;
+
+        for (;;) {
+                i += c_internal_string_byteset_find(&split->stops, str + i, n - i);
+                if (i == n || !(split->flags & C_STRING_SPLIT_QUOTES))
+                        return i;
+
+                switch (str[i]) {
+                case '\\':
+                        i += 2;
+                        break;
+                case '\'':
+                        p = memchr(str + i + 1, '\'', n - i - 1);
+                        i = p ? (size_t)(p - str) + 1 : n;
+                        break;
+                case '"':
+                        for (++i; i < n && str[i] != '"'; ++i)
+                                if (str[i] == '\\')
+                                        ++i;
+                        ++i;
+                        break;
+                default:
+                        return i;
+                }
+
+                if (i >= n)
+                        return n;
+        }
+}
+
+/**
+ * c_string_split_next() - yield next token of string splitter
+ * @split:      splitter to operate on
+ * @tokenp:     output argument for the token
+ *
+ * This yields the next token of @split. See c_string_split() for details.
+ * The token is a view into the input of the splitter.
+ *
+ * Return: True if a token was yielded, false if there are no more tokens.
+ */
+static inline bool c_string_split_next(CStringSplit *split, CStringView *tokenp) {
+        CStringView rest;
+        size_t l;
+
+        while (!split->done) {
+                rest = split->rest;
+                l = c_internal_string_split_token(split, rest.str, rest.len);
+                if (l < rest.len)
+                        split->rest = c_string_view(rest.str + l + 1, rest.len - l - 1);
+                else
+                        split->done = true;
+
+                if (l || !(split->flags & C_STRING_SPLIT_COALESCE)) {
+                        *tokenp = c_string_view(rest.str, l);
+                        return true;
+                }
+        }
+
+        return false;
+}
+
+/**
+ * c_string_split_for_each() - iterate over tokens of a string
+ * @_token:     CStringView to store each token in
+ * @_str:       string to split
+ * @_n:         length of @_str in bytes
+ * @_delimiters: zero-terminated set of delimiter bytes
+ * @_flags:     C_STRING_SPLIT_* flags
+ *
+ * This expands to a for-loop header, which runs the following statement
+ * once for each token, as yielded by c_string_split(), stored in @_token.
+ */
+#define c_string_split_for_each(_token, _str, _n, _delimiters, _flags)                          \
+        for (CStringSplit C_VAR(split) = c_string_split((_str), (_n), (_delimiters), (_flags));  \
+             c_string_split_next(&C_VAR(split), &(_token));                                     \
+             )
+
+/*
+ * c_internal_string_verify_utf8_scalar() - reference implementation
+ *
+ * This is the byte-by-byte reference implementation of
+ * c_string_verify_utf8(). All accelerated implementations must behave exactly
+ * the same, and fall back to this one to pinpoint the exact location of a
+ * failure.
+ */
+static inline void c_internal_string_verify_utf8_scalar(char **strp, size_t *lenp) {
+        unsigned char *str = (unsigned char *)*strp;
+        size_t len = *lenp;
+
+        /* See Unicode 9.0.0, Chapter 3, Section D92 */
+
+        while (len > 0) {
+                if (_c_unlikely_(*str == 0x00)) {
+                        break;
+                } else if (*str < 0x80) {
+                        ++str;
+                        --len;
+                } else if (_c_unlikely_(*str < 0xC2)) {
+                        break;
+                } else if (*str < 0xE0) {
+                        if (_c_unlikely_(len < 2))
+                                break;
+                        if (_c_unlikely_(*(str + 1) < 0x80 || *(str + 1) > 0xBF))
+                                break;
+
+                        str += 2;
+                        len -= 2;
+                } else if (*str < 0xE1) {
+                        if (_c_unlikely_(len < 3))
+                                break;
+                        if (_c_unlikely_(*(str + 1) < 0xA0 || *(str + 1) > 0xBF))
+                                break;
+                        if (_c_unlikely_(*(str + 2) < 0x80 || *(str + 2) > 0xBF))
+                                break;
+
+                        str += 3;
+                        len -= 3;
+                } else if (*str < 0xED) {
+                        if (_c_unlikely_(len < 3))
+                                break;
+                        if (_c_unlikely_(*(str + 1) < 0x80 || *(str + 1) > 0xBF))
+                                break;
+                        if (_c_unlikely_(*(str + 2) < 0x80 || *(str + 2) > 0xBF))
+                                break;
+
+                        str += 3;
+                        len -= 3;
+                } else if (*str < 0xEE) {
+                        if (_c_unlikely_(len < 3))
+                                break;
+                        if (_c_unlikely_(*(str + 1) < 0x80 || *(str + 1) > 0x9F))
+                                break;
+                        if (_c_unlikely_(*(str + 2) < 0x80 || *(str + 2) > 0xBF))
+                                break;
+
+                        str += 3;
+                        len -= 3;
+                } else if (*str < 0xF0) {
+                        if (_c_unlikely_(len < 3))
+                                break;
+                        if (_c_unlikely_(*(str + 1) < 0x80 || *(str + 1) > 0xBF))
+                                break;
+                        if (_c_unlikely_(*(str + 2) < 0x80 || *(str + 2) > 0xBF))
+                                break;
+
+                        str += 3;
+                        len -= 3;
+                } else if (*str < 0xF1) {
+                        if (_c_unlikely_(len < 4))
+                                break;
+                        if (_c_unlikely_(*(str + 1) < 0x90 || *(str + 1) > 0xBF))
+                                break;
+                        if (_c_unlikely_(*(str + 2) < 0x80 || *(str + 2) > 0xBF))
+                                break;
+                        if (_c_unlikely_(*(str + 3) < 0x80 || *(str + 3) > 0xBF))
+                                break;
+
+                        str += 4;
+                        len -= 4;
+                } else if (*str < 0xF4) {
+                        if (_c_unlikely_(len < 4))
+                                break;
+                        if (_c_unlikely_(*(str + 1) < 0x80 || *(str + 1) > 0xBF))
+                                break;
+                        if (_c_unlikely_(*(str + 2) < 0x80 || *(str + 2) > 0xBF))
+                                break;
+                        if (_c_unlikely_(*(str + 3) < 0x80 || *(str + 3) > 0xBF))
+                                break;
+
+                        str += 4;
+                        len -= 4;
+                } else if (*str < 0xF5) {
+                        if (_c_unlikely_(len < 4))
+                                break;
+                        if (_c_unlikely_(*(str + 1) < 0x80 || *(str + 1) > 0x8F))
+                                break;
+                        if (_c_unlikely_(*(str + 2) < 0x80 || *(str + 2) > 0xBF))
+                                break;
+                        if (_c_unlikely_(*(str + 3) < 0x80 || *(str + 3) > 0xBF))
+                                break;
+
+                        str += 4;
+                        len -= 4;
+                } else
+                        break;
+        }
+
+        *strp = (char *)str;
+        *lenp = len;
+}
+
+/*
+ * c_internal_string_count_byte() - count occurrences of a byte
+ *
+ * This counts how often @c occurs in the @n bytes at @str. This is written so
+ * compilers can auto-vectorize it.
+ */
+static inline size_t c_internal_string_count_byte(const char *str, size_t n, char c) {
+        size_t count = 0;
+
+        for (size_t i = 0; i < n; ++i)
+                count += str[i] == c;
+
+        return count;
+}
+
+/*
+ * c_internal_string_utf8_stats_add() - account verified data in statistics
+ *
+ * This adds the @n bytes at @str to @stats. The data must have been verified
+ * to consist of complete UTF-8 characters.
+ */
+static inline void c_internal_string_utf8_stats_add(CStringUtf8Stats *stats, const char *str, size_t n) {
+        const unsigned char *s = (const unsigned char *)str;
+        unsigned int max_len = stats->max_len;
+
+        for (size_t i = 0; i < n; ++i) {
+                if ((s[i] & 0xC0) != 0x80)
+                        ++stats->n_chars;
+                if (s[i] == '\n')
+                        ++stats->n_lines;
+
+                if (s[i] >= 0xF0)
+                        max_len = 4;
+                else if (s[i] >= 0xE0)
+                        max_len = c_max(max_len, 3U);
+                else if (s[i] >= 0xC0)
+                        max_len = c_max(max_len, 2U);
+                else
+                        max_len = c_max(max_len, 1U);
+        }
+
+        stats->max_len = max_len;
+}
+
+/*
+ * c_internal_string_count_utf8_swar() - word-at-a-time implementation
+ *
+ * This skips runs of ASCII a word at a time and hands everything else over to
+ * the reference implementation, restricted to a small window. The window is
+ * always large enough to fit any character, so if the reference
+ * implementation cannot make any progress on it, we found the end and stop.
+ *
+ * If @stats is non-NULL, every verified span is accounted right away, while
+ * it is still hot in the cache.
+ */
+static inline void c_internal_string_count_utf8_swar(char **strp, size_t *lenp, CStringUtf8Stats *stats) {
+        char *str = *strp, *pos;
+        size_t len = *lenp, n;
+
+        while (len > 0) {
+                pos = str;
+                c_internal_string_verify_ascii_swar(&str, &len);
+                if (stats) {
+                        stats->n_chars += str - pos;
+                        stats->n_lines += c_internal_string_count_byte(pos, str - pos, '\n');
+                        if (str != pos)
+                                stats->max_len = c_max(stats->max_len, 1U);
+                }
+
+                pos = str;
+                n = c_min(len, (size_t)32);
+                c_internal_string_verify_utf8_scalar(&pos, &n);
+                if (pos == str)
+                        break;
+
+                if (stats)
+                        c_internal_string_utf8_stats_add(stats, str, pos - str);
+
+                len -= pos - str;
+                str = pos;
+        }
+
+        *strp = str;
+        *lenp = len;
+}
+
+static inline void c_internal_string_verify_utf8_swar(char **strp, size_t *lenp) {
+        c_internal_string_count_utf8_swar(strp, lenp, NULL);
+}
+
+#if C_INTERNAL_STRING_X86
+
+/*
+ * The vectorized UTF-8 validation is based on "Validating UTF-8 In Less Than
+ * One Instruction Per Byte" by John Keiser and Daniel Lemire. For every byte
+ * we look at the high nibble of the previous byte, the low nibble of the
+ * previous byte, and the high nibble of the current byte. Each nibble is
+ * mapped through a 16-entry table to a set of error classes it is compatible
+ * with. The AND of all three is non-zero if the 2-byte combination is
+ * invalid. Additionally, the expected number of continuation bytes is verified
+ * by looking at the lead bytes two and three positions earlier.
+ *
+ * The error classes are:
+ *
+ *     TOO_SHORT:      0x01    11______ 0_______, 11______ 11______
+ *     TOO_LONG:       0x02    0_______ 10______
+ *     OVERLONG_3:     0x04    11100000 100_____
+ *     TOO_LARGE:      0x08    11110100 1001____, 11110100 101_____, ...
+ *     SURROGATE:      0x10    11101101 101_____
+ *     OVERLONG_2:     0x20    1100000_ 10______
+ *     TOO_LARGE_1000: 0x40    11110101 1000____, ...
+ *     OVERLONG_4:     0x40    11110000 1000____
+ *     TWO_CONTS:      0x80    10______ 10______
+ *
+ * This only detects whether a block is valid. If it is not, the caller rewinds
+ * to the last character boundary and lets the reference implementation find
+ * the exact location.
+ */
+#define C_INTERNAL_STRING_UTF8_BYTE_1_HIGH                                      \
+        0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,                         \
+        0x80, 0x80, 0x80, 0x80, 0x21, 0x01, 0x15, 0x49
+#define C_INTERNAL_STRING_UTF8_BYTE_1_LOW                                       \
+        0xe7, 0xa3, 0x83, 0x83, 0x8b, 0xcb, 0xcb, 0xcb,                         \
+        0xcb, 0xcb, 0xcb, 0xcb, 0xcb, 0xdb, 0xcb, 0xcb
+#define C_INTERNAL_STRING_UTF8_BYTE_2_HIGH                                      \
+        0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,                         \
+        0xe6, 0xae, 0xba, 0xba, 0x01, 0x01, 0x01, 0x01
+#define C_INTERNAL_STRING_UTF8_INCOMPLETE                                       \
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,                         \
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xef, 0xdf, 0xbf
+
+/*
+ * c_internal_string_utf8_rewind() - rewind to last character boundary
+ *
+ * The vectorized implementations validate full blocks, and a multi-byte
+ * character might straddle two blocks. Before handing over to the reference
+ * implementation, they use this to rewind over the last, possibly incomplete,
+ * character. Everything before @str must have been verified already.
+ */
+static inline void c_internal_string_utf8_rewind(char *start, char **strp, size_t *lenp) {
+        unsigned char *str = (unsigned char *)*strp;
+        size_t len = *lenp;
+
+        for (unsigned int i = 0; i < 4 && str > (unsigned char *)start; ++i) {
+                --str;
+                ++len;
+                if (*str < 0x80 || *str >= 0xC0)
+                        break;
+        }
+
+        *strp = (char *)str;
+        *lenp = len;
+}
+
+_c_target_("sse4.1")
+static inline __m128i c_internal_string_utf8_check_sse41(__m128i input, __m128i prev) {
+        const __m128i nibble = _mm_set1_epi8(0x0f);
+        __m128i prev1, prev2, prev3, special, must23;
+
+        prev1 = _mm_alignr_epi8(input, prev, 15);
+        prev2 = _mm_alignr_epi8(input, prev, 14);
+        prev3 = _mm_alignr_epi8(input, prev, 13);
+
+        special = _mm_and_si128(
+                _mm_and_si128(
+                        _mm_shuffle_epi8(_mm_setr_epi8(C_INTERNAL_STRING_UTF8_BYTE_1_HIGH),
+                                         _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+                        _mm_shuffle_epi8(_mm_setr_epi8(C_INTERNAL_STRING_UTF8_BYTE_1_LOW),
+                                         _mm_and_si128(prev1, nibble))),
+                _mm_shuffle_epi8(_mm_setr_epi8(C_INTERNAL_STRING_UTF8_BYTE_2_HIGH),
+                                 _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+
+        /* high-bit is set iff this must be a 2nd or 3rd continuation byte */
+        must23 = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(0xe0 - 0x80)),
+                              _mm_subs_epu8(prev3, _mm_set1_epi8(0xf0 - 0x80)));
+
+        return _mm_xor_si128(_mm_and_si128(must23, _mm_set1_epi8(0x80)), special);
+}
+
+_c_target_("sse2")
+static inline uint64_t c_internal_string_sum_epi64_sse2(__m128i v) {
+        uint64_t u[2];
+
+        _mm_storeu_si128((__m128i *)u, v);
+        return u[0] + u[1];
+}
+
+/*
+ * The vectorized implementations optionally gather statistics on the fly. A
+ * block is accounted only once its successor was verified, as a character at
+ * its end might still turn out invalid. Continuation bytes and newlines are
+ * summed up via sum-of-absolute-differences, and the highest byte value
+ * tells the longest character.
+ */
+
+_c_target_("sse4.1")
+static inline void c_internal_string_count_utf8_sse41(char **strp, size_t *lenp, CStringUtf8Stats *stats) {
+        const __m128i one = _mm_set1_epi8(1);
+        char *str = *strp, *end;
+        size_t len = *lenp;
+        __m128i input, error, prev = _mm_setzero_si128();
+        __m128i conts = _mm_setzero_si128(), lines = _mm_setzero_si128(), high = _mm_setzero_si128();
+
+        while (len >= sizeof(input)) {
+                input = _mm_loadu_si128((const __m128i *)str);
+
+                if (!_mm_testz_si128(_mm_cmpeq_epi8(input, _mm_setzero_si128()), _mm_set1_epi8(-1)))
+                        break;
+
+                if (_mm_testz_si128(input, _mm_set1_epi8(0x80)))
+                        /* pure ASCII, just verify the previous block was complete */
+                        error = _mm_subs_epu8(prev, _mm_setr_epi8(C_INTERNAL_STRING_UTF8_INCOMPLETE));
+                else
+                        error = c_internal_string_utf8_check_sse41(input, prev);
+
+                if (!_mm_testz_si128(error, error))
+                        break;
+
+                if (stats && str != *strp) {
+                        conts = _mm_add_epi64(conts, _mm_sad_epu8(_mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(-64), prev), one),
+                                                                  _mm_setzero_si128()));
+                        lines = _mm_add_epi64(lines, _mm_sad_epu8(_mm_and_si128(_mm_cmpeq_epi8(prev, _mm_set1_epi8('\n')), one),
+                                                                  _mm_setzero_si128()));
+                        high = _mm_max_epu8(high, prev);
+                }
+
+                prev = input;
+                str += sizeof(input);
+                len -= sizeof(input);
+        }
+
+        end = str;
+        c_internal_string_utf8_rewind(*strp, &str, &len);
+
+        if (stats && end != *strp) {
+                end -= sizeof(input);
+                stats->n_chars += end - *strp - c_internal_string_sum_epi64_sse2(conts);
+                stats->n_lines += c_internal_string_sum_epi64_sse2(lines);
+                if (end != *strp)
+                        stats->max_len = c_max(stats->max_len,
+                                               _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(high, _mm_set1_epi8(0xf0)), high)) ? 4U :
+                                               _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(high, _mm_set1_epi8(0xe0)), high)) ? 3U :
+                                               _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(high, _mm_set1_epi8(0xc0)), high)) ? 2U : 1U);
+                c_internal_string_utf8_stats_add(stats, end, str - end);
+        }
+
+        end = str;
+        c_internal_string_verify_utf8_scalar(&str, &len);
+        if (stats)
+                c_internal_string_utf8_stats_add(stats, end, str - end);
+
+        *strp = str;
+        *lenp = len;
+}
+
+static inline void c_internal_string_verify_utf8_sse41(char **strp, size_t *lenp) {
+        c_internal_string_count_utf8_sse41(strp, lenp, NULL);
+}
+
+_c_target_("avx2")
+static inline __m256i c_internal_string_utf8_check_avx2(__m256i input, __m256i prev) {
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+        __m256i shifted, prev1, prev2, prev3, special, must23;
+
+        /* lane-crossing equivalent of _mm_alignr_epi8() */
+        shifted = _mm256_permute2x128_si256(prev, input, 0x21);
+        prev1 = _mm256_alignr_epi8(input, shifted, 15);
+        prev2 = _mm256_alignr_epi8(input, shifted, 14);
+        prev3 = _mm256_alignr_epi8(input, shifted, 13);
+
+        special = _mm256_and_si256(
+                _mm256_and_si256(
+                        _mm256_shuffle_epi8(_mm256_setr_epi8(C_INTERNAL_STRING_UTF8_BYTE_1_HIGH,
+                                                             C_INTERNAL_STRING_UTF8_BYTE_1_HIGH),
+                                            _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                        _mm256_shuffle_epi8(_mm256_setr_epi8(C_INTERNAL_STRING_UTF8_BYTE_1_LOW,
+                                                             C_INTERNAL_STRING_UTF8_BYTE_1_LOW),
+                                            _mm256_and_si256(prev1, nibble))),
+                _mm256_shuffle_epi8(_mm256_setr_epi8(C_INTERNAL_STRING_UTF8_BYTE_2_HIGH,
+                                                     C_INTERNAL_STRING_UTF8_BYTE_2_HIGH),
+                                    _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+
+        must23 = _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8(0xe0 - 0x80)),
+                                 _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xf0 - 0x80)));
+
+        return _mm256_xor_si256(_mm256_and_si256(must23, _mm256_set1_epi8(0x80)), special);
+}
+
+_c_target_("avx2")
+static inline void c_internal_string_count_utf8_avx2(char **strp, size_t *lenp, CStringUtf8Stats *stats) {
+        const __m256i one = _mm256_set1_epi8(1);
+        char *str = *strp, *end;
+        size_t len = *lenp;
+        __m256i input, error, prev = _mm256_setzero_si256();
+        __m256i conts = _mm256_setzero_si256(), lines = _mm256_setzero_si256(), high = _mm256_setzero_si256();
+
+        while (len >= sizeof(input)) {
+                input = _mm256_loadu_si256((const __m256i *)str);
+
+                if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(input, _mm256_setzero_si256())))
+                        break;
+
+                if (!_mm256_movemask_epi8(input))
+                        error = _mm256_subs_epu8(prev, _mm256_setr_epi8(0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                                                        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                                                                        C_INTERNAL_STRING_UTF8_INCOMPLETE));
+                else
+                        error = c_internal_string_utf8_check_avx2(input, prev);
+
+                if (!_mm256_testz_si256(error, error))
+                        break;
+
+                if (stats && str != *strp) {
+                        conts = _mm256_add_epi64(conts, _mm256_sad_epu8(_mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(-64), prev), one),
+                                                                        _mm256_setzero_si256()));
+                        lines = _mm256_add_epi64(lines, _mm256_sad_epu8(_mm256_and_si256(_mm256_cmpeq_epi8(prev, _mm256_set1_epi8('\n')), one),
+                                                                        _mm256_setzero_si256()));
+                        high = _mm256_max_epu8(high, prev);
+                }
+
+                prev = input;
+                str += sizeof(input);
+                len -= sizeof(input);
+        }
+
+        end = str;
+        c_internal_string_utf8_rewind(*strp, &str, &len);
+
+        if (stats && end != *strp) {
+                end -= sizeof(input);
+                stats->n_chars += end - *strp - c_internal_string_sum_epi64_sse2(_mm_add_epi64(_mm256_castsi256_si128(conts),
+                                                                                               _mm256_extracti128_si256(conts, 1)));
+                stats->n_lines += c_internal_string_sum_epi64_sse2(_mm_add_epi64(_mm256_castsi256_si128(lines),
+                                                                                  _mm256_extracti128_si256(lines, 1)));
+                if (end != *strp)
+                        stats->max_len = c_max(stats->max_len,
+                                               _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(high, _mm256_set1_epi8(0xf0)), high)) ? 4U :
+                                               _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(high, _mm256_set1_epi8(0xe0)), high)) ? 3U :
+                                               _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(high, _mm256_set1_epi8(0xc0)), high)) ? 2U : 1U);
+                c_internal_string_utf8_stats_add(stats, end, str - end);
+        }
+
+        end = str;
+        c_internal_string_verify_utf8_scalar(&str, &len);
+        if (stats)
+                c_internal_string_utf8_stats_add(stats, end, str - end);
+
+        *strp = str;
+        *lenp = len;
+}
+
+static inline void c_internal_string_verify_utf8_avx2(char **strp, size_t *lenp) {
+        c_internal_string_count_utf8_avx2(strp, lenp, NULL);
+}
+
+#endif /* C_INTERNAL_STRING_X86 */
+
+/**
+ * c_string_verify_utf8() - verify that a scring is UTF-8 encoded
+ * @strp:               pointer to string to verify
+ * @lenp:               pointer to length of string
+ *
+ * Up to the first @lenp bytes of the string pointed to by @strp is
+ * verified to be UTF-8 encoded, and @strp and @lenp are updated to
+ * point to the first non-UTF-8 character or the first NULL of the
+ * string, and the remaining number of bytes of the string,
+ * respectively.
+ *
+ * Depending on the running CPU, this uses an AVX2 or SSE4.1 accelerated
+ * implementation, or a portable word-at-a-time implementation. All of them
+ * behave exactly the same.
+ */
+static inline void c_string_verify_utf8(char **strp, size_t *lenp) {
+#if C_INTERNAL_STRING_X86
+        if (*lenp >= 32 && __builtin_cpu_supports("avx2")) {
+                c_internal_string_verify_utf8_avx2(strp, lenp);
+                return;
+        }
+        if (*lenp >= 16 && __builtin_cpu_supports("sse4.1")) {
+                c_internal_string_verify_utf8_sse41(strp, lenp);
+                return;
+        }
+#endif
+        c_internal_string_verify_utf8_swar(strp, lenp);
+}
+
+/**
+ * c_string_verify_utf8_count() - verify UTF-8 string and gather statistics
+ * @strp:               pointer to string to verify
+ * @lenp:               pointer to length of string
+ * @stats:              output argument for statistics
+ *
+ * This is the same as c_string_verify_utf8(), but additionally fills @stats
+ * with the number of code points, the number of newlines, and the length of
+ * the longest character of the verified part of the string. This is done in
+ * a single pass over the data.
+ */
+static inline void c_string_verify_utf8_count(char **strp, size_t *lenp, CStringUtf8Stats *stats) {
+        *stats = (CStringUtf8Stats){};
+
+#if C_INTERNAL_STRING_X86
+        if (*lenp >= 32 && __builtin_cpu_supports("avx2")) {
+                c_internal_string_count_utf8_avx2(strp, lenp, stats);
+                return;
+        }
+        if (*lenp >= 16 && __builtin_cpu_supports("sse4.1")) {
+                c_internal_string_count_utf8_sse41(strp, lenp, stats);
+                return;
+        }
+#endif
+        c_internal_string_count_utf8_swar(strp, lenp, stats);
+}
+
+/*
+ * c_internal_string_utf8_incomplete() - check for a truncated character
+ *
+ * This checks whether the @len bytes at @str are the start of a valid UTF-8
+ * character, but are too short to form the entire character. That is, this
+ * returns true if the data might become valid if more data is appended.
+ */
+static inline bool c_internal_string_utf8_incomplete(const char *str, size_t len) {
+        const unsigned char *s = (const unsigned char *)str;
+        unsigned char low = 0x80, high = 0xBF;
+        size_t n;
+
+        if (len < 1)
+                return false;
+        else if (s[0] < 0xC2)
+                return false;
+        else if (s[0] < 0xE0)
+                n = 2;
+        else if (s[0] < 0xF0)
+                n = 3;
+        else if (s[0] < 0xF5)
+                n = 4;
+        else
+                return false;
+
+        if (len >= n)
+                return false;
+
+        /* See c_internal_string_verify_utf8_scalar() for the exceptions. */
+        if (s[0] == 0xE0)
+                low = 0xA0;
+        else if (s[0] == 0xED)
+                high = 0x9F;
+        else if (s[0] == 0xF0)
+                low = 0x90;
+        else if (s[0] == 0xF4)
+                high = 0x8F;
+
+        if (len > 1 && (s[1] < low || s[1] > high))
+                return false;
+        if (len > 2 && (s[2] < 0x80 || s[2] > 0xBF))
+                return false;
+
+        return true;
+}
+
+/**
+ * c_string_verify_utf8_feed() - verify a chunk of a UTF-8 stream
+ * @state:              state of the verification
+ * @chunk:              chunk to verify
+ * @n:                  length of @chunk in bytes
+ *
+ * This verifies the next chunk of a stream to be UTF-8 encoded. It behaves as
+ * if c_string_verify_utf8() was called on the concatenation of all chunks,
+ * but characters may straddle chunk boundaries. Up to 3 bytes of an
+ * incomplete character are carried over in @state, so no data needs to be
+ * retained by the caller.
+ *
+ * On failure, @state->n_valid is the offset in the stream of the first
+ * invalid character, or the first NULL. Once failed, all further calls fail
+ * as well.
+ *
+ * Return: True if the stream is valid so far, false if not.
+ */
+static inline bool c_string_verify_utf8_feed(CStringUtf8State *state, const char *chunk, size_t n) {
+        char *str, *pending;
+        size_t len;
+
+        if (_c_unlikely_(state->invalid))
+                return false;
+
+        /* complete the pending character byte by byte */
+        while (state->n_pending && n) {
+                state->pending[state->n_pending++] = *chunk++;
+                --n;
+
+                pending = (char *)state->pending;
+                len = state->n_pending;
+                c_internal_string_verify_utf8_scalar(&pending, &len);
+                if (!len) {
+                        state->n_valid += state->n_pending;
+                        state->n_pending = 0;
+                } else if (!c_internal_string_utf8_incomplete((char *)state->pending, state->n_pending)) {
+                        state->invalid = true;
+                        return false;
+                }
+        }
+
+        str = (char *)chunk;
+        len = n;
+        c_string_verify_utf8(&str, &len);
+        state->n_valid += str - chunk;
+
+        if (_c_likely_(!len))
+                return true;
+
+        if (!c_internal_string_utf8_incomplete(str, len)) {
+                state->invalid = true;
+                return false;
+        }
+
+        memcpy(state->pending, str, len);
+        state->n_pending = len;
+        return true;
+}
+
+/**
+ * c_string_verify_utf8_finish() - finish verification of a UTF-8 stream
+ * @state:              state of the verification
+ *
+ * This finishes the verification of a stream fed via
+ * c_string_verify_utf8_feed(). It fails if the stream was invalid, or if it
+ * ended with an incomplete character. In the latter case, @state->n_valid is
+ * the offset of that character in the stream.
+ *
+ * Return: True if the entire stream is valid, false if not.
+ */
+static inline bool c_string_verify_utf8_finish(CStringUtf8State *state) {
+        if (state->n_pending)
+                state->invalid = true;
+
+        return !state->invalid;
+}
+
+/*
+ * c_internal_string_emit() - append data to an optional output buffer
+ *
+ * This copies the @n bytes at @src to offset *@n_dstp of @dst, unless @dst is
+ * NULL, and advances *@n_dstp either way. Source and destination may overlap.
+ */
+static inline void c_internal_string_emit(char *dst, size_t *n_dstp, const char *src, size_t n) {
+        if (dst)
+                memmove(dst + *n_dstp, src, n);
+        *n_dstp += n;
+}
+
+/*
+ * c_internal_string_utf8_span() - measure valid UTF-8 prefix
+ *
+ * This returns the length of the longest prefix of the @n bytes at @str that
+ * is valid UTF-8 according to c_string_verify_utf8(), except that NULLs are
+ * allowed as well.
+ */
+static inline size_t c_internal_string_utf8_span(const char *str, size_t n) {
+        char *p = (char *)str;
+        size_t len = n;
+
+        for (;;) {
+                c_string_verify_utf8(&p, &len);
+                if (!len || *p)
+                        break;
+
+                ++p;
+                --len;
+        }
+
+        return n - len;
+}
+
+/**
+ * C_STRING_UTF8_SANITIZED_MAX() - calculate maximum length of sanitized data
+ * @_n:         length of the data in bytes
+ *
+ * Return: Evaluates to an upper bound of the length in bytes of @_n bytes
+ *         sanitized with c_string_sanitize_utf8().
+ */
+#define C_STRING_UTF8_SANITIZED_MAX(_n) ((_n) * 3)
+
+/**
+ * c_string_sanitize_utf8() - replace invalid UTF-8 sequences
+ * @str:                string to sanitize
+ * @n:                  length of @str in bytes
+ * @dst:                destination buffer, or NULL
+ * @n_dstp:             output argument for the length of the result
+ *
+ * This makes the @n bytes at @str valid UTF-8, by replacing every invalid
+ * sequence with U+FFFD REPLACEMENT CHARACTER. Valid characters are verified
+ * according to c_string_verify_utf8(), except that NULLs are kept. Each
+ * maximal subpart of an invalid sequence is replaced by a single U+FFFD, as
+ * recommended by the Unicode Standard (see "U+FFFD Substitution of Maximal
+ * Subparts"). That is, a truncated character is replaced as a whole, while
+ * every other invalid byte is replaced on its own.
+ *
+ * The input is verified up front, 16 or 32 bytes at a time. If it is valid
+ * already, nothing is written, @n_dstp is set to @n, and true is returned, so
+ * the caller can use @str as it is. Otherwise, the sanitized string is
+ * written to @dst, with valid runs copied in bulk. If @dst is NULL, nothing is
+ * written, but the exact length of the result is still returned in @n_dstp.
+ * Otherwise, @dst must be large enough for the result, and must not overlap
+ * @str. C_STRING_UTF8_SANITIZED_MAX(@n) bytes are always enough. No
+ * terminating zero is written.
+ *
+ * Return: True if @str is valid and was left alone, false if the sanitized
+ *         string was written to @dst.
+ */
+static inline bool c_string_sanitize_utf8(const char *str, size_t n, char *dst, size_t *n_dstp) {
+        size_t l, k, n_dst = 0;
+
+        l = c_internal_string_utf8_span(str, n);
+        if (l == n) {
+                *n_dstp = n;
+                return true;
+        }
+
+        for (;;) {
+                c_internal_string_emit(dst, &n_dst, str, l);
+                str += l;
+                n -= l;
+                if (!n)
+                        break;
+
+                for (k = 1; k < n && c_internal_string_utf8_incomplete(str, k + 1); ++k)
+                        ;
+
+                c_internal_string_emit(dst, &n_dst, "\xef\xbf\xbd", 3);
+                str += k;
+                n -= k;
+
+                l = c_internal_string_utf8_span(str, n);
+        }
+
+        *n_dstp = n_dst;
+        return false;
+}
+
+/*
+ * c_internal_string_utf8_decode() - decode a single UTF-8 character
+ *
+ * This decodes the UTF-8 character at the front of the @n bytes at @str into
+ * @cpp. The character is verified with c_internal_string_verify_utf8_scalar(),
+ * so the exact same rules apply. Notably, NULL is rejected.
+ *
+ * Return: Length of the character in bytes, or 0 if invalid.
+ */
+static inline size_t c_internal_string_utf8_decode(const char *str, size_t n, uint32_t *cpp) {
+        const unsigned char *s = (const unsigned char *)str;
+        char *p = (char *)str;
+        size_t l, len;
+
+        if (_c_unlikely_(!n))
+                return 0;
+
+        l = s[0] < 0x80 ? 1 : s[0] < 0xE0 ? 2 : s[0] < 0xF0 ? 3 : 4;
+        if (_c_unlikely_(l > n))
+                return 0;
+
+        len = l;
+        c_internal_string_verify_utf8_scalar(&p, &len);
+        if (_c_unlikely_(len))
+                return 0;
+
+        switch (l) {
+        case 1:
+                *cpp = s[0];
+                break;
+        case 2:
+                *cpp = (s[0] & 0x1f) << 6 | (s[1] & 0x3f);
+                break;
+        case 3:
+                *cpp = (s[0] & 0x0f) << 12 | (s[1] & 0x3f) << 6 | (s[2] & 0x3f);
+                break;
+        default:
+                *cpp = (s[0] & 0x07) << 18 | (s[1] & 0x3f) << 12 | (s[2] & 0x3f) << 6 | (s[3] & 0x3f);
+                break;
+        }
+
+        return l;
+}
+
+/*
+ * c_internal_string_utf8_encode() - encode a single UTF-8 character
+ *
+ * This encodes the valid code point @cp as UTF-8 into @dst, unless @dst is
+ * NULL.
+ *
+ * Return: Length of the encoded character in bytes.
+ */
+static inline size_t c_internal_string_utf8_encode(uint32_t cp, char *dst) {
+        unsigned char *d = (unsigned char *)dst;
+
+        if (cp < 0x80) {
+                if (d)
+                        d[0] = cp;
+                return 1;
+        } else if (cp < 0x800) {
+                if (d) {
+                        d[0] = 0xC0 | (cp >> 6);
+                        d[1] = 0x80 | (cp & 0x3f);
+                }
+                return 2;
+        } else if (cp < 0x10000) {
+                if (d) {
+                        d[0] = 0xE0 | (cp >> 12);
+                        d[1] = 0x80 | ((cp >> 6) & 0x3f);
+                        d[2] = 0x80 | (cp & 0x3f);
+                }
+                return 3;
+        } else {
+                if (d) {
+                        d[0] = 0xF0 | (cp >> 18);
+                        d[1] = 0x80 | ((cp >> 12) & 0x3f);
+                        d[2] = 0x80 | ((cp >> 6) & 0x3f);
+                        d[3] = 0x80 | (cp & 0x3f);
+                }
+                return 4;
+        }
+}
+
+/*
+ * The transcoders copy runs of ASCII characters in bulk. SSE2 is part of the
+ * x86-64 baseline, so no runtime detection is needed for it.
+ */
+
+static inline void c_internal_string_widen16(const char *str, size_t n, uint16_t *dst) {
+#if defined(__SSE2__)
+        __m128i input;
+
+        for ( ; n >= sizeof(input); n -= sizeof(input), str += sizeof(input), dst += sizeof(input)) {
+                input = _mm_loadu_si128((const __m128i *)str);
+                _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi8(input, _mm_setzero_si128()));
+                _mm_storeu_si128((__m128i *)dst + 1, _mm_unpackhi_epi8(input, _mm_setzero_si128()));
+        }
+#endif
+
+        while (n--)
+                *dst++ = (unsigned char)*str++;
+}
+
+static inline void c_internal_string_widen32(const char *str, size_t n, uint32_t *dst) {
+#if defined(__SSE2__)
+        __m128i input, low, high;
+
+        for ( ; n >= sizeof(input); n -= sizeof(input), str += sizeof(input), dst += sizeof(input)) {
+                input = _mm_loadu_si128((const __m128i *)str);
+                low = _mm_unpacklo_epi8(input, _mm_setzero_si128());
+                high = _mm_unpackhi_epi8(input, _mm_setzero_si128());
+                _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi16(low, _mm_setzero_si128()));
+                _mm_storeu_si128((__m128i *)dst + 1, _mm_unpackhi_epi16(low, _mm_setzero_si128()));
+                _mm_storeu_si128((__m128i *)dst + 2, _mm_unpacklo_epi16(high, _mm_setzero_si128()));
+                _mm_storeu_si128((__m128i *)dst + 3, _mm_unpackhi_epi16(high, _mm_setzero_si128()));
+        }
+#endif
+
+        while (n--)
+                *dst++ = (unsigned char)*str++;
+}
+
+/*
+ * c_internal_string_narrow16() - copy leading ASCII from UTF-16
+ *
+ * This copies the leading run of non-zero ASCII code units from @src to @dst,
+ * unless @dst is NULL.
+ *
+ * Return: Number of code units copied.
+ */
+static inline size_t c_internal_string_narrow16(const uint16_t *src, size_t n, char *dst) {
+        size_t i = 0;
+
+#if defined(__SSE2__)
+        __m128i packed;
+
+        for ( ; n - i >= 16; i += 16) {
+                /* packing saturates, so anything non-ASCII has its high-bit set */
+                packed = _mm_packus_epi16(_mm_loadu_si128((const __m128i *)(src + i)),
+                                          _mm_loadu_si128((const __m128i *)(src + i) + 1));
+                if (_mm_movemask_epi8(_mm_or_si128(packed, _mm_cmpeq_epi8(packed, _mm_setzero_si128()))))
+                        break;
+                if (dst)
+                        _mm_storeu_si128((__m128i *)(dst + i), packed);
+        }
+#endif
+
+        for ( ; i < n && src[i] && src[i] < 0x80; ++i)
+                if (dst)
+                        dst[i] = src[i];
+
+        return i;
+}
+
+/*
+ * c_internal_string_narrow32() - copy leading ASCII from UTF-32
+ *
+ * This is the UTF-32 equivalent of c_internal_string_narrow16().
+ *
+ * Return: Number of code units copied.
+ */
+static inline size_t c_internal_string_narrow32(const uint32_t *src, size_t n, char *dst) {
+        size_t i = 0;
+
+#if defined(__SSE2__)
+        __m128i packed;
+
+        for ( ; n - i >= 16; i += 16) {
+                /* signed saturation maps anything above 0x7fffffff to 0 */
+                packed = _mm_packus_epi16(_mm_packs_epi32(_mm_loadu_si128((const __m128i *)(src + i)),
+                                                          _mm_loadu_si128((const __m128i *)(src + i) + 1)),
+                                          _mm_packs_epi32(_mm_loadu_si128((const __m128i *)(src + i) + 2),
+                                                          _mm_loadu_si128((const __m128i *)(src + i) + 3)));
+                if (_mm_movemask_epi8(_mm_or_si128(packed, _mm_cmpeq_epi8(packed, _mm_setzero_si128()))))
+                        break;
+                if (dst)
+                        _mm_storeu_si128((__m128i *)(dst + i), packed);
+        }
+#endif
+
+        for ( ; i < n && src[i] && src[i] < 0x80; ++i)
+                if (dst)
+                        dst[i] = src[i];
+
+        return i;
+}
+
+/**
+ * c_string_utf8_to_utf16() - transcode UTF-8 to UTF-16
+ * @str:                UTF-8 string to transcode
+ * @n:                  length of @str in bytes
+ * @dst:                destination buffer, or NULL
+ * @n_dstp:             output argument for the length of the result
+ *
+ * This transcodes the @n bytes at @str from UTF-8 to UTF-16 in host byte
+ * order. The input is verified according to c_string_verify_utf8(), and all
+ * @n bytes must be valid. That is, a NULL is rejected as well.
+ *
+ * If @dst is NULL, nothing is written, but the exact number of code units
+ * needed is still returned in @n_dstp. Otherwise, @dst must be large enough
+ * for the result. @n code units are always enough.
+ *
+ * Return: True if successful, false if the input is invalid.
+ */
+static inline bool c_string_utf8_to_utf16(const char *str, size_t n, uint16_t *dst, size_t *n_dstp) {
+        size_t l, n_dst = 0;
+        char *ascii;
+        uint32_t cp;
+
+        while (n) {
+                ascii = (char *)str;
+                l = n;
+                c_string_verify_ascii(&ascii, &l);
+                if (dst)
+                        c_internal_string_widen16(str, ascii - str, dst + n_dst);
+                n_dst += ascii - str;
+                n -= ascii - str;
+                str = ascii;
+                if (!n)
+                        break;
+
+                l = c_internal_string_utf8_decode(str, n, &cp);
+                if (!l)
+                        return false;
+
+                if (cp < 0x10000) {
+                        if (dst)
+                                dst[n_dst] = cp;
+                        n_dst += 1;
+                } else {
+                        if (dst) {
+                                dst[n_dst] = 0xD800 + ((cp - 0x10000) >> 10);
+                                dst[n_dst + 1] = 0xDC00 + ((cp - 0x10000) & 0x3ff);
+                        }
+                        n_dst += 2;
+                }
+
+                str += l;
+                n -= l;
+        }
+
+        *n_dstp = n_dst;
+        return true;
+}
+
+/**
+ * c_string_utf8_to_utf32() - transcode UTF-8 to UTF-32
+ * @str:                UTF-8 string to transcode
+ * @n:                  length of @str in bytes
+ * @dst:                destination buffer, or NULL
+ * @n_dstp:             output argument for the length of the result
+ *
+ * This is the UTF-32 equivalent of c_string_utf8_to_utf16(). @n code units are
+ * always enough to hold the result.
+ *
+ * Return: True if successful, false if the input is invalid.
+ */
+static inline bool c_string_utf8_to_utf32(const char *str, size_t n, uint32_t *dst, size_t *n_dstp) {
+        size_t l, n_dst = 0;
+        char *ascii;
+        uint32_t cp;
+
+        while (n) {
+                ascii = (char *)str;
+                l = n;
+                c_string_verify_ascii(&ascii, &l);
+                if (dst)
+                        c_internal_string_widen32(str, ascii - str, dst + n_dst);
+                n_dst += ascii - str;
+                n -= ascii - str;
+                str = ascii;
+                if (!n)
+                        break;
+
+                l = c_internal_string_utf8_decode(str, n, &cp);
+                if (!l)
+                        return false;
+
+                if (dst)
+                        dst[n_dst] = cp;
+                n_dst += 1;
+
+                str += l;
+                n -= l;
+        }
+
+        *n_dstp = n_dst;
+        return true;
+}
+
+/**
+ * c_string_utf16_to_utf8() - transcode UTF-16 to UTF-8
+ * @src:                UTF-16 string to transcode
+ * @n:                  length of @src in code units
+ * @dst:                destination buffer, or NULL
+ * @n_dstp:             output argument for the length of the result
+ *
+ * This transcodes the @n code units at @src from UTF-16 in host byte order to
+ * UTF-8. Unpaired surrogates and NULL are rejected.
+ *
+ * If @dst is NULL, nothing is written, but the exact number of bytes needed is
+ * still returned in @n_dstp. Otherwise, @dst must be large enough for the
+ * result. 3 * @n bytes are always enough.
+ *
+ * Return: True if successful, false if the input is invalid.
+ */
+static inline bool c_string_utf16_to_utf8(const uint16_t *src, size_t n, char *dst, size_t *n_dstp) {
+        size_t l, n_dst = 0;
+        uint32_t cp;
+
+        while (n) {
+                l = c_internal_string_narrow16(src, n, dst ? dst + n_dst : NULL);
+                n_dst += l;
+                src += l;
+                n -= l;
+                if (!n)
+                        break;
+
+                if (_c_unlikely_(!src[0]))
+                        return false;
+
+                if (src[0] < 0xD800 || src[0] > 0xDFFF) {
+                        cp = src[0];
+                        l = 1;
+                } else if (src[0] < 0xDC00 && n > 1 && src[1] >= 0xDC00 && src[1] <= 0xDFFF) {
+                        cp = 0x10000 + ((src[0] - 0xD800) << 10) + (src[1] - 0xDC00);
+                        l = 2;
+                } else {
+                        return false;
+                }
+
+                n_dst += c_internal_string_utf8_encode(cp, dst ? dst + n_dst : NULL);
+                src += l;
+                n -= l;
+        }
+
+        *n_dstp = n_dst;
+        return true;
+}
+
+/**
+ * c_string_utf32_to_utf8() - transcode UTF-32 to UTF-8
+ * @src:                UTF-32 string to transcode
+ * @n:                  length of @src in code units
+ * @dst:                destination buffer, or NULL
+ * @n_dstp:             output argument for the length of the result
+ *
+ * This is the UTF-32 equivalent of c_string_utf16_to_utf8(). Surrogates, code
+ * points beyond U+10FFFF, and NULL are rejected. 4 * @n bytes are always
+ * enough to hold the result.
+ *
+ * Return: True if successful, false if the input is invalid.
+ */
+static inline bool c_string_utf32_to_utf8(const uint32_t *src, size_t n, char *dst, size_t *n_dstp) {
+        size_t l, n_dst = 0;
+
+        while (n) {
+                l = c_internal_string_narrow32(src, n, dst ? dst + n_dst : NULL);
+                n_dst += l;
+                src += l;
+                n -= l;
+                if (!n)
+                        break;
+
+                if (_c_unlikely_(!src[0] || src[0] > 0x10FFFF || (src[0] >= 0xD800 && src[0] <= 0xDFFF)))
+                        return false;
+
+                n_dst += c_internal_string_utf8_encode(src[0], dst ? dst + n_dst : NULL);
+                ++src;
+                --n;
+        }
+
+        *n_dstp = n_dst;
+        return true;
+}
+
+static const char c_internal_string_digits[200] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+_c_const_ static inline unsigned int c_internal_string_count_digits(uint64_t v) {
+        unsigned int n = 1;
+
+        for (;;) {
+                if (v < 10)
+                        return n;
+                if (v < 100)
+                        return n + 1;
+                if (v < 1000)
+                        return n + 2;
+                if (v < 10000)
+                        return n + 3;
+
+                v /= 10000;
+                n += 4;
+        }
+}
+
+/**
+ * c_string_from_u64() - format unsigned integer as decimal
+ * @str:        destination buffer
+ * @v:          value to format
+ *
+ * This writes the decimal representation of @v to @str, followed by a
+ * terminating zero. The destination buffer must be at least
+ * C_DECIMAL_MAX(uint64_t) + 1 bytes long. Unlike snprintf(), this is not
+ * affected by the locale. Two digits are produced per step, via a lookup
+ * table.
+ *
+ * Return: The number of digits written, excluding the terminator.
+ */
+static inline size_t c_string_from_u64(char *str, uint64_t v) {
+        unsigned int n = c_internal_string_count_digits(v);
+        char *p = str + n;
+
+        *p = 0;
+
+        while (v >= 100) {
+                p -= 2;
+                memcpy(p, c_internal_string_digits + 2 * (v % 100), 2);
+                v /= 100;
+        }
+
+        if (v >= 10) {
+                p -= 2;
+                memcpy(p, c_internal_string_digits + 2 * v, 2);
+        } else {
+                *--p = '0' + v;
+        }
+
+        return n;
+}
+
+/**
+ * c_string_from_i64() - format signed integer as decimal
+ * @str:        destination buffer
+ * @v:          value to format
+ *
+ * This is the same as c_string_from_u64(), but for signed integers. Negative
+ * values are prefixed with a minus sign. The destination buffer must be at
+ * least C_DECIMAL_MAX(int64_t) + 1 bytes long.
+ *
+ * Return: The number of characters written, excluding the terminator.
+ */
+static inline size_t c_string_from_i64(char *str, int64_t v) {
+        if (v < 0) {
+                *str = '-';
+                return 1 + c_string_from_u64(str + 1, -(uint64_t)v);
+        }
+
+        return c_string_from_u64(str, v);
+}
+
+/*
+ * c_internal_string_parse8() - parse 8 decimal digits at once
+ *
+ * This loads 8 characters into a single word and verifies all of them are
+ * digits. The digits are then combined pairwise, pairs into quadruples, and
+ * quadruples into the final value, each with a single multiplication.
+ */
+static inline bool c_internal_string_parse8(const char *str, uint64_t *vp) {
+        uint64_t v;
+
+        memcpy(&v, str, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        v = __builtin_bswap64(v);
+#endif
+
+        if (((v & UINT64_C(0xf0f0f0f0f0f0f0f0)) |
+             (((v + UINT64_C(0x0606060606060606)) & UINT64_C(0xf0f0f0f0f0f0f0f0)) >> 4)) !=
+            UINT64_C(0x3333333333333333))
+                return false;
+
+        v = ((v & UINT64_C(0x0f0f0f0f0f0f0f0f)) * 2561) >> 8;
+        v = ((v & UINT64_C(0x00ff00ff00ff00ff)) * 6553601) >> 16;
+        *vp = ((v & UINT64_C(0x0000ffff0000ffff)) * UINT64_C(42949672960001)) >> 32;
+        return true;
+}
+
+/**
+ * c_string_to_u64() - parse unsigned decimal integer
+ * @str:        string to parse
+ * @n:          length of @str in bytes
+ * @vp:         output argument for the parsed value
+ *
+ * This parses the decimal integer given as @str and @n. Parsing is strict:
+ * the entire input must consist of decimal digits, and at least one digit is
+ * required. Leading zeros are allowed. Signs, whitespace, and any other
+ * characters are rejected. Unlike strtoull(), this is not affected by the
+ * locale. Runs of 8 digits are parsed at once.
+ *
+ * On failure, @vp is left untouched.
+ *
+ * Return: 0 on success, -EINVAL if the input is not a decimal integer, or
+ *         -ERANGE if it does not fit into 64 bits.
+ */
+static inline int c_string_to_u64(const char *str, size_t n, uint64_t *vp) {
+        const char *end = str + n;
+        uint64_t v = 0, chunk;
+        size_t i;
+
+        if (!n)
+                return -EINVAL;
+
+        while (str < end && *str == '0')
+                ++str;
+
+        /* more than 20 significant digits always overflow */
+        if (end - str > 20) {
+                for (i = 0; i < (size_t)(end - str); ++i)
+                        if (str[i] < '0' || str[i] > '9')
+                                return -EINVAL;
+                return -ERANGE;
+        }
+
+        /* 16 digits cannot overflow, so no checks needed */
+        while (end - str >= 8 && v < UINT64_C(100000000)) {
+                if (!c_internal_string_parse8(str, &chunk))
+                        return -EINVAL;
+
+                v = v * 100000000 + chunk;
+                str += 8;
+        }
+
+        for ( ; str < end; ++str) {
+                if (*str < '0' || *str > '9')
+                        return -EINVAL;
+                if (__builtin_mul_overflow(v, 10, &v) || __builtin_add_overflow(v, *str - '0', &v)) {
+                        /* this can only be the last digit */
+                        return -ERANGE;
+                }
+        }
+
+        *vp = v;
+        return 0;
+}
+
+/**
+ * c_string_to_i64() - parse signed decimal integer
+ * @str:        string to parse
+ * @n:          length of @str in bytes
+ * @vp:         output argument for the parsed value
+ *
+ * This is the same as c_string_to_u64(), but for signed integers. A single
+ * leading minus sign is allowed. A plus sign is not.
+ *
+ * Return: 0 on success, -EINVAL if the input is not a decimal integer, or
+ *         -ERANGE if it does not fit into 64 bits.
+ */
+static inline int c_string_to_i64(const char *str, size_t n, int64_t *vp) {
+        bool negative;
+        uint64_t v;
+        int r;
+
+        negative = n && *str == '-';
+        if (negative) {
+                ++str;
+                --n;
+        }
+
+        r = c_string_to_u64(str, n, &v);
+        if (r)
+                return r;
+
+        if (negative) {
+                if (v > (uint64_t)INT64_MAX + 1)
+                        return -ERANGE;
+                *vp = (int64_t)(0 - v);
+        } else {
+                if (v > INT64_MAX)
+                        return -ERANGE;
+                *vp = v;
+        }
+
+        return 0;
+}
+
+/*
+ * The escape functions share a scan for the next byte that needs to be
+ * escaped. Bytes are biased by 0x60, which moves the control characters to
+ * the top of the signed range (96 to 127), right above DEL and the non-ASCII
+ * bytes (-33 to 95). A single signed comparison against a limit thus selects
+ * either just the control characters, or the control characters plus DEL and
+ * all non-ASCII bytes. Quotes and backslashes are always selected.
+ */
+#define C_INTERNAL_STRING_ESCAPE_C ((signed char)-34)
+#define C_INTERNAL_STRING_ESCAPE_JSON ((signed char)95)
+
+_c_const_ static inline bool c_internal_string_escape_special(unsigned char c, signed char limit) {
+        return (signed char)(c + 0x60) > limit || c == '"' || c == '\\';
+}
+
+/*
+ * c_internal_string_escape_span_scalar() - reference implementation
+ *
+ * This returns the number of leading bytes of the @n bytes at @str which do
+ * not need to be escaped, given the @limit of the escape style. All
+ * accelerated implementations must return exactly the same.
+ */
+_c_pure_ static inline size_t c_internal_string_escape_span_scalar(const char *str, size_t n, signed char limit) {
+        size_t i;
+
+        for (i = 0; i < n && !c_internal_string_escape_special(str[i], limit); ++i)
+                ;
+
+        return i;
+}
+
+#if C_INTERNAL_STRING_X86
+
+_c_target_("sse2")
+static inline size_t c_internal_string_escape_span_sse2(const char *str, size_t n, signed char limit) {
+        __m128i v, special;
+        unsigned int mask;
+        size_t i;
+
+        for (i = 0; i + sizeof(v) <= n; i += sizeof(v)) {
+                v = _mm_loadu_si128((const __m128i *)(str + i));
+                special = _mm_cmpgt_epi8(_mm_add_epi8(v, _mm_set1_epi8(0x60)), _mm_set1_epi8(limit));
+                special = _mm_or_si128(special, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+                special = _mm_or_si128(special, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+                mask = _mm_movemask_epi8(special);
+                if (mask)
+                        return i + __builtin_ctz(mask);
+        }
+
+        return i + c_internal_string_escape_span_scalar(str + i, n - i, limit);
+}
+
+_c_target_("avx2")
+static inline size_t c_internal_string_escape_span_avx2(const char *str, size_t n, signed char limit) {
+        __m256i v, special;
+        unsigned int mask;
+        size_t i;
+
+        for (i = 0; i + sizeof(v) <= n; i += sizeof(v)) {
+                v = _mm256_loadu_si256((const __m256i *)(str + i));
+                special = _mm256_cmpgt_epi8(_mm256_add_epi8(v, _mm256_set1_epi8(0x60)), _mm256_set1_epi8(limit));
+                special = _mm256_or_si256(special, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+                special = _mm256_or_si256(special, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+                mask = _mm256_movemask_epi8(special);
+                if (mask)
+                        return i + __builtin_ctz(mask);
+        }
+
+        return i + c_internal_string_escape_span_scalar(str + i, n - i, limit);
+}
+
+#endif /* C_INTERNAL_STRING_X86 */
+
+static inline size_t c_internal_string_escape_span(const char *str, size_t n, signed char limit) {
+#if C_INTERNAL_STRING_X86
+        if (n >= 32 && __builtin_cpu_supports("avx2"))
+                return c_internal_string_escape_span_avx2(str, n, limit);
+        if (n >= 16 && __builtin_cpu_supports("sse2"))
+                return c_internal_string_escape_span_sse2(str, n, limit);
+#endif
+        return c_internal_string_escape_span_scalar(str, n, limit);
+}
+
+/**
+ * C_STRING_ESCAPE_C_MAX() - calculate maximum length of C escaped data
+ * @_n:         length of the data in bytes
+ *
+ * Return: Evaluates to an upper bound of the length in bytes of @_n bytes
+ *         escaped with c_string_escape_c().
+ */
+#define C_STRING_ESCAPE_C_MAX(_n) ((_n) * 4)
+
+/**
+ * C_STRING_ESCAPE_JSON_MAX() - calculate maximum length of JSON escaped data
+ * @_n:         length of the data in bytes
+ *
+ * Return: Evaluates to an upper bound of the length in bytes of @_n bytes
+ *         escaped with c_string_escape_json().
+ */
+#define C_STRING_ESCAPE_JSON_MAX(_n) ((_n) * 6)
+
+/**
+ * C_STRING_ESCAPE_SHELL_MAX() - calculate maximum length of shell escaped data
+ * @_n:         length of the data in bytes
+ *
+ * Return: Evaluates to an upper bound of the length in bytes of @_n bytes
+ *         escaped with c_string_escape_shell().
+ */
+#define C_STRING_ESCAPE_SHELL_MAX(_n) ((_n) * 4 + 2)
+
+/**
+ * c_string_escape_c() - escape string for a C string literal
+ * @str:        string to escape
+ * @n:          length of @str in bytes
+ * @dst:        destination buffer, or NULL
+ *
+ * This escapes the @n bytes at @str, so they can be placed between the double
+ * quotes of a C string literal. The result consists of printable ASCII only.
+ * Quotes, backslashes and the control characters with a named escape sequence
+ * (like "\n") are escaped with it, all other control characters, DEL, and all
+ * non-ASCII bytes are escaped as three-digit octal sequences. No terminating
+ * zero is written.
+ *
+ * If @dst is NULL, nothing is written, but the exact length of the result is
+ * still returned. Otherwise, @dst must be large enough for the result.
+ * C_STRING_ESCAPE_C_MAX(@n) bytes are always enough.
+ *
+ * Runs of bytes that need no escaping are located 16 or 32 bytes at a time,
+ * and copied in bulk.
+ *
+ * Return: Length of the result in bytes.
+ */
+static inline size_t c_string_escape_c(const char *str, size_t n, char *dst) {
+        static const char names[] = "abtnvfr";
+        unsigned char c;
+        size_t l, n_dst = 0;
+        char esc[4];
+
+        while (n) {
+                l = c_internal_string_escape_span(str, n, C_INTERNAL_STRING_ESCAPE_C);
+                c_internal_string_emit(dst, &n_dst, str, l);
+                str += l;
+                n -= l;
+                if (!n)
+                        break;
+
+                c = *str++;
+                --n;
+
+                esc[0] = '\\';
+                if (c >= '\a' && c <= '\r') {
+                        esc[1] = names[c - '\a'];
+                        l = 2;
+                } else if (c == '"' || c == '\\') {
+                        esc[1] = c;
+                        l = 2;
+                } else {
+                        esc[1] = '0' + (c >> 6);
+                        esc[2] = '0' + ((c >> 3) & 0x7);
+                        esc[3] = '0' + (c & 0x7);
+                        l = 4;
+                }
+
+                c_internal_string_emit(dst, &n_dst, esc, l);
+        }
+
+        return n_dst;
+}
+
+/**
+ * c_string_unescape_c() - unescape C string literal
+ * @str:        escaped string
+ * @n:          length of @str in bytes
+ * @dst:        destination buffer, or NULL
+ * @n_dstp:     output argument for the length of the result
+ *
+ * This reverses c_string_escape_c(). All simple escape sequences of ISO C,
+ * octal sequences of one to three digits, and hexadecimal sequences of
+ * exactly two digits are accepted. Any other byte is taken literally.
+ *
+ * If @dst is NULL, nothing is written, but the exact length of the result is
+ * still returned in @n_dstp. Otherwise, @dst must be at least @n bytes big.
+ * @dst may be equal to @str to unescape in place. On failure, the content of
+ * @dst is undefined.
+ *
+ * Return: True if successful, false if the input is invalid.
+ */
+static inline bool c_string_unescape_c(const char *str, size_t n, char *dst, size_t *n_dstp) {
+        static const char names[] = "abtnvfr";
+        const char *p;
+        size_t l, n_dst = 0;
+        unsigned int v;
+        char c;
+
+        while (n) {
+                p = memchr(str, '\\', n);
+                l = p ? (size_t)(p - str) : n;
+                c_internal_string_emit(dst, &n_dst, str, l);
+                str += l;
+                n -= l;
+                if (!n)
+                        break;
+
+                if (n < 2)
+                        return false;
+
+                p = memchr(names, str[1], sizeof(names) - 1);
+                if (p) {
+                        c = '\a' + (p - names);
+                        l = 2;
+                } else if (str[1] == '\\' || str[1] == '\'' || str[1] == '"' || str[1] == '?') {
+                        c = str[1];
+                        l = 2;
+                } else if (str[1] == 'x') {
+                        if (n < 4 || !c_internal_string_from_hex_scalar(&c, 1, str + 2, NULL))
+                                return false;
+                        l = 4;
+                } else if (str[1] >= '0' && str[1] <= '7') {
+                        v = 0;
+                        for (l = 1; l < 4 && l < n && str[l] >= '0' && str[l] <= '7'; ++l)
+                                v = v * 8 + str[l] - '0';
+                        if (v > 0xff)
+                                return false;
+                        c = v;
+                } else {
+                        return false;
+                }
+
+                c_internal_string_emit(dst, &n_dst, &c, 1);
+                str += l;
+                n -= l;
+        }
+
+        *n_dstp = n_dst;
+        return true;
+}
+
+/**
+ * c_string_escape_json() - escape string for a JSON string
+ * @str:        UTF-8 string to escape
+ * @n:          length of @str in bytes
+ * @dst:        destination buffer, or NULL
+ * @n_dstp:     output argument for the length of the result
+ *
+ * This escapes the @n bytes at @str, so they can be placed between the double
+ * quotes of a JSON string, according to RFC 8259. Quotes, backslashes and
+ * control characters are escaped, preferring the short escape sequences where
+ * they exist. All other characters are copied unmodified. The input must be
+ * valid UTF-8 according to c_string_verify_utf8(), except that NULLs are
+ * allowed and escaped. No terminating zero is written.
+ *
+ * If @dst is NULL, nothing is written, but the exact length of the result is
+ * still returned in @n_dstp. Otherwise, @dst must be large enough for the
+ * result. C_STRING_ESCAPE_JSON_MAX(@n) bytes are always enough.
+ *
+ * Runs of bytes that need no escaping are located 16 or 32 bytes at a time,
+ * verified with c_string_verify_utf8(), and copied in bulk.
+ *
+ * Return: True if successful, false if the input is not valid UTF-8.
+ */
+static inline bool c_string_escape_json(const char *str, size_t n, char *dst, size_t *n_dstp) {
+        static const char hex[] = "0123456789abcdef";
+        size_t l, len, n_dst = 0;
+        unsigned char c;
+        char esc[6], *p;
+
+        while (n) {
+                l = c_internal_string_escape_span(str, n, C_INTERNAL_STRING_ESCAPE_JSON);
+
+                /* the run has no NULLs, so it is verified in its entirety */
+                p = (char *)str;
+                len = l;
+                c_string_verify_utf8(&p, &len);
+                if (len)
+                        return false;
+
+                c_internal_string_emit(dst, &n_dst, str, l);
+                str += l;
+                n -= l;
+                if (!n)
+                        break;
+
+                c = *str++;
+                --n;
+
+                esc[0] = '\\';
+                l = 2;
+                switch (c) {
+                case '"':
+                case '\\':
+                        esc[1] = c;
+                        break;
+                case '\b':
+                        esc[1] = 'b';
+                        break;
+                case '\f':
+                        esc[1] = 'f';
+                        break;
+                case '\n':
+                        esc[1] = 'n';
+                        break;
+                case '\r':
+                        esc[1] = 'r';
+                        break;
+                case '\t':
+                        esc[1] = 't';
+                        break;
+                default:
+                        esc[1] = 'u';
+                        esc[2] = '0';
+                        esc[3] = '0';
+                        esc[4] = hex[c >> 4];
+                        esc[5] = hex[c & 0xf];
+                        l = 6;
+                        break;
+                }
+
+                c_internal_string_emit(dst, &n_dst, esc, l);
+        }
+
+        *n_dstp = n_dst;
+        return true;
+}
+
+static inline bool c_internal_string_unescape_json_u16(const char *str, size_t n, uint32_t *vp) {
+        unsigned char v[2];
+
+        if (n < 6 || str[0] != '\\' || str[1] != 'u')
+                return false;
+        if (!c_internal_string_from_hex_scalar((char *)v, 2, str + 2, NULL))
+                return false;
+
+        *vp = v[0] << 8 | v[1];
+        return true;
+}
+
+/**
+ * c_string_unescape_json() - unescape JSON string
+ * @str:        escaped string
+ * @n:          length of @str in bytes
+ * @dst:        destination buffer, or NULL
+ * @n_dstp:     output argument for the length of the result
+ *
+ * This unescapes the content of a JSON string (without the surrounding
+ * quotes), according to RFC 8259. Unescaped quotes and control characters
+ * are rejected. Unescaped characters must be valid UTF-8 according to
+ * c_string_verify_utf8(), and "\u" sequences must encode valid code points.
+ * Surrogate pairs are combined, lone surrogates are rejected. The result is
+ * valid UTF-8, but may contain NULLs if the input contains "\u0000".
+ *
+ * If @dst is NULL, nothing is written, but the exact length of the result is
+ * still returned in @n_dstp. Otherwise, @dst must be at least @n bytes big.
+ * @dst may be equal to @str to unescape in place. On failure, the content of
+ * @dst is undefined.
+ *
+ * Return: True if successful, false if the input is invalid.
+ */
+static inline bool c_string_unescape_json(const char *str, size_t n, char *dst, size_t *n_dstp) {
+        size_t l, len, n_dst = 0;
+        uint32_t cp, low;
+        char c, *p;
+
+        while (n) {
+                l = c_internal_string_escape_span(str, n, C_INTERNAL_STRING_ESCAPE_JSON);
+
+                p = (char *)str;
+                len = l;
+                c_string_verify_utf8(&p, &len);
+                if (len)
+                        return false;
+
+                c_internal_string_emit(dst, &n_dst, str, l);
+                str += l;
+                n -= l;
+                if (!n)
+                        break;
+
+                if (*str != '\\' || n < 2)
+                        return false;
+
+                l = 2;
+                switch (str[1]) {
+                case '"':
+                case '\\':
+                case '/':
+                        c = str[1];
+                        break;
+                case 'b':
+                        c = '\b';
+                        break;
+                case 'f':
+                        c = '\f';
+                        break;
+                case 'n':
+                        c = '\n';
+                        break;
+                case 'r':
+                        c = '\r';
+                        break;
+                case 't':
+                        c = '\t';
+                        break;
+                case 'u':
+                        if (!c_internal_string_unescape_json_u16(str, n, &cp))
+                                return false;
+
+                        l = 6;
+                        if (cp >= 0xD800 && cp < 0xDC00) {
+                                if (!c_internal_string_unescape_json_u16(str + 6, n - 6, &low) ||
+                                    low < 0xDC00 || low >= 0xE000)
+                                        return false;
+
+                                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                                l = 12;
+                        } else if (cp >= 0xDC00 && cp < 0xE000) {
+                                return false;
+                        }
+
+                        n_dst += c_internal_string_utf8_encode(cp, dst ? dst + n_dst : NULL);
+                        str += l;
+                        n -= l;
+                        continue;
+                default:
+                        return false;
+                }
+
+                c_internal_string_emit(dst, &n_dst, &c, 1);
+                str += l;
+                n -= l;
+        }
+
+        *n_dstp = n_dst;
+        return true;
+}
+
+/*
+ * c_internal_string_shell_safe() - check for a byte without special meaning
+ *
+ * This returns true for the bytes which have no special meaning to a POSIX
+ * shell anywhere in an unquoted word.
+ */
+_c_const_ static inline bool c_internal_string_shell_safe(unsigned char c) {
+        return (c >= 'a' && c <= 'z') ||
+               (c >= 'A' && c <= 'Z') ||
+               (c >= '0' && c <= '9') ||
+               (c && strchr("%+,-./:=@_", c));
+}
+
+/**
+ * c_string_escape_shell() - quote string for a POSIX shell
+ * @str:        string to quote
+ * @n:          length of @str in bytes
+ * @dst:        destination buffer, or NULL
+ *
+ * This quotes the @n bytes at @str, so a POSIX shell parses the result as a
+ * single word with exactly the content of @str. Non-empty strings consisting
+ * of letters, digits, and the characters "%+,-./:=@_" only are copied
+ * unmodified. Anything else is placed in single quotes, and single quotes
+ * themselves are written as "'\''". Note that a shell word cannot contain
+ * NULLs. No terminating zero is written.
+ *
+ * If @dst is NULL, nothing is written, but the exact length of the result is
+ * still returned. Otherwise, @dst must be large enough for the result.
+ * C_STRING_ESCAPE_SHELL_MAX(@n) bytes are always enough.
+ *
+ * Return: Length of the result in bytes.
+ */
+static inline size_t c_string_escape_shell(const char *str, size_t n, char *dst) {
+        size_t l, n_dst = 0;
+        const char *p;
+
+        for (l = 0; l < n && c_internal_string_shell_safe(str[l]); ++l)
+                ;
+
+        if (n && l == n) {
+                c_internal_string_emit(dst, &n_dst, str, n);
+                return n_dst;
+        }
+
+        c_internal_string_emit(dst, &n_dst, "'", 1);
+        for (;;) {
+                p = memchr(str, '\'', n);
+                l = p ? (size_t)(p - str) : n;
+                c_internal_string_emit(dst, &n_dst, str, l);
+                if (!p)
+                        break;
+
+                c_internal_string_emit(dst, &n_dst, "'\\''", 4);
+                str += l + 1;
+                n -= l + 1;
+        }
+        c_internal_string_emit(dst, &n_dst, "'", 1);
+
+        return n_dst;
+}
+
+static inline bool c_internal_string_unescape_shell_dquote(const char **strp, size_t *np, char *dst, size_t *n_dstp) {
+        const char *str = *strp;
+        size_t l, n = *np;
+
+        for (;;) {
+                for (l = 0; l < n && !memchr("\"\\$`", str[l], 4); ++l)
+                        ;
+
+                c_internal_string_emit(dst, n_dstp, str, l);
+                str += l;
+                n -= l;
+                if (!n || *str == '$' || *str == '`')
+                        return false;
+                if (*str == '"')
+                        break;
+
+                /* a backslash only escapes the characters special in here */
+                if (n >= 2 && memchr("\"\\$`\n", str[1], 5)) {
+                        if (str[1] != '\n')
+                                c_internal_string_emit(dst, n_dstp, str + 1, 1);
+                        str += 2;
+                        n -= 2;
+                } else {
+                        c_internal_string_emit(dst, n_dstp, str, 1);
+                        str += 1;
+                        n -= 1;
+                }
+        }
+
+        *strp = str + 1;
+        *np = n - 1;
+        return true;
+}
+
+/**
+ * c_string_unescape_shell() - unquote POSIX shell word
+ * @str:        quoted shell word
+ * @n:          length of @str in bytes
+ * @dst:        destination buffer, or NULL
+ * @n_dstp:     output argument for the length of the result
+ *
+ * This removes the quoting of a single POSIX shell word, and thus reverses
+ * c_string_escape_shell(). Single quotes, double quotes and backslashes are
+ * supported. Anything that would make a shell do more than remove quotes is
+ * rejected. That is, unquoted whitespace and operators, unterminated quotes,
+ * and any kind of expansion.
+ *
+ * If @dst is NULL, nothing is written, but the exact length of the result is
+ * still returned in @n_dstp. Otherwise, @dst must be at least @n bytes big.
+ * @dst may be equal to @str to unquote in place. On failure, the content of
+ * @dst is undefined.
+ *
+ * Return: True if successful, false if the input is invalid.
+ */
+static inline bool c_string_unescape_shell(const char *str, size_t n, char *dst, size_t *n_dstp) {
+        size_t l, n_dst = 0;
+        const char *p;
+
+        while (n) {
+                if (*str == '\'') {
+                        p = memchr(str + 1, '\'', n - 1);
+                        if (!p)
+                                return false;
+
+                        l = p - str - 1;
+                        c_internal_string_emit(dst, &n_dst, str + 1, l);
+                        str += l + 2;
+                        n -= l + 2;
+                } else if (*str == '"') {
+                        ++str;
+                        --n;
+                        if (!c_internal_string_unescape_shell_dquote(&str, &n, dst, &n_dst))
+                                return false;
+                } else if (*str == '\\') {
+                        if (n < 2)
+                                return false;
+
+                        if (str[1] != '\n')
+                                c_internal_string_emit(dst, &n_dst, str + 1, 1);
+                        str += 2;
+                        n -= 2;
+                } else {
+                        for (l = 0; l < n && c_internal_string_shell_safe(str[l]); ++l)
+                                ;
+                        if (!l)
+                                return false;
+
+                        c_internal_string_emit(dst, &n_dst, str, l);
+                        str += l;
+                        n -= l;
+                }
+        }
+
+        *n_dstp = n_dst;
+        return true;
+}
+
+enum {
+        C_STRING_URI_FORM               = (1U << 0),
+};
+
+/**
+ * C_STRING_ESCAPE_URI_MAX() - calculate maximum length of percent-encoded data
+ * @_n:         length of the data in bytes
+ *
+ * Return: Evaluates to an upper bound of the length in bytes of @_n bytes
+ *         escaped with c_string_escape_uri().
+ */
+#define C_STRING_ESCAPE_URI_MAX(_n) ((_n) * 3)
+
+/*
+ * c_internal_string_uri_unsafe() - compute set of bytes to percent-encode
+ *
+ * This fills @set with all bytes but the unreserved characters of RFC 3986
+ * and the characters in @safe. The percent sign is always included, and so
+ * are the space and plus sign in form-encoding.
+ */
+static inline void c_internal_string_uri_unsafe(CInternalStringByteset *set, const char *safe, unsigned int flags) {
+        static const char unreserved[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-._~";
+        const char *p;
+
+        memset(set, 0xff, sizeof(*set));
+        for (p = unreserved; *p; ++p)
+                c_internal_string_byteset_remove(set, *p);
+        for (p = safe; p && *p; ++p)
+                c_internal_string_byteset_remove(set, *p);
+
+        c_internal_string_byteset_add(set, '%');
+        if (flags & C_STRING_URI_FORM) {
+                c_internal_string_byteset_add(set, ' ');
+                c_internal_string_byteset_add(set, '+');
+        }
+}
+
+/**
+ * c_string_escape_uri() - percent-encode string for a URI
+ * @str:        string to escape
+ * @n:          length of @str in bytes
+ * @dst:        destination buffer, or NULL
+ * @safe:       zero-terminated set of additional bytes to copy unmodified,
+ *              or NULL
+ * @flags:      C_STRING_URI_* flags
+ *
+ * This percent-encodes the @n bytes at @str according to RFC 3986. The
+ * unreserved characters (letters, digits, and "-._~") and the bytes in @safe
+ * are copied unmodified, all other bytes are encoded as "%XX" with upper-case
+ * hex digits. Which bytes are safe depends on the component the result is
+ * used in, for instance "/" for paths, or the sub-delimiters "!$&'()*+,;=" for
+ * opaque components. The percent sign is always encoded, even if it is in
+ * @safe. No terminating zero is written.
+ *
+ * If C_STRING_URI_FORM is given, this encodes for the
+ * application/x-www-form-urlencoded format instead, which encodes spaces as
+ * "+" and thus always percent-encodes the plus sign.
+ *
+ * If @dst is NULL, nothing is written, but the exact length of the result is
+ * still returned. Otherwise, @dst must be large enough for the result.
+ * C_STRING_ESCAPE_URI_MAX(@n) bytes are always enough.
+ *
+ * Runs of bytes that need no encoding are located 16 or 32 bytes at a time,
+ * and copied in bulk.
+ *
+ * Return: Length of the result in bytes.
+ */
+static inline size_t c_string_escape_uri(const char *str, size_t n, char *dst, const char *safe, unsigned int flags) {
+        static const char hex[] = "0123456789ABCDEF";
+        CInternalStringByteset unsafe;
+        size_t l, n_dst = 0;
+        unsigned char c;
+        char esc[3];
+
+        c_internal_string_uri_unsafe(&unsafe, safe, flags);
+
+        while (n) {
+                l = c_internal_string_byteset_find(&unsafe, str, n);
+                c_internal_string_emit(dst, &n_dst, str, l);
+                str += l;
+                n -= l;
+                if (!n)
+                        break;
+
+                c = *str++;
+                --n;
+
+                if (c == ' ' && (flags & C_STRING_URI_FORM)) {
+                        c_internal_string_emit(dst, &n_dst, "+", 1);
+                } else {
+                        esc[0] = '%';
+                        esc[1] = hex[c >> 4];
+                        esc[2] = hex[c & 0xf];
+                        c_internal_string_emit(dst, &n_dst, esc, 3);
+                }
+        }
+
+        return n_dst;
+}
+
+/**
+ * c_string_unescape_uri() - decode percent-encoded string
+ * @str:        percent-encoded string
+ * @n:          length of @str in bytes
+ * @dst:        destination buffer, or NULL
+ * @n_dstp:     output argument for the length of the result
+ * @offsetp:    output argument for the offset of the first malformed escape
+ *              sequence, or NULL
+ * @flags:      C_STRING_URI_* flags
+ *
+ * This reverses c_string_escape_uri(). Every "%" must be followed by two hex
+ * digits of either case. Any other byte is taken literally, regardless of
+ * whether c_string_escape_uri() would have encoded it. If C_STRING_URI_FORM
+ * is given, plus signs are decoded as spaces.
+ *
+ * If @dst is NULL, nothing is written, but the exact length of the result is
+ * still returned in @n_dstp. Otherwise, @dst must be at least @n bytes big.
+ * @dst may be equal to @str to decode in place. On failure, the offset of the
+ * malformed escape sequence in @str is returned in @offsetp, and the content
+ * of @dst is undefined.
+ *
+ * Runs of bytes that need no decoding are located 16 or 32 bytes at a time,
+ * and copied in bulk.
+ *
+ * Return: True if successful, false if the input is invalid.
+ */
+static inline bool c_string_unescape_uri(const char *str, size_t n, char *dst, size_t *n_dstp, size_t *offsetp, unsigned int flags) {
+        CInternalStringByteset special = {};
+        const char *start = str;
+        size_t l, n_dst = 0;
+        char c;
+
+        c_internal_string_byteset_add(&special, '%');
+        if (flags & C_STRING_URI_FORM)
+                c_internal_string_byteset_add(&special, '+');
+
+        while (n) {
+                l = c_internal_string_byteset_find(&special, str, n);
+                c_internal_string_emit(dst, &n_dst, str, l);
+                str += l;
+                n -= l;
+                if (!n)
+                        break;
+
+                if (*str == '+') {
+                        c = ' ';
+                        l = 1;
+                } else if (n >= 3 && c_internal_string_from_hex_scalar(&c, 1, str + 1, NULL)) {
+                        l = 3;
+                } else {
+                        if (offsetp)
+                                *offsetp = str - start;
+                        return false;
+                }
+
+                c_internal_string_emit(dst, &n_dst, &c, 1);
+                str += l;
+                n -= l;
+        }
+
+        *n_dstp = n_dst;
+        return true;
+}
+
+/**
+ * c_string_buf_str() - return string of buffer
+ * @buf:                buffer to query
+ *
+ * Return: Pointer to the zero-terminated string in @buf. It is valid until
+ *         the next modification of @buf.
+ */
+static inline char *c_string_buf_str(CStringBuf *buf) {
+        return buf->heap ? buf->heap : buf->small;
+}
+
+/**
+ * c_string_buf_len() - return length of buffer
+ * @buf:                buffer to query
+ *
+ * Return: Length of the string in @buf in bytes, excluding the terminator.
+ */
+static inline size_t c_string_buf_len(CStringBuf *buf) {
+        return buf->len;
+}
+
+/**
+ * c_string_buf_deinit() - release string buffer
+ * @buf:                buffer to release
+ *
+ * This releases all resources of @buf, and resets it to an empty buffer.
+ */
+static inline void c_string_buf_deinit(CStringBuf *buf) {
+        free(buf->heap);
+        *buf = (CStringBuf)C_STRING_BUF_INIT;
+}
+
+/* cannot use C_DEFINE_CLEANUP(), since the buffer lives on the stack */
+static inline void c_string_buf_deinitp(CStringBuf *buf) {
+        c_string_buf_deinit(buf);
+}
+
+/**
+ * c_string_buf_clear() - truncate string buffer
+ * @buf:                buffer to truncate
+ *
+ * This truncates the string in @buf to the empty string, but keeps its
+ * storage around for reuse.
+ */
+static inline void c_string_buf_clear(CStringBuf *buf) {
+        buf->len = 0;
+        c_string_buf_str(buf)[0] = 0;
+}
+
+/**
+ * c_string_buf_reserve() - reserve space in string buffer
+ * @buf:                buffer to operate on
+ * @n:                  number of bytes to reserve
+ *
+ * This makes sure @buf can be extended by @n bytes without reallocation. On
+ * success, c_string_buf_str() points to at least @n + 1 bytes of writable
+ * storage behind the current string.
+ *
+ * Return: 0 on success, -ENOMEM on allocation failure.
+ */
+static inline int c_string_buf_reserve(CStringBuf *buf, size_t n) {
+        size_t size;
+        char *heap;
+
+        if (n < (buf->heap ? buf->size : sizeof(buf->small)) - buf->len)
+                return 0;
+
+        if (n >= SIZE_MAX / 2 - buf->len)
+                return -ENOMEM;
+
+        /* grow geometrically, so appends have amortized constant cost */
+        size = c_max(2 * sizeof(buf->small), 2 * buf->size);
+        size = c_max(size, buf->len + n + 1);
+
+        heap = realloc(buf->heap, size);
+        if (!heap)
+                return -ENOMEM;
+
+        if (!buf->heap)
+                memcpy(heap, buf->small, buf->len + 1);
+
+        buf->heap = heap;
+        buf->size = size;
+        return 0;
+}
+
+/**
+ * c_string_buf_append() - append bytes to string buffer
+ * @buf:                buffer to operate on
+ * @data:               data to append
+ * @n:                  length of @data in bytes
+ *
+ * This appends @n bytes from @data to the string in @buf.
+ *
+ * Return: 0 on success, -ENOMEM on allocation failure.
+ */
+static inline int c_string_buf_append(CStringBuf *buf, const void *data, size_t n) {
+        char *str;
+        int r;
+
+        r = c_string_buf_reserve(buf, n);
+        if (r)
+                return r;
+
+        str = c_string_buf_str(buf);
+        memcpy(str + buf->len, data, n);
+        buf->len += n;
+        str[buf->len] = 0;
+        return 0;
+}
+
+/**
+ * c_string_buf_append_str() - append string to string buffer
+ * @buf:                buffer to operate on
+ * @str:                zero-terminated string to append
+ *
+ * Return: 0 on success, -ENOMEM on allocation failure.
+ */
+static inline int c_string_buf_append_str(CStringBuf *buf, const char *str) {
+        return c_string_buf_append(buf, str, strlen(str));
+}
+
+/**
+ * c_string_buf_append_char() - append character to string buffer
+ * @buf:                buffer to operate on
+ * @c:                  character to append
+ *
+ * Return: 0 on success, -ENOMEM on allocation failure.
+ */
+static inline int c_string_buf_append_char(CStringBuf *buf, char c) {
+        return c_string_buf_append(buf, &c, 1);
+}
+
+/**
+ * c_string_buf_append_hex() - append hex-encoded data to string buffer
+ * @buf:                buffer to operate on
+ * @data:               data to encode
+ * @n:                  length of @data in bytes
+ *
+ * This hex-encodes @data via c_string_to_hex() and appends the result to the
+ * string in @buf.
+ *
+ * Return: 0 on success, -ENOMEM on allocation failure.
+ */
+static inline int c_string_buf_append_hex(CStringBuf *buf, const void *data, size_t n) {
+        char *str;
+        int r;
+
+        if (n > SIZE_MAX / 2)
+                return -ENOMEM;
+
+        r = c_string_buf_reserve(buf, 2 * n);
+        if (r)
+                return r;
+
+        str = c_string_buf_str(buf);
+        c_string_to_hex(data, n, str + buf->len);
+        buf->len += 2 * n;
+        str[buf->len] = 0;
+        return 0;
+}
+
+/**
+ * c_string_buf_append_u64() - append unsigned integer to string buffer
+ * @buf:                buffer to operate on
+ * @v:                  value to append
+ *
+ * This appends the decimal representation of @v to the string in @buf.
+ *
+ * Return: 0 on success, -ENOMEM on allocation failure.
+ */
+static inline int c_string_buf_append_u64(CStringBuf *buf, uint64_t v) {
+        char digits[C_DECIMAL_MAX(uint64_t) + 1];
+
+        return c_string_buf_append(buf, digits, c_string_from_u64(digits, v));
+}
+
+/**
+ * c_string_buf_append_i64() - append signed integer to string buffer
+ * @buf:                buffer to operate on
+ * @v:                  value to append
+ *
+ * This appends the decimal representation of @v to the string in @buf.
+ *
+ * Return: 0 on success, -ENOMEM on allocation failure.
+ */
+static inline int c_string_buf_append_i64(CStringBuf *buf, int64_t v) {
+        char digits[C_DECIMAL_MAX(int64_t) + 1];
+
+        return c_string_buf_append(buf, digits, c_string_from_i64(digits, v));
+}
+
+/**
+ * c_string_buf_append_vprintf() - append formatted string to string buffer
+ * @buf:                buffer to operate on
+ * @format:             printf() format string
+ * @args:               format arguments
+ *
+ * This formats the arguments as vsnprintf() does it, and appends the result
+ * to the string in @buf. The output is formatted directly into the buffer.
+ * Only if it does not fit, the buffer is grown and the output is formatted a
+ * second time.
+ *
+ * Return: 0 on success, -ENOMEM on allocation failure, -EINVAL on formatting
+ *         errors.
+ */
+_c_printf_(2, 0)
+static inline int c_string_buf_append_vprintf(CStringBuf *buf, const char *format, va_list args) {
+        size_t n_free;
+        va_list copy;
+        int r, l;
+
+        n_free = (buf->heap ? buf->size : sizeof(buf->small)) - buf->len;
+
+        va_copy(copy, args);
+        l = vsnprintf(c_string_buf_str(buf) + buf->len, n_free, format, copy);
+        va_end(copy);
+
+        if (l < 0) {
+                c_string_buf_str(buf)[buf->len] = 0;
+                return -EINVAL;
+        }
+
+        if ((size_t)l >= n_free) {
+                r = c_string_buf_reserve(buf, l);
+                if (r) {
+                        c_string_buf_str(buf)[buf->len] = 0;
+                        return r;
+                }
+
+                vsnprintf(c_string_buf_str(buf) + buf->len, l + 1, format, args);
+        }
+
+        buf->len += l;
+        return 0;
+}
+
+/**
+ * c_string_buf_append_printf() - append formatted string to string buffer
+ * @buf:                buffer to operate on
+ * @format:             printf() format string
+ * @...:                format arguments
+ *
+ * This is the same as c_string_buf_append_vprintf(), but takes the format
+ * arguments directly.
+ *
+ * Return: 0 on success, -ENOMEM on allocation failure, -EINVAL on formatting
+ *         errors.
+ */
+_c_printf_(2, 3)
+static inline int c_string_buf_append_printf(CStringBuf *buf, const char *format, ...) {
+        va_list args;
+        int r;
+
+        va_start(args, format);
+        r = c_string_buf_append_vprintf(buf, format, args);
+        va_end(args);
+
+        return r;
+}
+
+/**
+ * c_string_buf_steal() - take over string of buffer
+ * @buf:                buffer to operate on
+ * @lenp:               output argument for the string length, or NULL
+ *
+ * This returns the string assembled in @buf as heap allocation, which the
+ * caller must release via free(). The buffer is reset to an empty buffer. If
+ * the string lives on the heap already, it is handed over without copying.
+ * Otherwise, it is copied into a new allocation of the exact size.
+ *
+ * Return: Pointer to the zero-terminated string, or NULL on allocation
+ *         failure, in which case @buf is left untouched.
+ */
+static inline char *c_string_buf_steal(CStringBuf *buf, size_t *lenp) {
+        char *str;
+
+        if (buf->heap) {
+                str = buf->heap;
+        } else {
+                str = malloc(buf->len + 1);
+                if (!str)
+                        return NULL;
+
+                memcpy(str, buf->small, buf->len + 1);
+        }
+
+        if (lenp)
+                *lenp = buf->len;
+
+        *buf = (CStringBuf)C_STRING_BUF_INIT;
+        return str;
 }
 
 #ifdef __cplusplus
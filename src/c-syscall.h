@@ -60,6 +60,32 @@ static inline int c_syscall_memfd_create(const char *name, unsigned int flags) {
         return (int)syscall(nr, name, flags);
 }
 
+/**
+ * c_syscall_getrandom() - wrapper for getrandom(2) syscall
+ * @buffer:     buffer to fill with random bytes
+ * @n:          size of @buffer in bytes
+ * @flags:      getrandom flags
+ *
+ * This is a wrapper for the getrandom(2) syscall. Older libc versions do not
+ * export a user-space wrapper. Requests of up to 256 bytes are never
+ * truncated, but they might block until the kernel entropy pool is
+ * initialized, unless GRND_NONBLOCK is passed in @flags.
+ *
+ * Return: Number of bytes written to @buffer on success, -1 on failure.
+ */
+static inline int c_syscall_getrandom(void *buffer, size_t n, unsigned int flags) {
+#if defined __NR_getrandom
+        long nr = __NR_getrandom;
+#elif defined __x86_64__
+        long nr = 318;
+#elif defined __i386__
+        long nr = 355;
+#else
+#  error "__NR_getrandom is undefined"
+#endif
+        return (int)syscall(nr, buffer, n, flags);
+}
+
 /**
  * c_syscall_gettid() - wrapper for gettid(2) syscall
  *
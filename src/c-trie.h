@@ -0,0 +1,208 @@
+#pragma once
+
+/*
+ * Prefix Tries
+ *
+ * This implements a static multi-prefix matcher. A set of prefixes is compiled
+ * once into a deterministic automaton, which then finds the longest prefix of
+ * a string that is part of the set, in a single pass over the string. This
+ * replaces chains of c_string_prefix() calls, whose cost grows linearly with
+ * the number of prefixes.
+ *
+ * The automaton is a dense transition table indexed by state and byte class.
+ * Bytes that occur in no prefix share a single class, so the table stays
+ * small for typical (mostly alphanumeric) prefix sets. The entire trie is a
+ * single allocation. Once created, a trie is never modified, hence lookups
+ * can be run from any number of threads in parallel, without any
+ * synchronization.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <c-macro.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct CTrie CTrie;
+
+/* state 0 is the dead state, it has no outgoing transitions */
+#define C_INTERNAL_TRIE_DEAD 0
+#define C_INTERNAL_TRIE_ROOT 1
+#define C_INTERNAL_TRIE_NONE UINT32_MAX
+
+/**
+ * struct CTrie - compiled prefix trie
+ * @n_states:           number of states, including the dead state
+ * @n_classes:          number of byte classes
+ * @classes:            map from bytes to byte classes
+ *
+ * The transition table (@n_states * @n_classes entries) and the match table
+ * (@n_states entries) directly follow this structure in memory. Each match
+ * entry contains the ID of the prefix accepted by that state, or
+ * C_INTERNAL_TRIE_NONE. All members are private to the implementation.
+ */
+struct CTrie {
+        size_t n_states;
+        size_t n_classes;
+        uint8_t classes[256];
+};
+
+static inline uint32_t *c_internal_trie_transitions(const CTrie *trie) {
+        return (uint32_t *)(trie + 1);
+}
+
+static inline uint32_t *c_internal_trie_matches(const CTrie *trie) {
+        return c_internal_trie_transitions(trie) + trie->n_states * trie->n_classes;
+}
+
+/**
+ * c_trie_new() - compile prefix trie
+ * @triep:              output argument for the new trie
+ * @prefixes:           array of zero-terminated prefixes
+ * @n_prefixes:         number of entries in @prefixes
+ *
+ * This compiles the prefixes given in @prefixes into a new trie. The ID of a
+ * prefix is its index in @prefixes. If a prefix is given multiple times, the
+ * lowest ID is used. The empty prefix is allowed, and matches any string.
+ *
+ * The trie does not reference @prefixes, so the caller is free to release it
+ * once this function returns.
+ *
+ * Return: 0 on success, -EINVAL if too many or too long prefixes are given,
+ *         -ENOMEM on allocation failure.
+ */
+static inline int c_trie_new(CTrie **triep, const char * const *prefixes, size_t n_prefixes) {
+        uint8_t classes[256] = {};
+        size_t i, j, l, n_classes = 1, n_max = 2, n_states = 2;
+        uint32_t *transitions, *matches, *t, s;
+        CTrie *trie, *shrunk;
+
+        if (n_prefixes >= C_INTERNAL_TRIE_NONE)
+                return -EINVAL;
+
+        /*
+         * Assign byte classes in order of first appearance, and compute an
+         * upper bound on the number of states, assuming no prefixes share a
+         * common head.
+         */
+        for (i = 0; i < n_prefixes; ++i) {
+                l = strlen(prefixes[i]);
+                if (l >= C_INTERNAL_TRIE_NONE - n_max)
+                        return -EINVAL;
+
+                n_max += l;
+                for (j = 0; j < l; ++j)
+                        if (!classes[(unsigned char)prefixes[i][j]])
+                                classes[(unsigned char)prefixes[i][j]] = n_classes++;
+        }
+
+        if (n_max > (SIZE_MAX - sizeof(*trie)) / sizeof(uint32_t) / (n_classes + 1))
+                return -ENOMEM;
+
+        trie = calloc(1, sizeof(*trie) + n_max * (n_classes + 1) * sizeof(uint32_t));
+        if (!trie)
+                return -ENOMEM;
+
+        trie->n_states = n_max;
+        trie->n_classes = n_classes;
+        memcpy(trie->classes, classes, sizeof(classes));
+
+        transitions = c_internal_trie_transitions(trie);
+        matches = c_internal_trie_matches(trie);
+        for (i = 0; i < n_max; ++i)
+                matches[i] = C_INTERNAL_TRIE_NONE;
+
+        for (i = 0; i < n_prefixes; ++i) {
+                s = C_INTERNAL_TRIE_ROOT;
+
+                for (j = 0; prefixes[i][j]; ++j) {
+                        t = &transitions[s * n_classes + classes[(unsigned char)prefixes[i][j]]];
+                        if (*t == C_INTERNAL_TRIE_DEAD)
+                                *t = n_states++;
+                        s = *t;
+                }
+
+                if (matches[s] == C_INTERNAL_TRIE_NONE)
+                        matches[s] = i;
+        }
+
+        /*
+         * Move the match table directly behind the used part of the transition
+         * table and release the unused tail. If shrinking fails, we simply
+         * keep the larger allocation.
+         */
+        trie->n_states = n_states;
+        memmove(c_internal_trie_matches(trie), matches, n_states * sizeof(uint32_t));
+
+        shrunk = realloc(trie, sizeof(*trie) + n_states * (n_classes + 1) * sizeof(uint32_t));
+        *triep = shrunk ? shrunk : trie;
+        return 0;
+}
+
+/**
+ * c_trie_free() - destroy prefix trie
+ * @trie:               trie to destroy, or NULL
+ *
+ * This destroys @trie and releases all its resources. If NULL is passed, this
+ * is a no-op.
+ *
+ * Return: NULL is returned.
+ */
+static inline CTrie *c_trie_free(CTrie *trie) {
+        free(trie);
+        return NULL;
+}
+
+C_DEFINE_CLEANUP(CTrie *, c_trie_free);
+
+/**
+ * c_trie_lookup() - find longest matching prefix
+ * @trie:               trie to use
+ * @str:                zero-terminated string to check
+ * @idp:                output argument for the prefix ID, or NULL
+ *
+ * This searches the prefixes compiled into @trie for the longest one that
+ * @str starts with. This is equivalent to calling c_string_prefix() with each
+ * prefix and picking the longest match, but takes a single pass over @str and
+ * never reads beyond its terminator.
+ *
+ * On success, the ID of the matching prefix is stored in @idp. On failure,
+ * @idp is left untouched.
+ *
+ * Return: Pointer directly behind the longest matching prefix in @str, or
+ *         NULL if no prefix matches.
+ */
+static inline char *c_trie_lookup(const CTrie *trie, const char *str, size_t *idp) {
+        const uint32_t *transitions = c_internal_trie_transitions(trie);
+        const uint32_t *matches = c_internal_trie_matches(trie);
+        const char *end = NULL;
+        uint32_t s = C_INTERNAL_TRIE_ROOT, id = C_INTERNAL_TRIE_NONE;
+
+        /*
+         * The terminator is never part of a prefix, so its class has no
+         * transitions other than to the dead state, and the loop stops there.
+         */
+        for (;;) {
+                if (matches[s] != C_INTERNAL_TRIE_NONE) {
+                        id = matches[s];
+                        end = str;
+                }
+
+                s = transitions[s * trie->n_classes + trie->classes[(unsigned char)*str]];
+                if (s == C_INTERNAL_TRIE_DEAD)
+                        break;
+
+                ++str;
+        }
+
+        if (end && idp)
+                *idp = id;
+
+        return (char *)end;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,237 @@
+/*
+ * Tests for Multi-Pattern Search
+ * Bunch of tests for the Aho-Corasick module, comparing it against a naive
+ * search for each pattern.
+ */
+
+#include <stdlib.h>
+#include "c-aho.h"
+#include "c-macro.h"
+
+typedef struct TestMatch {
+        size_t id;
+        size_t offset;
+} TestMatch;
+
+typedef struct TestMatches {
+        TestMatch matches[4096];
+        size_t n_matches;
+} TestMatches;
+
+static int test_match_fn(void *userdata, size_t id, size_t offset) {
+        TestMatches *m = userdata;
+
+        assert(m->n_matches < C_ARRAY_SIZE(m->matches));
+        m->matches[m->n_matches++] = (TestMatch){ .id = id, .offset = offset };
+        return 0;
+}
+
+static int test_match_compare(const void *a, const void *b) {
+        const TestMatch *ma = a, *mb = b;
+
+        if (ma->offset != mb->offset)
+                return (ma->offset > mb->offset) - (ma->offset < mb->offset);
+        return (ma->id > mb->id) - (ma->id < mb->id);
+}
+
+static void test_search_reference(const char * const *patterns, size_t n_patterns, const char *str, size_t n, TestMatches *m) {
+        size_t i, j, k, l;
+
+        m->n_matches = 0;
+
+        for (i = 0; i < n_patterns; ++i) {
+                /* duplicates only report the lowest ID */
+                for (k = 0; k < i; ++k)
+                        if (!strcmp(patterns[k], patterns[i]))
+                                break;
+                if (k < i)
+                        continue;
+
+                l = strlen(patterns[i]);
+                for (j = 0; j + l <= n; ++j)
+                        if (!memcmp(str + j, patterns[i], l))
+                                test_match_fn(m, i, j);
+        }
+}
+
+static void test_search_compare(const CAho *aho, const char * const *patterns, size_t n_patterns, const char *str, size_t n) {
+        static TestMatches m1, m2;
+        _c_cleanup_(c_freep) char *dup = NULL;
+        size_t i;
+        int r;
+
+        /* heap copy, so ASAN catches reads beyond the end */
+        dup = malloc(c_max(n, (size_t)1));
+        assert(dup);
+        memcpy(dup, str, n);
+
+        test_search_reference(patterns, n_patterns, dup, n, &m1);
+
+        m2.n_matches = 0;
+        r = c_aho_search(aho, dup, n, test_match_fn, &m2);
+        assert(!r);
+
+        /* matches are reported in order of their end, longest first */
+        for (i = 1; i < m2.n_matches; ++i) {
+                assert(m2.matches[i - 1].offset + strlen(patterns[m2.matches[i - 1].id]) <=
+                       m2.matches[i].offset + strlen(patterns[m2.matches[i].id]));
+        }
+
+        qsort(m1.matches, m1.n_matches, sizeof(*m1.matches), test_match_compare);
+        qsort(m2.matches, m2.n_matches, sizeof(*m2.matches), test_match_compare);
+        assert(m1.n_matches == m2.n_matches);
+        assert(!memcmp(m1.matches, m2.matches, m1.n_matches * sizeof(*m1.matches)));
+}
+
+static int test_stop_fn(void *userdata, size_t id, size_t offset) {
+        size_t *n = userdata;
+
+        return ++*n == 2 ? 7 : 0;
+}
+
+static void test_basic(void) {
+        static const char * const patterns[] = {
+                "he",
+                "she",
+                "his",
+                "hers",
+                "she",
+                "\xff\x80",
+        };
+        _c_cleanup_(c_aho_freep) CAho *aho = NULL;
+        TestMatches m = {};
+        size_t n = 0;
+        int r;
+
+        r = c_aho_new(&aho, patterns, C_ARRAY_SIZE(patterns));
+        assert(!r);
+
+        r = c_aho_search_str(aho, "ushers", test_match_fn, &m);
+        assert(!r);
+        assert(m.n_matches == 3);
+        assert(m.matches[0].id == 1 && m.matches[0].offset == 1);
+        assert(m.matches[1].id == 0 && m.matches[1].offset == 2);
+        assert(m.matches[2].id == 3 && m.matches[2].offset == 2);
+
+        m.n_matches = 0;
+        r = c_aho_search(aho, "his\0\xff\x80", 6, test_match_fn, &m);
+        assert(!r);
+        assert(m.n_matches == 2);
+        assert(m.matches[0].id == 2 && m.matches[0].offset == 0);
+        assert(m.matches[1].id == 5 && m.matches[1].offset == 4);
+
+        m.n_matches = 0;
+        r = c_aho_search_str(aho, "his\0\xff\x80", test_match_fn, &m);
+        assert(!r);
+        assert(m.n_matches == 1);
+
+        r = c_aho_search_str(aho, "he he he", test_stop_fn, &n);
+        assert(r == 7);
+        assert(n == 2);
+}
+
+static void test_invalid(void) {
+        static const char * const patterns[] = {
+                "foo",
+                "",
+        };
+        _c_cleanup_(c_aho_freep) CAho *aho = NULL;
+        TestMatches m = {};
+        int r;
+
+        r = c_aho_new(&aho, patterns, C_ARRAY_SIZE(patterns));
+        assert(r == -EINVAL);
+        assert(!aho);
+
+        r = c_aho_new(&aho, NULL, 0);
+        assert(!r);
+        r = c_aho_search_str(aho, "foobar", test_match_fn, &m);
+        assert(!r);
+        assert(!m.n_matches);
+}
+
+static void test_prefilter(void) {
+        static const char * const patterns[] = {
+                "\x01", "\x7f", "\x80", "\xff", "a", "Q", "0",
+        };
+        _c_cleanup_(c_aho_freep) CAho *aho = NULL;
+        char buf[128];
+        size_t i, j, n;
+        int r;
+
+        r = c_aho_new(&aho, patterns, C_ARRAY_SIZE(patterns));
+        assert(!r);
+
+        /*
+         * Place every possible byte at every position of a buffer of
+         * otherwise uninteresting bytes, and verify all backends find exactly
+         * the first interesting one.
+         */
+        for (i = 0; i < 256; ++i) {
+                for (j = 0; j < sizeof(buf); j += 7) {
+                        memset(buf, 'b', sizeof(buf));
+                        buf[j] = i;
+                        n = c_internal_string_byteset_find_scalar(&aho->first, buf, sizeof(buf));
+                        assert(n == (c_internal_string_byteset_contains(&aho->first, i) ? j : sizeof(buf)));
+#if C_INTERNAL_STRING_X86
+                        if (__builtin_cpu_supports("ssse3"))
+                                assert(n == c_internal_string_byteset_find_ssse3(&aho->first, buf, sizeof(buf)));
+                        if (__builtin_cpu_supports("avx2"))
+                                assert(n == c_internal_string_byteset_find_avx2(&aho->first, buf, sizeof(buf)));
+#endif
+                }
+        }
+
+        for (i = 0; i < 256; ++i)
+                assert(c_internal_string_byteset_contains(&aho->first, i) ==
+                       (i == 0x01 || i == 0x7f || i == 0x80 || i == 0xff || i == 'a' || i == 'Q' || i == '0'));
+}
+
+static void test_random(void) {
+        static const char alphabet[] = "abc\xe0\x80";
+        _c_cleanup_(c_aho_freep) CAho *aho = NULL;
+        char storage[48][6], *patterns[48], str[512];
+        size_t i, j, k, l;
+        int r;
+
+        /*
+         * Use a tiny alphabet, so the patterns overlap and share heads and
+         * tails, and also mix in long runs of bytes outside of it, so the
+         * prefilter gets to skip.
+         */
+        srand(0xa4);
+
+        for (i = 0; i < C_ARRAY_SIZE(storage); ++i) {
+                l = 1 + rand() % (sizeof(storage[i]) - 1);
+                for (j = 0; j < l; ++j)
+                        storage[i][j] = alphabet[rand() % (sizeof(alphabet) - 1)];
+                storage[i][l] = 0;
+                patterns[i] = storage[i];
+        }
+
+        r = c_aho_new(&aho, (const char * const *)patterns, C_ARRAY_SIZE(patterns));
+        assert(!r);
+
+        for (i = 0; i < 1024; ++i) {
+                l = rand() % sizeof(str);
+                for (j = 0; j < l; ) {
+                        if (rand() % 4) {
+                                str[j++] = alphabet[rand() % (sizeof(alphabet) - 1)];
+                        } else {
+                                k = c_min(l - j, (size_t)(rand() % 64));
+                                memset(str + j, rand() % 2 ? 'x' : 0, k);
+                                j += k;
+                        }
+                }
+
+                test_search_compare(aho, (const char * const *)patterns, C_ARRAY_SIZE(patterns), str, l);
+        }
+}
+
+int main(int argc, char **argv) {
+        test_basic();
+        test_invalid();
+        test_prefilter();
+        test_random();
+        return 0;
+}
@@ -5,13 +5,82 @@
  */
 
 #include <stdlib.h>
+#include "c-aho.h"
 #include "c-bitmap.h"
+#include "c-hash.h"
+#include "c-intern.h"
+#include "c-lines.h"
 #include "c-macro.h"
 #include "c-ref.h"
+#include "c-sort.h"
 #include "c-string.h"
 #include "c-syscall.h"
+#include "c-trie.h"
 #include "c-usec.h"
 
+static int test_aho_fn(void *userdata, size_t id, size_t offset) {
+        return 0;
+}
+
+static void test_aho(void) {
+        static const char * const patterns[] = { "foo" };
+        _c_cleanup_(c_aho_freep) CAho *aho = NULL;
+        int r;
+
+        r = c_aho_new(&aho, patterns, C_ARRAY_SIZE(patterns));
+        assert(!r);
+        r = c_aho_search(aho, "bar", 3, test_aho_fn, NULL);
+        assert(!r);
+        r = c_aho_search_str(aho, "bar", test_aho_fn, NULL);
+        assert(!r);
+}
+
+static void test_hash(void) {
+        static const unsigned char key[C_HASH_SIP_KEY_SIZE] = {};
+        CHashFast fast;
+        CHashSip sip;
+
+        c_hash_sip_init(&sip, key);
+        c_hash_sip_update(&sip, "foo", 3);
+        assert(c_hash_sip_final(&sip) == c_hash_sip(key, "foo", 3));
+
+        c_hash_fast_init(&fast, 0);
+        c_hash_fast_update(&fast, "foo", 3);
+        assert(c_hash_fast_final(&fast) == c_hash_fast(0, "foo", 3));
+}
+
+static void test_intern(void) {
+        _c_cleanup_(c_intern_freep) CIntern *intern = NULL;
+        CInternStats stats;
+        const char *p;
+        int r;
+
+        r = c_intern_new(&intern);
+        assert(!r);
+        r = c_intern_string(intern, "foo", 3, &p);
+        assert(!r);
+        assert(c_intern_lookup(intern, "foo", 3) == p);
+        c_intern_get_stats(intern, &stats);
+}
+
+static void test_lines(void) {
+        _c_cleanup_(c_lines_freep) CLines *lines = NULL;
+        CStringView line;
+        int r, fd;
+
+        fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        assert(fd >= 0);
+
+        r = c_lines_new(&lines, fd, 0);
+        assert(!r);
+        r = c_lines_next(lines, &line);
+        assert(!r);
+        assert(!line.str);
+
+        lines = c_lines_free(lines);
+        close(fd);
+}
+
 static void test_ref_release(_Atomic unsigned long *ref, void *userdata) {
         assert(userdata == (void *)0xdeadbeefUL);
 
@@ -46,6 +115,13 @@ static void test_ref(void) {
         assert(ref == 16);
 }
 
+static void test_sort(void) {
+        char *strv[] = { "foo", NULL };
+
+        c_sort_strings(strv, C_ARRAY_SIZE(strv));
+        assert(!strv[0]);
+}
+
 static void test_string(void) {
         assert(!c_string_equal("foo", "bar"));
         assert(!c_string_prefix("foo", "bar"));
@@ -54,19 +130,32 @@ static void test_string(void) {
 static void test_syscall(void) {
         int (*f_clone) (unsigned long, void *) = c_syscall_clone;
         int (*f_memfd_create) (const char *, unsigned int) = c_syscall_memfd_create;
+        int (*f_getrandom) (void *, size_t, unsigned int) = c_syscall_getrandom;
         int r;
 
         /*
-         * Avoid running the clone, and memfd_create wrappers, since they might
-         * not be available on older kernels.
+         * Avoid running the clone, memfd_create, and getrandom wrappers, since
+         * they might not be available on older kernels.
          */
         assert(!!f_clone);
         assert(!!f_memfd_create);
+        assert(!!f_getrandom);
 
         r = c_syscall_gettid();
         assert(r >= 0);
 }
 
+static void test_trie(void) {
+        static const char * const prefixes[] = { "foo" };
+        _c_cleanup_(c_trie_freep) CTrie *trie = NULL;
+        size_t id;
+        int r;
+
+        r = c_trie_new(&trie, prefixes, C_ARRAY_SIZE(prefixes));
+        assert(!r);
+        assert(!c_trie_lookup(trie, "bar", &id));
+}
+
 static void test_usec(void) {
         uint64_t u_time;
 
@@ -79,9 +168,15 @@ static void test_usec(void) {
 }
 
 int main(int argc, char **argv) {
+        test_aho();
+        test_hash();
+        test_intern();
+        test_lines();
         test_ref();
+        test_sort();
         test_string();
         test_syscall();
+        test_trie();
         test_usec();
         return 0;
 }
@@ -0,0 +1,157 @@
+/*
+ * Tests for Hash Functions
+ * Bunch of tests for the hash function module. The expected values are fixed,
+ * since hashes must be stable across versions and machines.
+ */
+
+#include <stdlib.h>
+#include "c-hash.h"
+#include "c-macro.h"
+
+static const struct {
+        size_t n;
+        uint64_t sip;
+        uint64_t fast;
+} test_vectors[] = {
+        {  0, UINT64_C(0xabac0158050fc4dc), UINT64_C(0x16d3b0a07d2cea83) },
+        {  1, UINT64_C(0xc9f49bf37d57ca93), UINT64_C(0x1c5e594f9acc52f2) },
+        {  3, UINT64_C(0x8bf80ab8e7ddf7fb), UINT64_C(0xf7eeaec11b8d314f) },
+        {  4, UINT64_C(0xcf75576088d38328), UINT64_C(0x590acbddbfb67b04) },
+        {  7, UINT64_C(0xd3927d989bb11140), UINT64_C(0x030a082b2697a7be) },
+        {  8, UINT64_C(0x369095118d299a8e), UINT64_C(0x38fec632744d6228) },
+        { 15, UINT64_C(0xd320d86d2a519956), UINT64_C(0x906828b62bdf2a67) },
+        { 16, UINT64_C(0xcc4fdd1a7d908b66), UINT64_C(0xabf4d601a5868149) },
+        { 17, UINT64_C(0x9cf2689063dbd80c), UINT64_C(0x1711522a1b066519) },
+        { 47, UINT64_C(0x49fb169c8b5114fd), UINT64_C(0x6598fbbcce9bdda6) },
+        { 48, UINT64_C(0x9f3143f8df074c46), UINT64_C(0x1ceb7e9512f09cac) },
+        { 49, UINT64_C(0xc6fdaf2412cc86b3), UINT64_C(0xcc756b939489a1ed) },
+        { 63, UINT64_C(0x9d199062b7bbb3a8), UINT64_C(0x388e9a18ba3ff50c) },
+        { 64, UINT64_C(0xf17997ec4b4a6065), UINT64_C(0x6aaacbe9e8f0b027) },
+};
+
+static void test_init(unsigned char *key, unsigned char *msg, size_t n_msg) {
+        size_t i;
+
+        for (i = 0; i < C_HASH_SIP_KEY_SIZE; ++i)
+                key[i] = i;
+        for (i = 0; i < n_msg; ++i)
+                msg[i] = i;
+}
+
+static void test_sip24(void) {
+        static const uint64_t expected[] = {
+                UINT64_C(0x726fdb47dd0e0e31),
+                UINT64_C(0x74f839c593dc67fd),
+                UINT64_C(0x0d6c8009d9a94f5a),
+                UINT64_C(0x85676696d7fb7e2d),
+        };
+        unsigned char key[C_HASH_SIP_KEY_SIZE], msg[4];
+        CHashSip state;
+        size_t i;
+
+        /* verify the SipHash core against the reference vectors */
+        test_init(key, msg, sizeof(msg));
+
+        for (i = 0; i < C_ARRAY_SIZE(expected); ++i) {
+                c_internal_hash_sip_init(&state, key);
+                c_internal_hash_sip_update(&state, msg, i, 2);
+                assert(c_internal_hash_sip_final(&state, 2, 4) == expected[i]);
+        }
+}
+
+static void test_vectors_fixed(void) {
+        unsigned char key[C_HASH_SIP_KEY_SIZE], msg[64];
+        size_t i;
+
+        test_init(key, msg, sizeof(msg));
+
+        for (i = 0; i < C_ARRAY_SIZE(test_vectors); ++i) {
+                assert(c_hash_sip(key, msg, test_vectors[i].n) == test_vectors[i].sip);
+                assert(c_hash_fast(UINT64_C(0x0123456789abcdef), msg, test_vectors[i].n) == test_vectors[i].fast);
+        }
+}
+
+static void test_mum(void) {
+        uint64_t a1, b1, a2, b2;
+        size_t i;
+
+        srand(0x11);
+
+        for (i = 0; i < 4096; ++i) {
+                a1 = a2 = ((uint64_t)rand() << 40) ^ ((uint64_t)rand() << 20) ^ rand() ^ (i & 1 ? UINT64_MAX : 0);
+                b1 = b2 = ((uint64_t)rand() << 40) ^ ((uint64_t)rand() << 20) ^ rand() ^ (i & 2 ? UINT64_MAX : 0);
+
+                c_internal_hash_fast_mum(&a1, &b1);
+                c_internal_hash_fast_mum_portable(&a2, &b2);
+                assert(a1 == a2 && b1 == b2);
+        }
+}
+
+static void test_stream(void) {
+        unsigned char key[C_HASH_SIP_KEY_SIZE], msg[512];
+        CHashFast fast;
+        CHashSip sip;
+        size_t i, j, k, n;
+
+        test_init(key, msg, sizeof(msg));
+        srand(0x27);
+
+        /*
+         * Split messages of all lengths at random points, and verify the
+         * streaming API always yields the same result as the one-shot API.
+         */
+        for (n = 0; n < sizeof(msg); ++n) {
+                for (k = 0; k < 8; ++k) {
+                        c_hash_sip_init(&sip, key);
+                        c_hash_fast_init(&fast, n);
+
+                        for (i = 0; i < n; i += j) {
+                                j = rand() % (k < 4 ? 8 : 128);
+                                j = c_min(j, n - i);
+                                c_hash_sip_update(&sip, msg + i, j);
+                                c_hash_fast_update(&fast, msg + i, j);
+                        }
+
+                        assert(c_hash_sip_final(&sip) == c_hash_sip(key, msg, n));
+                        assert(c_hash_fast_final(&fast) == c_hash_fast(n, msg, n));
+                }
+        }
+}
+
+static void test_sensitivity(void) {
+        unsigned char key[C_HASH_SIP_KEY_SIZE], msg[96];
+        uint64_t sip, fast;
+        size_t i, j;
+
+        test_init(key, msg, sizeof(msg));
+
+        /* flipping any single input bit must change the hash */
+        sip = c_hash_sip(key, msg, sizeof(msg));
+        fast = c_hash_fast(0, msg, sizeof(msg));
+
+        for (i = 0; i < sizeof(msg); ++i) {
+                for (j = 0; j < 8; ++j) {
+                        msg[i] ^= 1 << j;
+                        assert(c_hash_sip(key, msg, sizeof(msg)) != sip);
+                        assert(c_hash_fast(0, msg, sizeof(msg)) != fast);
+                        msg[i] ^= 1 << j;
+                }
+        }
+
+        for (i = 0; i < sizeof(key); ++i) {
+                key[i] ^= 1;
+                assert(c_hash_sip(key, msg, sizeof(msg)) != sip);
+                key[i] ^= 1;
+        }
+
+        assert(c_hash_fast(1, msg, sizeof(msg)) != fast);
+}
+
+int main(int argc, char **argv) {
+        test_sip24();
+        test_vectors_fixed();
+        test_mum();
+        test_stream();
+        test_sensitivity();
+        return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * Tests for String Interning
+ * Bunch of tests for the string interning table, including concurrent use
+ * from multiple threads.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "c-intern.h"
+#include "c-macro.h"
+
+#define TEST_N_STRINGS 4096
+#define TEST_N_THREADS 8
+
+static void test_basic(void) {
+        _c_cleanup_(c_intern_freep) CIntern *intern = NULL;
+        const char *p1, *p2, *p3, *p4;
+        char buf[] = "foobar";
+        CInternStats stats;
+        int r;
+
+        r = c_intern_new(&intern);
+        assert(!r);
+
+        assert(!c_intern_lookup(intern, "foo", 3));
+
+        r = c_intern_string(intern, "foo", 3, &p1);
+        assert(!r);
+        assert(!strcmp(p1, "foo"));
+        assert(c_intern_lookup(intern, "foo", 3) == p1);
+
+        /* equal strings map to the same copy, regardless of their source */
+        r = c_intern_string(intern, buf, 3, &p2);
+        assert(!r);
+        assert(p1 == p2);
+        assert(p1 != buf);
+
+        r = c_intern_string(intern, "fo", 2, &p2);
+        assert(!r);
+        assert(p1 != p2);
+        assert(!strcmp(p2, "fo"));
+
+        /* embedded zero-bytes and the empty string are regular strings */
+        r = c_intern_string(intern, "fo\0o", 4, &p3);
+        assert(!r);
+        assert(p3 != p2 && p3 != p1);
+        assert(!memcmp(p3, "fo\0o", 5));
+
+        r = c_intern_string(intern, "", 0, &p4);
+        assert(!r);
+        assert(!*p4);
+        assert(c_intern_lookup(intern, "", 0) == p4);
+
+        c_intern_get_stats(intern, &stats);
+        assert(stats.n_entries == 4);
+        assert(stats.n_bytes >= stats.n_bytes_used);
+        assert(stats.n_bytes_used >= 4 * sizeof(CInternEntry) + 3 + 2 + 4 + 0 + 4);
+        assert(stats.n_probes >= stats.n_entries);
+        assert(stats.max_probes >= 1);
+}
+
+static void test_grow(void) {
+        _c_cleanup_(c_intern_freep) CIntern *intern = NULL;
+        static const char *strings[TEST_N_STRINGS];
+        char buf[32], big[256 * 1024];
+        CInternStats stats;
+        const char *p;
+        size_t i, n;
+        int r;
+
+        r = c_intern_new(&intern);
+        assert(!r);
+
+        for (i = 0; i < TEST_N_STRINGS; ++i) {
+                n = snprintf(buf, sizeof(buf), "string-%zu", i);
+                r = c_intern_string(intern, buf, n, &strings[i]);
+                assert(!r);
+                assert(!strcmp(strings[i], buf));
+        }
+
+        /* an oversized string must not lose the space left in the arena */
+        memset(big, 'x', sizeof(big));
+        r = c_intern_string(intern, big, sizeof(big), &p);
+        assert(!r);
+        assert(!memcmp(p, big, sizeof(big)) && !p[sizeof(big)]);
+
+        c_intern_get_stats(intern, &stats);
+        assert(stats.n_entries == TEST_N_STRINGS + 1);
+        assert(4 * stats.n_entries <= 3 * stats.n_slots);
+        assert(stats.n_bytes - stats.n_bytes_used < 2 * C_INTERNAL_INTERN_CHUNK_SIZE);
+
+        /* all entries survived the rehashing */
+        for (i = 0; i < TEST_N_STRINGS; ++i) {
+                n = snprintf(buf, sizeof(buf), "string-%zu", i);
+                assert(c_intern_lookup(intern, buf, n) == strings[i]);
+                r = c_intern_string(intern, buf, n, &p);
+                assert(!r);
+                assert(p == strings[i]);
+        }
+
+        c_intern_get_stats(intern, &stats);
+        assert(stats.n_entries == TEST_N_STRINGS + 1);
+}
+
+static void test_tables(void) {
+        _c_cleanup_(c_intern_freep) CIntern *intern1 = NULL, *intern2 = NULL;
+        const char *p1, *p2;
+        char buf[32];
+        size_t i, n;
+        int r;
+
+        /* every table has its own key, but they all behave the same */
+        r = c_intern_new(&intern1);
+        assert(!r);
+        r = c_intern_new(&intern2);
+        assert(!r);
+
+        for (i = 0; i < TEST_N_STRINGS; ++i) {
+                n = snprintf(buf, sizeof(buf), "interface-%zu", i);
+                r = c_intern_string(intern1, buf, n, &p1);
+                assert(!r);
+                r = c_intern_string(intern2, buf, n, &p2);
+                assert(!r);
+                assert(p1 != p2 && !strcmp(p1, buf) && !strcmp(p2, buf));
+        }
+
+        for (i = 0; i < TEST_N_STRINGS; ++i) {
+                n = snprintf(buf, sizeof(buf), "interface-%zu", i);
+                p1 = c_intern_lookup(intern1, buf, n);
+                p2 = c_intern_lookup(intern2, buf, n);
+                assert(p1 && p2 && p1 != p2);
+                assert(!strcmp(p1, buf) && !strcmp(p2, buf));
+                assert(!c_intern_lookup(intern1, buf, n + 1));
+        }
+}
+
+typedef struct TestThread {
+        pthread_t thread;
+        CIntern *intern;
+        size_t seed;
+        const char *strings[TEST_N_STRINGS];
+} TestThread;
+
+static void *test_thread_fn(void *userdata) {
+        TestThread *t = userdata;
+        const char *p;
+        char buf[32];
+        size_t i, j, n;
+        int r;
+
+        /* each thread interns all strings, in a different order */
+        for (i = 0; i < TEST_N_STRINGS; ++i) {
+                j = (i * 7 + t->seed * 1031) % TEST_N_STRINGS;
+                n = snprintf(buf, sizeof(buf), "member-%zu", j);
+
+                p = c_intern_lookup(t->intern, buf, n);
+                r = c_intern_string(t->intern, buf, n, &t->strings[j]);
+                assert(!r);
+                assert(!p || p == t->strings[j]);
+        }
+
+        return NULL;
+}
+
+static void test_threads(void) {
+        _c_cleanup_(c_intern_freep) CIntern *intern = NULL;
+        static TestThread threads[TEST_N_THREADS];
+        CInternStats stats;
+        size_t i, j;
+        int r;
+
+        r = c_intern_new(&intern);
+        assert(!r);
+
+        for (i = 0; i < TEST_N_THREADS; ++i) {
+                threads[i].intern = intern;
+                threads[i].seed = i;
+                r = pthread_create(&threads[i].thread, NULL, test_thread_fn, &threads[i]);
+                assert(!r);
+        }
+
+        for (i = 0; i < TEST_N_THREADS; ++i) {
+                r = pthread_join(threads[i].thread, NULL);
+                assert(!r);
+        }
+
+        for (i = 1; i < TEST_N_THREADS; ++i)
+                for (j = 0; j < TEST_N_STRINGS; ++j)
+                        assert(threads[i].strings[j] == threads[0].strings[j]);
+
+        c_intern_get_stats(intern, &stats);
+        assert(stats.n_entries == TEST_N_STRINGS);
+}
+
+int main(int argc, char **argv) {
+        test_basic();
+        test_grow();
+        test_tables();
+        test_threads();
+        return 0;
+}
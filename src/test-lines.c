@@ -0,0 +1,246 @@
+/*
+ * Tests for Line Reader
+ * Bunch of tests for the line reader, feeding it from regular files (which
+ * are mapped) and from pipes (which are read).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include "c-lines.h"
+#include "c-macro.h"
+#include "c-string.h"
+
+static int test_file(const char *data, size_t n) {
+        FILE *f;
+        int fd;
+
+        f = tmpfile();
+        assert(f);
+        assert(fwrite(data, 1, n, f) == n);
+        assert(!fflush(f));
+
+        fd = dup(fileno(f));
+        assert(fd >= 0);
+        fclose(f);
+
+        assert(lseek(fd, 0, SEEK_SET) == 0);
+        return fd;
+}
+
+static int test_pipe(const char *data, size_t n) {
+        int r, fds[2];
+        pid_t pid;
+
+        r = pipe(fds);
+        assert(!r);
+
+        pid = fork();
+        assert(pid >= 0);
+        if (!pid) {
+                close(fds[0]);
+                assert(write(fds[1], data, n) == (ssize_t)n);
+                _exit(0);
+        }
+
+        close(fds[1]);
+        return fds[0];
+}
+
+static void test_expect(int fd, unsigned int flags, const char * const *expected, size_t n_expected) {
+        _c_cleanup_(c_lines_freep) CLines *lines = NULL;
+        CStringView line;
+        size_t i;
+        int r;
+
+        r = c_lines_new(&lines, fd, flags);
+        assert(!r);
+
+        for (i = 0; i < n_expected; ++i) {
+                r = c_lines_next(lines, &line);
+                assert(!r);
+                assert(c_string_view_equal(line, c_string_view_from(expected[i])));
+        }
+
+        r = c_lines_next(lines, &line);
+        assert(!r);
+        assert(!line.str && !line.len);
+
+        /* the end is sticky */
+        r = c_lines_next(lines, &line);
+        assert(!r);
+        assert(!line.str);
+}
+
+static void test_basic(void) {
+        static const char data[] = "foo\n\nbar\r\nbaz";
+        static const char * const expected[] = { "foo", "", "bar\r", "baz" };
+        int fd;
+
+        fd = test_file(data, strlen(data));
+        test_expect(fd, 0, expected, C_ARRAY_SIZE(expected));
+        close(fd);
+
+        fd = test_pipe(data, strlen(data));
+        test_expect(fd, 0, expected, C_ARRAY_SIZE(expected));
+        close(fd);
+        wait(NULL);
+
+        /* a trailing newline does not start another line */
+        fd = test_file("foo\n", 4);
+        test_expect(fd, 0, (const char *[]){ "foo" }, 1);
+        close(fd);
+
+        fd = test_file("\n", 1);
+        test_expect(fd, 0, (const char *[]){ "" }, 1);
+        close(fd);
+
+        /* empty input yields no lines at all */
+        fd = test_file("", 0);
+        test_expect(fd, 0, NULL, 0);
+        close(fd);
+
+        fd = test_pipe("", 0);
+        test_expect(fd, 0, NULL, 0);
+        close(fd);
+        wait(NULL);
+
+        /* mapped files are read from the current position */
+        fd = test_file("foo\nbar\n", 8);
+        assert(lseek(fd, 4, SEEK_SET) == 4);
+        test_expect(fd, 0, (const char *[]){ "bar" }, 1);
+        close(fd);
+}
+
+static void test_utf8(void) {
+        static const char data[] = "f\xc3\xb6\xc3\xb6\nb\xe4r\nbaz\n";
+        _c_cleanup_(c_lines_freep) CLines *lines = NULL;
+        CStringView line;
+        int r, fd;
+
+        fd = test_file(data, strlen(data));
+
+        r = c_lines_new(&lines, fd, C_LINES_VERIFY_UTF8);
+        assert(!r);
+
+        r = c_lines_next(lines, &line);
+        assert(!r);
+        assert(c_string_view_equal(line, c_string_view_from("f\xc3\xb6\xc3\xb6")));
+
+        /* invalid lines are yielded anyway, and reading continues */
+        r = c_lines_next(lines, &line);
+        assert(r == -EILSEQ);
+        assert(c_string_view_equal(line, c_string_view_from("b\xe4r")));
+
+        r = c_lines_next(lines, &line);
+        assert(!r);
+        assert(c_string_view_equal(line, c_string_view_from("baz")));
+
+        r = c_lines_next(lines, &line);
+        assert(!r);
+        assert(!line.str);
+
+        close(fd);
+}
+
+static void test_utf8_blocks(void) {
+        _c_cleanup_(c_lines_freep) CLines *lines = NULL;
+        _c_cleanup_(c_freep) char *data = NULL;
+        size_t i, n = 3 * 3 * C_INTERNAL_LINES_VERIFY_SIZE;
+        CStringView line;
+        int r, fd;
+
+        /*
+         * Verification runs in blocks, which end in the middle of characters
+         * here, since lines are three bytes long. This must not fail any of
+         * the lines, while the single invalid line must still be detected.
+         */
+        data = malloc(n);
+        assert(data);
+        for (i = 0; i < n; i += 3)
+                memcpy(data + i, "\xc3\xb6\n", 3);
+        data[n / 2] = '\xff';
+
+        fd = test_file(data, n);
+
+        r = c_lines_new(&lines, fd, C_LINES_VERIFY_UTF8);
+        assert(!r);
+
+        for (i = 0; i < n; i += 3) {
+                r = c_lines_next(lines, &line);
+                assert(line.len == 2);
+                if (i == n / 2)
+                        assert(r == -EILSEQ);
+                else
+                        assert(!r);
+        }
+
+        r = c_lines_next(lines, &line);
+        assert(!r);
+        assert(!line.str);
+
+        close(fd);
+}
+
+static void test_long(void) {
+        _c_cleanup_(c_lines_freep) CLines *lines = NULL;
+        _c_cleanup_(c_freep) char *data = NULL;
+        size_t i, n_lines, n = 4 * C_INTERNAL_LINES_BUFFER_SIZE;
+        CStringView line;
+        int r, fd, k;
+
+        /*
+         * Mix lines of all lengths with a single line longer than the
+         * initial buffer, so the buffer has to move data and grow.
+         */
+        data = malloc(n);
+        assert(data);
+        for (i = 0, n_lines = 0; i < n; ++i) {
+                data[i] = 'a' + i % 26;
+                if (i % 97 == 0 && (i < n / 4 || i > n / 2)) {
+                        data[i] = '\n';
+                        ++n_lines;
+                }
+        }
+        data[n - 1] = '\n';
+        ++n_lines;
+
+        for (k = 0; k < 2; ++k) {
+                fd = k ? test_pipe(data, n) : test_file(data, n);
+
+                r = c_lines_new(&lines, fd, C_LINES_VERIFY_UTF8);
+                assert(!r);
+
+                for (i = 0; ; ) {
+                        r = c_lines_next(lines, &line);
+                        assert(!r);
+                        if (!line.str)
+                                break;
+
+                        assert(line.str[line.len] == '\n');
+                        assert(!memchr(line.str, '\n', line.len));
+                        i += line.len + 1;
+                        --n_lines;
+                }
+
+                assert(i == n);
+                assert(n_lines == 0);
+
+                lines = c_lines_free(lines);
+                close(fd);
+                if (k)
+                        wait(NULL);
+
+                /* count again for the next round */
+                for (i = 0; i < n; ++i)
+                        n_lines += data[i] == '\n';
+        }
+}
+
+int main(int argc, char **argv) {
+        test_basic();
+        test_utf8();
+        test_utf8_blocks();
+        test_long();
+        return 0;
+}
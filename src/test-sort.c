@@ -0,0 +1,161 @@
+/*
+ * Tests for String Sorting
+ * Bunch of tests for the string sorting module, comparing it against qsort()
+ * with c_string_compare().
+ */
+
+#include <stdlib.h>
+#include "c-macro.h"
+#include "c-sort.h"
+#include "c-string.h"
+
+static int test_compare(const void *a, const void *b) {
+        return c_string_compare(*(char * const *)a, *(char * const *)b);
+}
+
+static void test_sort_one(char **strv, size_t n) {
+        _c_cleanup_(c_freep) char **ref = NULL;
+        size_t i;
+
+        ref = malloc(n * sizeof(*ref) + 1);
+        assert(ref);
+        memcpy(ref, strv, n * sizeof(*ref));
+
+        qsort(ref, n, sizeof(*ref), test_compare);
+        c_sort_strings(strv, n);
+
+        for (i = 0; i < n; ++i)
+                assert(!c_string_compare(strv[i], ref[i]));
+
+        /* equal strings are ordered by address */
+        for (i = 1; i < n; ++i)
+                if (strv[i - 1] && !c_string_compare(strv[i - 1], strv[i]))
+                        assert((uintptr_t)strv[i - 1] <= (uintptr_t)strv[i]);
+}
+
+static void test_basic(void) {
+        char *strv[] = {
+                "foo", NULL, "", "foobar", "bar", NULL, "\xff", "foo", "fo", "",
+        };
+
+        c_sort_strings(NULL, 0);
+        test_sort_one(strv, C_ARRAY_SIZE(strv));
+
+        assert(!strv[0] && !strv[1]);
+        assert(!strcmp(strv[2], "") && !strcmp(strv[3], ""));
+        assert(!strcmp(strv[4], "bar"));
+        assert(!strcmp(strv[9], "\xff"));
+}
+
+static void test_random(void) {
+        static const char alphabet[] = "ab/\x80";
+        static char storage[4096][24];
+        static char *strv[4096];
+        size_t i, j, l, n;
+
+        /*
+         * Use a tiny alphabet and long shared prefixes, so there are plenty
+         * of duplicates and deep partitions.
+         */
+        srand(0);
+        for (n = 0; n <= C_ARRAY_SIZE(strv); n = n * 2 + 1) {
+                for (i = 0; i < n; ++i) {
+                        l = rand() % sizeof(storage[i]);
+                        for (j = 0; j < l; ++j)
+                                storage[i][j] = (j < 8) ? '/' : alphabet[rand() % (sizeof(alphabet) - 1)];
+                        storage[i][l] = 0;
+                        strv[i] = (rand() % 64) ? storage[i] : NULL;
+                }
+
+                test_sort_one(strv, n);
+        }
+
+        /* sorted and reversed input must not degrade */
+        for (i = 0; i < C_ARRAY_SIZE(strv); ++i)
+                snprintf(storage[i], sizeof(storage[i]), "/usr/lib/%08zu", i);
+        for (i = 0; i < C_ARRAY_SIZE(strv); ++i)
+                strv[i] = storage[i];
+        test_sort_one(strv, C_ARRAY_SIZE(strv));
+        for (i = 0; i < C_ARRAY_SIZE(strv); ++i)
+                strv[i] = storage[C_ARRAY_SIZE(strv) - i - 1];
+        test_sort_one(strv, C_ARRAY_SIZE(strv));
+}
+
+static void test_limit(void) {
+        static char storage[4096][16];
+        static char *strv[4096], *ref[4096];
+        static uint64_t keys[4096];
+        size_t i, n = C_ARRAY_SIZE(strv);
+
+        /* organ-pipe and sawtooth input, both are classic median-of-3 killers */
+        for (i = 0; i < n; ++i) {
+                snprintf(storage[i], sizeof(storage[i]), "%08zu", (i < n / 2) ? i : n - i);
+                strv[i] = storage[i];
+        }
+        test_sort_one(strv, n);
+        for (i = 0; i < n; ++i) {
+                snprintf(storage[i], sizeof(storage[i]), "%08zu", i % 61);
+                strv[i] = storage[i];
+        }
+        test_sort_one(strv, n);
+
+        /* an exhausted limit must finish with qsort(), with the same result */
+        srand(0);
+        for (i = 0; i < n; ++i) {
+                snprintf(storage[i], sizeof(storage[i]), "/%x", rand() % 1024);
+                strv[i] = storage[i];
+        }
+        memcpy(ref, strv, sizeof(ref));
+        c_sort_strings(ref, n);
+        c_internal_sort_load(strv, keys, n, 0);
+        c_internal_sort_mkqs(strv, keys, n, 0, 0);
+        assert(!memcmp(strv, ref, sizeof(ref)));
+}
+
+static void test_parallel(void) {
+        static const size_t n_threads[] = { 0, 1, 2, 3, 8 };
+        _c_cleanup_(c_freep) char *storage = NULL;
+        _c_cleanup_(c_freep) char **ref = NULL, **strv = NULL;
+        size_t i, j, k, n = 3 * C_INTERNAL_SORT_PARALLEL_MIN;
+        char *p;
+        int r;
+
+        storage = malloc(n * 16);
+        ref = malloc(n * sizeof(*ref));
+        strv = malloc(n * sizeof(*strv));
+        assert(storage && ref && strv);
+
+        /* few distinct values, so buckets are split in between duplicates */
+        srand(0);
+        for (i = 0; i < n; ++i) {
+                snprintf(storage + i * 16, 16, "/srv/%x", rand() % 4096);
+                ref[i] = (rand() % 64) ? storage + i * 16 : NULL;
+        }
+
+        memcpy(strv, ref, n * sizeof(*ref));
+        c_sort_strings(ref, n);
+
+        for (i = 0; i < C_ARRAY_SIZE(n_threads); ++i) {
+                for (j = n - 1; j > 0; --j) {
+                        k = rand() % (j + 1);
+                        p = strv[j];
+                        strv[j] = strv[k];
+                        strv[k] = p;
+                }
+
+                r = c_sort_strings_parallel(strv, n, n_threads[i]);
+                assert(!r);
+                assert(!memcmp(strv, ref, n * sizeof(*ref)));
+        }
+
+        r = c_sort_strings_parallel(NULL, 0, 4);
+        assert(!r);
+}
+
+int main(int argc, char **argv) {
+        test_basic();
+        test_random();
+        test_limit();
+        test_parallel();
+        return 0;
+}
@@ -2,6 +2,8 @@
  * Tests for string manipulation helpers
  */
 
+#include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include "c-macro.h"
 #include "c-string.h"
@@ -44,6 +46,587 @@ static void test_equal(void) {
         assert(!b);
 }
 
+static void test_lcp(void) {
+        size_t lcp;
+
+        assert(!c_string_compare_lcp(NULL, NULL, &lcp) && lcp == 0);
+        assert(c_string_compare_lcp(NULL, "", &lcp) < 0 && lcp == 0);
+        assert(c_string_compare_lcp("", NULL, &lcp) > 0 && lcp == 0);
+        assert(!c_string_compare_lcp("", "", &lcp) && lcp == 0);
+        assert(!c_string_compare_lcp("foo", "foo", &lcp) && lcp == 3);
+        assert(c_string_compare_lcp("foo", "foobar", &lcp) < 0 && lcp == 3);
+        assert(c_string_compare_lcp("foobar", "foo", &lcp) > 0 && lcp == 3);
+        assert(c_string_compare_lcp("/usr/lib", "/usr/bin", &lcp) > 0 && lcp == 5);
+        assert(c_string_compare_lcp("a\x80", "a\x7f", &lcp) > 0 && lcp == 1);
+}
+
+static void test_prefix_one(const char *str) {
+        _c_cleanup_(c_freep) char *dup = NULL;
+
+        /* heap copy, so ASAN catches reads beyond the terminator */
+        dup = strdup(str);
+        assert(dup);
+
+        assert(c_string_prefix(dup, "") == (c_string_prefix)(dup, ""));
+        assert(c_string_prefix(dup, "f") == (c_string_prefix)(dup, "f"));
+        assert(c_string_prefix(dup, "foo") == (c_string_prefix)(dup, "foo"));
+        assert(c_string_prefix(dup, "foobar") == (c_string_prefix)(dup, "foobar"));
+        assert(c_string_prefix(dup, "foo\0bar") == (c_string_prefix)(dup, "foo\0bar"));
+        assert(c_string_prefix(dup, "foobarfoobarfoob") == (c_string_prefix)(dup, "foobarfoobarfoob"));
+        assert(c_string_prefix(dup, "foobarfoobarfooba") == (c_string_prefix)(dup, "foobarfoobarfooba"));
+        assert(c_string_prefix(dup, "foobarfoobarfoobarfoobar") == (c_string_prefix)(dup, "foobarfoobarfoobarfoobar"));
+}
+
+static void test_prefix(void) {
+        const char *prefix = "foo";
+        const char *str = "foobar";
+
+        assert(c_string_prefix(str, "foo") == str + 3);
+        assert(c_string_prefix(str, prefix) == str + 3);
+        assert(c_string_prefix(str, "foo\0bar") == str + 3);
+        assert(c_string_prefix(str, "") == str);
+        assert(!c_string_prefix(str, "fob"));
+        assert(!c_string_prefix(str, "foobarx"));
+        assert((c_string_prefix)(str, "foo") == str + 3);
+
+        test_prefix_one("");
+        test_prefix_one("f");
+        test_prefix_one("fo");
+        test_prefix_one("foo");
+        test_prefix_one("fob");
+        test_prefix_one("foobar");
+        test_prefix_one("foobarfoobarfoob");
+        test_prefix_one("foobarfoobarfooba");
+        test_prefix_one("foobarfoobarfoobarfoobar");
+        test_prefix_one("foobarfoobarfoobarfoobax");
+}
+
+static void test_integer_one(uint64_t u) {
+        char buf[C_DECIMAL_MAX(uint64_t) + 1], ref[64];
+        int64_t i = (int64_t)u, i2;
+        uint64_t u2;
+        size_t n;
+        int r;
+
+        n = c_string_from_u64(buf, u);
+        snprintf(ref, sizeof(ref), "%" PRIu64, u);
+        assert(n == strlen(ref));
+        assert(!strcmp(buf, ref));
+
+        r = c_string_to_u64(buf, n, &u2);
+        assert(!r);
+        assert(u == u2);
+
+        n = c_string_from_i64(buf, i);
+        snprintf(ref, sizeof(ref), "%" PRIi64, i);
+        assert(n == strlen(ref));
+        assert(!strcmp(buf, ref));
+
+        r = c_string_to_i64(buf, n, &i2);
+        assert(!r);
+        assert(i == i2);
+}
+
+static void test_integer_parse(const char *str, int expected, uint64_t expected_u, int expected_i, int64_t expected_v) {
+        uint64_t u = 71;
+        int64_t i = 71;
+        int r;
+
+        r = c_string_to_u64(str, strlen(str), &u);
+        assert(r == expected);
+        assert(u == (r ? 71 : expected_u));
+
+        r = c_string_to_i64(str, strlen(str), &i);
+        assert(r == expected_i);
+        assert(i == (r ? 71 : expected_v));
+}
+
+static void test_integer(void) {
+        uint64_t v;
+        size_t i, j;
+
+        test_integer_one(0);
+        test_integer_one(UINT64_MAX);
+        test_integer_one(INT64_MAX);
+        test_integer_one((uint64_t)INT64_MIN);
+
+        /* all powers of 10, and their neighbors */
+        for (i = 0, v = 1; i < 20; ++i, v *= 10) {
+                test_integer_one(v - 1);
+                test_integer_one(v);
+                test_integer_one(v + 1);
+                test_integer_one(-v);
+        }
+
+        srand(0x16);
+        for (i = 0; i < 100000; ++i) {
+                v = ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ rand();
+                test_integer_one(v >> (rand() % 64));
+        }
+
+        test_integer_parse("", -EINVAL, 0, -EINVAL, 0);
+        test_integer_parse("-", -EINVAL, 0, -EINVAL, 0);
+        test_integer_parse("+1", -EINVAL, 0, -EINVAL, 0);
+        test_integer_parse(" 1", -EINVAL, 0, -EINVAL, 0);
+        test_integer_parse("1 ", -EINVAL, 0, -EINVAL, 0);
+        test_integer_parse("--1", -EINVAL, 0, -EINVAL, 0);
+        test_integer_parse("0x10", -EINVAL, 0, -EINVAL, 0);
+        test_integer_parse("0", 0, 0, 0, 0);
+        test_integer_parse("-0", -EINVAL, 0, 0, 0);
+        test_integer_parse("00000000000000000000000000000042", 0, 42, 0, 42);
+        test_integer_parse("18446744073709551615", 0, UINT64_MAX, -ERANGE, 0);
+        test_integer_parse("18446744073709551616", -ERANGE, 0, -ERANGE, 0);
+        test_integer_parse("99999999999999999999", -ERANGE, 0, -ERANGE, 0);
+        test_integer_parse("100000000000000000000", -ERANGE, 0, -ERANGE, 0);
+        test_integer_parse("10000000000000000000x", -EINVAL, 0, -EINVAL, 0);
+        test_integer_parse("9223372036854775807", 0, INT64_MAX, 0, INT64_MAX);
+        test_integer_parse("9223372036854775808", 0, (uint64_t)INT64_MAX + 1, -ERANGE, 0);
+        test_integer_parse("-9223372036854775808", -EINVAL, 0, 0, INT64_MIN);
+        test_integer_parse("-9223372036854775809", -EINVAL, 0, -ERANGE, 0);
+
+        /* invalid characters at every position of the vectorized runs */
+        for (i = 0; i < 19; ++i) {
+                for (j = 0; j < 4; ++j) {
+                        char buf[] = "1234567890123456789";
+
+                        buf[i] = "/:\x80\xb0"[j];
+                        test_integer_parse(buf, -EINVAL, 0, -EINVAL, 0);
+                }
+        }
+
+        /* embedded zero-bytes are invalid characters, too */
+        assert(c_string_to_u64("12\0" "4", 4, &v) == -EINVAL);
+}
+
+static void test_escape_span_compare(const char *str, size_t n, signed char limit) {
+        size_t ref;
+
+        ref = c_internal_string_escape_span_scalar(str, n, limit);
+#if C_INTERNAL_STRING_X86
+        assert(c_internal_string_escape_span_sse2(str, n, limit) == ref);
+        if (__builtin_cpu_supports("avx2"))
+                assert(c_internal_string_escape_span_avx2(str, n, limit) == ref);
+#endif
+        assert(c_internal_string_escape_span(str, n, limit) == ref);
+}
+
+static void test_escape_one(const char *str, size_t n, const char *c, const char *json, const char *shell) {
+        char buf[C_STRING_ESCAPE_JSON_MAX(64)], raw[64];
+        size_t l, l_raw;
+
+        assert(n <= sizeof(raw));
+
+        l = c_string_escape_c(str, n, NULL);
+        assert(l == strlen(c) && l <= C_STRING_ESCAPE_C_MAX(n));
+        assert(c_string_escape_c(str, n, buf) == l);
+        assert(!memcmp(buf, c, l));
+        assert(c_string_unescape_c(buf, l, NULL, &l_raw) && l_raw == n);
+        assert(c_string_unescape_c(buf, l, buf, &l_raw) && l_raw == n);
+        assert(!memcmp(buf, str, n));
+
+        if (json) {
+                assert(c_string_escape_json(str, n, NULL, &l));
+                assert(l == strlen(json) && l <= C_STRING_ESCAPE_JSON_MAX(n));
+                assert(c_string_escape_json(str, n, buf, &l) && l == strlen(json));
+                assert(!memcmp(buf, json, l));
+                assert(c_string_unescape_json(buf, l, NULL, &l_raw) && l_raw == n);
+                assert(c_string_unescape_json(buf, l, raw, &l_raw) && l_raw == n);
+                assert(!memcmp(raw, str, n));
+        } else {
+                assert(!c_string_escape_json(str, n, NULL, &l));
+        }
+
+        l = c_string_escape_shell(str, n, NULL);
+        assert(l == strlen(shell) && l <= C_STRING_ESCAPE_SHELL_MAX(n));
+        assert(c_string_escape_shell(str, n, buf) == l);
+        assert(!memcmp(buf, shell, l));
+        assert(c_string_unescape_shell(buf, l, NULL, &l_raw) && l_raw == n);
+        assert(c_string_unescape_shell(buf, l, buf, &l_raw) && l_raw == n);
+        assert(!memcmp(buf, str, n));
+}
+
+static void test_unescape_one(bool (*fn)(const char *, size_t, char *, size_t *), const char *str, const char *expected) {
+        char buf[64];
+        size_t l;
+
+        if (expected) {
+                assert(fn(str, strlen(str), buf, &l));
+                assert(l == strlen(expected) && !memcmp(buf, expected, l));
+        } else {
+                assert(!fn(str, strlen(str), buf, &l));
+        }
+}
+
+static void test_escape(void) {
+        char buf[256], esc[C_STRING_ESCAPE_C_MAX(256)], raw[256];
+        size_t i, j, l, l_raw;
+
+        test_escape_one("", 0, "", "", "''");
+        test_escape_one("foobar", 6, "foobar", "foobar", "foobar");
+        test_escape_one("a\"b\\c", 5, "a\\\"b\\\\c", "a\\\"b\\\\c", "'a\"b\\c'");
+        test_escape_one("\a\b\t\n\v\f\r", 7, "\\a\\b\\t\\n\\v\\f\\r", "\\u0007\\b\\t\\n\\u000b\\f\\r", "'\a\b\t\n\v\f\r'");
+        test_escape_one("\x01\x1f\x7f", 3, "\\001\\037\\177", "\\u0001\\u001f\x7f", "'\x01\x1f\x7f'");
+        test_escape_one("\xc3\xa4", 2, "\\303\\244", "\xc3\xa4", "'\xc3\xa4'");
+        test_escape_one("\xc3", 1, "\\303", NULL, "'\xc3'");
+        test_escape_one("it's", 4, "it's", "it's", "'it'\\''s'");
+        test_escape_one("a b", 3, "a b", "a b", "'a b'");
+        test_escape_one("/usr/bin:-x=1,%@+", 17, "/usr/bin:-x=1,%@+", "/usr/bin:-x=1,%@+", "/usr/bin:-x=1,%@+");
+
+        test_unescape_one(c_string_unescape_c, "\\x41\\x4a\\101\\?\\'", "AJA?'");
+        test_unescape_one(c_string_unescape_c, "\\1234", "S4");
+        test_unescape_one(c_string_unescape_c, "\\", NULL);
+        test_unescape_one(c_string_unescape_c, "\\x4", NULL);
+        test_unescape_one(c_string_unescape_c, "\\xg0", NULL);
+        test_unescape_one(c_string_unescape_c, "\\400", NULL);
+        test_unescape_one(c_string_unescape_c, "\\q", NULL);
+
+        test_unescape_one(c_string_unescape_json, "\\/\\u00e4\\u20AC", "/\xc3\xa4\xe2\x82\xac");
+        test_unescape_one(c_string_unescape_json, "\\ud83d\\ude00", "\xf0\x9f\x98\x80");
+        test_unescape_one(c_string_unescape_json, "\\ud83d", NULL);
+        test_unescape_one(c_string_unescape_json, "\\ud83dx", NULL);
+        test_unescape_one(c_string_unescape_json, "\\ud83d\\u0041", NULL);
+        test_unescape_one(c_string_unescape_json, "\\ude00", NULL);
+        test_unescape_one(c_string_unescape_json, "\\u12", NULL);
+        test_unescape_one(c_string_unescape_json, "\\a", NULL);
+        test_unescape_one(c_string_unescape_json, "\"", NULL);
+        test_unescape_one(c_string_unescape_json, "\n", NULL);
+        test_unescape_one(c_string_unescape_json, "\xc3", NULL);
+        test_unescape_one(c_string_unescape_json, "\xed\xa0\x80", NULL);
+
+        test_unescape_one(c_string_unescape_shell, "a'b c'\"d\\\"\\$\\x\"\\ e\\\nf", "ab cd\"$\\x ef");
+        test_unescape_one(c_string_unescape_shell, "\"a\\\nb\"", "ab");
+        test_unescape_one(c_string_unescape_shell, "a b", NULL);
+        test_unescape_one(c_string_unescape_shell, "a;b", NULL);
+        test_unescape_one(c_string_unescape_shell, "$HOME", NULL);
+        test_unescape_one(c_string_unescape_shell, "\"$HOME\"", NULL);
+        test_unescape_one(c_string_unescape_shell, "\"`ls`\"", NULL);
+        test_unescape_one(c_string_unescape_shell, "'a", NULL);
+        test_unescape_one(c_string_unescape_shell, "\"a", NULL);
+        test_unescape_one(c_string_unescape_shell, "a\\", NULL);
+        test_unescape_one(c_string_unescape_shell, "*", NULL);
+
+        /* round-trip all byte values at every offset */
+        for (i = 0; i < sizeof(buf); ++i)
+                buf[i] = i * 7;
+
+        for (i = 0; i < 64; ++i) {
+                l = c_string_escape_c(buf + i, sizeof(buf) - i, esc);
+                assert(c_string_unescape_c(esc, l, raw, &l_raw));
+                assert(l_raw == sizeof(buf) - i && !memcmp(raw, buf + i, l_raw));
+
+                l = c_string_escape_shell(buf + i, sizeof(buf) - i, esc);
+                assert(c_string_unescape_shell(esc, l, raw, &l_raw));
+                assert(l_raw == sizeof(buf) - i && !memcmp(raw, buf + i, l_raw));
+        }
+
+        for (i = 0; i < 128; ++i)
+                buf[i] = i;
+
+        assert(c_string_escape_json(buf, 128, esc, &l));
+        assert(c_string_unescape_json(esc, l, esc, &l_raw));
+        assert(l_raw == 128 && !memcmp(esc, buf, l_raw));
+
+        /* verify all accelerated scanners against the reference */
+        for (i = 0; i < sizeof(buf); ++i)
+                buf[i] = 'a' + i % 26;
+
+        for (i = 0; i < 80; ++i) {
+                for (j = 0; j < 256; ++j) {
+                        buf[i] = j;
+                        test_escape_span_compare(buf, 80, C_INTERNAL_STRING_ESCAPE_C);
+                        test_escape_span_compare(buf, 80, C_INTERNAL_STRING_ESCAPE_JSON);
+                        test_escape_span_compare(buf + 1, 79, C_INTERNAL_STRING_ESCAPE_JSON);
+                }
+                buf[i] = 'a' + i % 26;
+        }
+}
+
+static void test_uri_one(const char *str, const char *safe, unsigned int flags, const char *expected) {
+        char buf[C_STRING_ESCAPE_URI_MAX(64)], raw[64];
+        size_t l, l_raw, n = strlen(str);
+
+        l = c_string_escape_uri(str, n, NULL, safe, flags);
+        assert(l == strlen(expected) && l <= C_STRING_ESCAPE_URI_MAX(n));
+        assert(c_string_escape_uri(str, n, buf, safe, flags) == l);
+        assert(!memcmp(buf, expected, l));
+
+        assert(c_string_unescape_uri(buf, l, NULL, &l_raw, NULL, flags) && l_raw == n);
+        assert(c_string_unescape_uri(buf, l, raw, &l_raw, NULL, flags) && l_raw == n);
+        assert(!memcmp(raw, str, n));
+        assert(c_string_unescape_uri(buf, l, buf, &l_raw, NULL, flags) && l_raw == n);
+        assert(!memcmp(buf, str, n));
+}
+
+static void test_unescape_uri_one(const char *str, unsigned int flags, const char *expected, size_t offset) {
+        size_t l, o = -1;
+        char buf[64];
+
+        if (expected) {
+                assert(c_string_unescape_uri(str, strlen(str), buf, &l, &o, flags));
+                assert(l == strlen(expected) && !memcmp(buf, expected, l));
+                assert(o == (size_t)-1);
+        } else {
+                assert(!c_string_unescape_uri(str, strlen(str), buf, &l, &o, flags));
+                assert(o == offset);
+                assert(!c_string_unescape_uri(str, strlen(str), NULL, &l, NULL, flags));
+        }
+}
+
+static void test_uri(void) {
+        char buf[256], esc[C_STRING_ESCAPE_URI_MAX(256)], raw[256];
+        size_t i, j, l, l_raw;
+
+        test_uri_one("", NULL, 0, "");
+        test_uri_one("AZaz09-._~", NULL, 0, "AZaz09-._~");
+        test_uri_one("a b+c%d/e", NULL, 0, "a%20b%2Bc%25d%2Fe");
+        test_uri_one("a b+c%d/e", "/+%", 0, "a%20b+c%25d/e");
+        test_uri_one("a b+c%d/e", "/+ ", C_STRING_URI_FORM, "a+b%2Bc%25d/e");
+        test_uri_one("\xc3\xa4\x7f\x01", NULL, 0, "%C3%A4%7F%01");
+        test_uri_one("/usr/lib/x86_64-linux-gnu/libc.so.6", "/", 0, "/usr/lib/x86_64-linux-gnu/libc.so.6");
+
+        test_unescape_uri_one("%c3%A4+", 0, "\xc3\xa4+", 0);
+        test_unescape_uri_one("%c3%A4+", C_STRING_URI_FORM, "\xc3\xa4 ", 0);
+        test_unescape_uri_one("a b/?&", 0, "a b/?&", 0);
+        test_unescape_uri_one("%", 0, NULL, 0);
+        test_unescape_uri_one("ab%4", 0, NULL, 2);
+        test_unescape_uri_one("ab%41%4g", 0, NULL, 5);
+        test_unescape_uri_one("%%41", 0, NULL, 0);
+        test_unescape_uri_one("abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz%\xc1" "1", 0, NULL, 52);
+
+        /* round-trip all byte values at every offset, in every mode */
+        for (i = 0; i < sizeof(buf); ++i)
+                buf[i] = i * 7;
+
+        for (i = 0; i < 64; ++i) {
+                for (j = 0; j < 2; ++j) {
+                        l = c_string_escape_uri(buf + i, sizeof(buf) - i, esc, j ? "!$&'()*+,;=/" : NULL, j);
+                        assert(l == c_string_escape_uri(buf + i, sizeof(buf) - i, NULL, j ? "!$&'()*+,;=/" : NULL, j));
+                        assert(c_string_unescape_uri(esc, l, raw, &l_raw, NULL, j));
+                        assert(l_raw == sizeof(buf) - i && !memcmp(raw, buf + i, l_raw));
+                }
+        }
+
+        /* exactly the unreserved characters are copied unmodified */
+        for (i = 0; i < 256; ++i) {
+                buf[0] = i;
+                l = c_string_escape_uri(buf, 1, esc, NULL, 0);
+                assert(l == 3U - 2U * ((i >= 'a' && i <= 'z') ||
+                                     (i >= 'A' && i <= 'Z') ||
+                                     (i >= '0' && i <= '9') ||
+                                     (i && strchr("-._~", i))));
+        }
+}
+
+static void test_buf(void) {
+        _c_cleanup_(c_string_buf_deinitp) CStringBuf buf = C_STRING_BUF_INIT;
+        _c_cleanup_(c_freep) char *str = NULL;
+        char big[3 * C_STRING_BUF_SMALL];
+        const char *small;
+        size_t i, len;
+        int r;
+
+        /* a fresh buffer holds the empty string */
+        assert(!strcmp(c_string_buf_str(&buf), ""));
+        assert(c_string_buf_len(&buf) == 0);
+
+        /* short strings stay inline */
+        r = c_string_buf_append_str(&buf, "foo");
+        assert(!r);
+        r = c_string_buf_append_char(&buf, ':');
+        assert(!r);
+        r = c_string_buf_append_hex(&buf, "\x01\xab", 2);
+        assert(!r);
+        r = c_string_buf_append(&buf, "\0x", 2);
+        assert(!r);
+        assert(c_string_buf_len(&buf) == 10);
+        assert(!memcmp(c_string_buf_str(&buf), "foo:01ab\0x", 11));
+        assert(c_string_buf_str(&buf) == buf.small);
+
+        c_string_buf_clear(&buf);
+        r = c_string_buf_append_u64(&buf, 0);
+        assert(!r);
+        r = c_string_buf_append_char(&buf, ' ');
+        assert(!r);
+        r = c_string_buf_append_u64(&buf, UINT64_MAX);
+        assert(!r);
+        r = c_string_buf_append_char(&buf, ' ');
+        assert(!r);
+        r = c_string_buf_append_i64(&buf, INT64_MIN);
+        assert(!r);
+        r = c_string_buf_append_char(&buf, ' ');
+        assert(!r);
+        r = c_string_buf_append_i64(&buf, -7);
+        assert(!r);
+        r = c_string_buf_append_printf(&buf, " %s=%d", "x", 71);
+        assert(!r);
+        assert(!strcmp(c_string_buf_str(&buf), "0 18446744073709551615 -9223372036854775808 -7 x=71"));
+
+        /* stealing an inline string copies it, and resets the buffer */
+        small = c_string_buf_str(&buf);
+        str = c_string_buf_steal(&buf, &len);
+        assert(str && str != small);
+        assert(len == strlen(str));
+        assert(!strcmp(str, "0 18446744073709551615 -9223372036854775808 -7 x=71"));
+        assert(!c_string_buf_len(&buf) && !buf.heap);
+        str = c_free(str);
+
+        /* long strings move to the heap and grow geometrically */
+        memset(big, 'x', sizeof(big));
+        for (i = 0; i < 64; ++i) {
+                r = c_string_buf_append(&buf, big, sizeof(big));
+                assert(!r);
+                assert(c_string_buf_len(&buf) == (i + 1) * sizeof(big));
+                assert(!c_string_buf_str(&buf)[c_string_buf_len(&buf)]);
+        }
+        assert(buf.heap);
+        assert(buf.size < 4 * c_string_buf_len(&buf));
+
+        /* printf output larger than the free space is formatted twice */
+        c_string_buf_clear(&buf);
+        r = c_string_buf_append_str(&buf, "a");
+        assert(!r);
+        len = 2 * buf.size;
+        r = c_string_buf_append_printf(&buf, "%*s", (int)len, "b");
+        assert(!r);
+        assert(c_string_buf_len(&buf) == 1 + len);
+        assert(c_string_buf_str(&buf)[0] == 'a');
+        assert(c_string_buf_str(&buf)[c_string_buf_len(&buf) - 1] == 'b');
+        assert(strlen(c_string_buf_str(&buf)) == c_string_buf_len(&buf));
+
+        /* stealing a heap string hands it over */
+        small = c_string_buf_str(&buf);
+        str = c_string_buf_steal(&buf, NULL);
+        assert(str == small);
+}
+
+static void test_view(void) {
+        CStringView v, head, tail;
+        const char *str = "foo:bar\0baz";
+
+        /* compare and equal behave like their zero-terminated counterparts */
+        assert(c_string_view_compare(C_STRING_VIEW_NULL, C_STRING_VIEW_NULL) == 0);
+        assert(c_string_view_compare(c_string_view_from(""), C_STRING_VIEW_NULL) > 0);
+        assert(c_string_view_compare(C_STRING_VIEW_NULL, c_string_view_from("")) < 0);
+        assert(c_string_view_compare(c_string_view_from("a"), c_string_view_from("a")) == 0);
+        assert(c_string_view_compare(c_string_view_from("a"), c_string_view_from("b")) < 0);
+        assert(c_string_view_compare(c_string_view_from("a"), c_string_view_from("ab")) < 0);
+        assert(c_string_view_compare(c_string_view_from("b"), c_string_view_from("ab")) > 0);
+        assert(c_string_view_compare(c_string_view_from("\xff"), c_string_view_from("a")) > 0);
+        assert(c_string_view_compare(c_string_view(str, 11), c_string_view(str, 7)) > 0);
+
+        assert(c_string_view_equal(C_STRING_VIEW_NULL, C_STRING_VIEW_NULL));
+        assert(!c_string_view_equal(c_string_view_from(""), C_STRING_VIEW_NULL));
+        assert(!c_string_view_equal(C_STRING_VIEW_NULL, c_string_view_from("")));
+        assert(c_string_view_equal(c_string_view_from("a"), c_string_view(str + 5, 1)));
+        assert(!c_string_view_equal(c_string_view_from("a"), c_string_view_from("ab")));
+
+        /* prefix and suffix */
+        v = c_string_view_prefix(c_string_view(str, 11), c_string_view_from("foo:"));
+        assert(v.str == str + 4 && v.len == 7);
+        v = c_string_view_prefix(c_string_view(str, 3), c_string_view_from("foo:"));
+        assert(!v.str);
+        v = c_string_view_prefix(c_string_view(str, 11), c_string_view_from(""));
+        assert(v.str == str && v.len == 11);
+        v = c_string_view_prefix(c_string_view(str, 11), C_STRING_VIEW_NULL);
+        assert(!v.str);
+
+        v = c_string_view_suffix(c_string_view(str, 11), c_string_view_from("baz"));
+        assert(v.str == str && v.len == 8);
+        v = c_string_view_suffix(c_string_view(str, 11), c_string_view_from("bar"));
+        assert(!v.str);
+        v = c_string_view_suffix(c_string_view(str, 7), c_string_view_from("bar"));
+        assert(v.str == str && v.len == 4);
+
+        /* find */
+        v = c_string_view_find(c_string_view(str, 11), c_string_view_from("baz"));
+        assert(v.str == str + 8 && v.len == 3);
+        v = c_string_view_find(c_string_view(str, 10), c_string_view_from("baz"));
+        assert(!v.str);
+        v = c_string_view_find(c_string_view(str, 11), c_string_view(str + 7, 1));
+        assert(v.str == str + 7 && v.len == 4);
+
+        /* split */
+        assert(c_string_view_split(c_string_view(str, 11), c_string_view_from(":"), &head, &tail));
+        assert(head.str == str && head.len == 3);
+        assert(tail.str == str + 4 && tail.len == 7);
+        assert(c_string_view_split(tail, c_string_view("", 1), &head, &tail));
+        assert(c_string_view_equal(head, c_string_view_from("bar")));
+        assert(c_string_view_equal(tail, c_string_view_from("baz")));
+        assert(!c_string_view_split(tail, c_string_view_from(":"), &head, &tail));
+        assert(c_string_view_equal(head, c_string_view_from("baz")));
+        assert(!tail.str);
+}
+
+static void test_split_one(const char *str, const char *delimiters, unsigned int flags, const char * const *expected, size_t n_expected) {
+        CStringSplit split;
+        CStringView token;
+        size_t i = 0;
+
+        split = c_string_split(str, strlen(str), delimiters, flags);
+        while (c_string_split_next(&split, &token)) {
+                assert(i < n_expected);
+                assert(c_string_view_equal(token, c_string_view_from(expected[i])));
+                ++i;
+        }
+        assert(i == n_expected);
+        assert(!c_string_split_next(&split, &token));
+
+        i = 0;
+        c_string_split_for_each(token, str, strlen(str), delimiters, flags)
+                assert(c_string_view_equal(token, c_string_view_from(expected[i++])));
+        assert(i == n_expected);
+}
+
+static void test_split(void) {
+        char buf[256];
+        size_t i, j, k, n;
+        CStringView token;
+        CInternalStringByteset set = {};
+
+        test_split_one("", ":", 0, (const char *[]){ "" }, 1);
+        test_split_one("", ":", C_STRING_SPLIT_COALESCE, NULL, 0);
+        test_split_one("/usr/bin::/bin:", ":", 0, (const char *[]){ "/usr/bin", "", "/bin", "" }, 4);
+        test_split_one("/usr/bin::/bin:", ":", C_STRING_SPLIT_COALESCE, (const char *[]){ "/usr/bin", "/bin" }, 2);
+        test_split_one("  foo \t bar\n", " \t\n", C_STRING_SPLIT_COALESCE, (const char *[]){ "foo", "bar" }, 2);
+        test_split_one("a,b;c", ",;", 0, (const char *[]){ "a", "b", "c" }, 3);
+        test_split_one("a 'b c' \"d \\\" e\" f\\ g", " ", C_STRING_SPLIT_QUOTES,
+                       (const char *[]){ "a", "'b c'", "\"d \\\" e\"", "f\\ g" }, 4);
+        test_split_one("'a\\' b", " ", C_STRING_SPLIT_QUOTES, (const char *[]){ "'a\\'", "b" }, 2);
+        test_split_one("a 'b c", " ", C_STRING_SPLIT_QUOTES, (const char *[]){ "a", "'b c" }, 2);
+        test_split_one("a \"b\\", " ", C_STRING_SPLIT_QUOTES, (const char *[]){ "a", "\"b\\" }, 2);
+        test_split_one("a\\", " ", C_STRING_SPLIT_QUOTES, (const char *[]){ "a\\" }, 1);
+        test_split_one("a 'b' ", " ", C_STRING_SPLIT_QUOTES | C_STRING_SPLIT_COALESCE, (const char *[]){ "a", "'b'" }, 2);
+
+        /* splitting does not need a terminator */
+        n = 0;
+        c_string_split_for_each(token, "a:b:c", 3, ":", 0)
+                ++n;
+        assert(n == 2);
+
+        /* verify all accelerated scanners against the reference */
+        c_internal_string_byteset_add(&set, 0x00);
+        c_internal_string_byteset_add(&set, ':');
+        c_internal_string_byteset_add(&set, 0x7f);
+        c_internal_string_byteset_add(&set, 0x80);
+        c_internal_string_byteset_add(&set, 0xfe);
+
+        for (i = 0; i < 256; ++i) {
+                for (j = 0; j < 80; j += 3) {
+                        memset(buf, 'x', sizeof(buf));
+                        buf[j] = i;
+                        k = c_internal_string_byteset_find_scalar(&set, buf, 80);
+                        assert(k == (c_internal_string_byteset_contains(&set, i) ? j : 80));
+#if C_INTERNAL_STRING_X86
+                        if (__builtin_cpu_supports("ssse3"))
+                                assert(k == c_internal_string_byteset_find_ssse3(&set, buf, 80));
+                        if (__builtin_cpu_supports("avx2"))
+                                assert(k == c_internal_string_byteset_find_avx2(&set, buf, 80));
+#endif
+                        assert(k == c_internal_string_byteset_find(&set, buf, 80));
+                }
+        }
+}
+
 static void test_verify_from_hex(const char *hex) {
         _c_cleanup_(c_freep) char *raw = NULL, *copy = NULL;
         bool valid_hex1, valid_hex2;
@@ -80,6 +663,353 @@ static void test_hex(void) {
         test_verify_from_hex("\x01" "a");
 }
 
+/* verify all hex encoders against the reference */
+static void test_hex_backends(void) {
+        char buf[256], ref[2 * 256], hex[2 * 256 + 1];
+        size_t i, n;
+
+        for (i = 0; i < sizeof(buf); ++i)
+                buf[i] = i * 7;
+
+        for (n = 0; n <= sizeof(buf); ++n) {
+                c_internal_string_to_hex_scalar(buf + sizeof(buf) - n, n, ref, "0123456789abcdef");
+
+                for (i = 0; i < 2 * n; ++i)
+                        assert(strchr("0123456789abcdef", ref[i]));
+
+                memset(hex, 0, sizeof(hex));
+                c_string_to_hex(buf + sizeof(buf) - n, n, hex);
+                assert(!memcmp(hex, ref, 2 * n));
+                assert(!hex[2 * n]);
+
+#if C_INTERNAL_STRING_X86
+                if (__builtin_cpu_supports("ssse3")) {
+                        memset(hex, 0, sizeof(hex));
+                        c_internal_string_to_hex_ssse3(buf + sizeof(buf) - n, n, hex, "0123456789abcdef");
+                        assert(!memcmp(hex, ref, 2 * n));
+                        assert(!hex[2 * n]);
+                }
+
+                if (__builtin_cpu_supports("avx2")) {
+                        memset(hex, 0, sizeof(hex));
+                        c_internal_string_to_hex_avx2(buf + sizeof(buf) - n, n, hex, "0123456789abcdef");
+                        assert(!memcmp(hex, ref, 2 * n));
+                        assert(!hex[2 * n]);
+                }
+#endif
+
+                memset(hex, 0, sizeof(hex));
+                c_string_to_hex_upper(buf + sizeof(buf) - n, n, hex);
+                assert(!strncasecmp(hex, ref, 2 * n));
+                assert(!hex[2 * n]);
+                for (i = 0; i < 2 * n; ++i)
+                        assert(strchr("0123456789ABCDEF", hex[i]));
+        }
+}
+
+static void test_from_hex_compare(const char *hex, size_t n, size_t offset) {
+        char ref[256], str[256];
+        size_t o;
+        bool r;
+
+        assert(n <= sizeof(ref));
+
+        o = -1;
+        r = c_internal_string_from_hex_scalar(ref, n, hex, &o);
+        assert(r == (offset == (size_t)-1));
+        assert(o == offset);
+
+        o = -1;
+        r = c_string_from_hex_offset(str, n, hex, &o);
+        assert(r == (offset == (size_t)-1));
+        assert(o == offset);
+        assert(!r || !memcmp(str, ref, n));
+
+#if C_INTERNAL_STRING_X86
+        if (__builtin_cpu_supports("ssse3")) {
+                o = -1;
+                r = c_internal_string_from_hex_ssse3(str, n, hex, &o);
+                assert(r == (offset == (size_t)-1));
+                assert(o == offset);
+                assert(!r || !memcmp(str, ref, n));
+        }
+
+        if (__builtin_cpu_supports("avx2")) {
+                o = -1;
+                r = c_internal_string_from_hex_avx2(str, n, hex, &o);
+                assert(r == (offset == (size_t)-1));
+                assert(o == offset);
+                assert(!r || !memcmp(str, ref, n));
+        }
+#endif
+}
+
+/* verify all hex decoders against the reference */
+static void test_from_hex_backends(void) {
+        static const char alphabet[] = "0123456789abcdefABCDEF";
+        char hex[2 * 256 + 1], c;
+        size_t i, n;
+
+        for (i = 0; i < sizeof(hex) - 1; ++i)
+                hex[i] = alphabet[(i * 5) % (sizeof(alphabet) - 1)];
+        hex[i] = 0;
+
+        for (n = 0; n <= 256; ++n)
+                test_from_hex_compare(hex + 2 * (256 - n), n, -1);
+
+        /* every invalid character at every position */
+        for (i = 0; i < 2 * 80; ++i) {
+                for (c = -128; ; ++c) {
+                        if (!strchr(alphabet, c) || !c) {
+                                char saved = hex[i];
+
+                                hex[i] = c;
+                                test_from_hex_compare(hex, 80, i);
+                                test_from_hex_compare(hex, i / 2 + 1, i);
+                                test_from_hex_compare(hex, i / 2, -1);
+                                hex[i] = saved;
+                        }
+
+                        if (c == 127)
+                                break;
+                }
+        }
+}
+
+/* test separated hex, UUID and MAC en/de-coders */
+static void test_hex_sep(void) {
+        static const char uuid_str[] = "f81d4fae-7dec-11d0-a765-00a0c91e6bf6";
+        static const char uuid_raw[] = "\xf8\x1d\x4f\xae\x7d\xec\x11\xd0\xa7\x65\x00\xa0\xc9\x1e\x6b\xf6";
+        char buf[256], hex[3 * 256], raw[256], str[C_STRING_UUID_LEN];
+        size_t i, n, offset;
+
+        c_string_to_hex_sep("\x00\x1a\xff", 3, hex, ':');
+        assert(!memcmp(hex, "00:1a:ff", 8));
+        c_string_to_hex_sep_upper("\x00\x1a\xff", 3, hex, '-');
+        assert(!memcmp(hex, "00-1A-FF", 8));
+        assert(c_string_from_hex_sep(raw, 3, "00-1A-fF", '-', NULL));
+        assert(!memcmp(raw, "\x00\x1a\xff", 3));
+        assert(c_string_from_hex_sep(raw, 0, "", ':', NULL));
+
+        assert(!c_string_from_hex_sep(raw, 3, "00:1a-ff", ':', &offset) && offset == 5);
+        assert(!c_string_from_hex_sep(raw, 3, "00:1a:fg", ':', &offset) && offset == 7);
+        assert(!c_string_from_hex_sep(raw, 3, "0x:1a:ff", ':', &offset) && offset == 1);
+        assert(!c_string_from_hex_sep(raw, 3, "00::1a:f", ':', &offset) && offset == 3);
+        assert(!c_string_from_hex_sep(raw, 1, "\xb0" "0", ':', &offset) && offset == 0);
+
+        /* round-trip all byte values at every length */
+        for (i = 0; i < sizeof(buf); ++i)
+                buf[i] = i * 7;
+
+        for (n = 1; n <= sizeof(buf); ++n) {
+                c_string_to_hex_sep(buf + sizeof(buf) - n, n, hex, '.');
+                assert(c_string_from_hex_sep(raw, n, hex, '.', NULL));
+                assert(!memcmp(raw, buf + sizeof(buf) - n, n));
+                assert(!c_string_from_hex_sep(raw, n, hex, ':', NULL) == (n > 1));
+        }
+
+        c_string_to_uuid(uuid_raw, str);
+        assert(!memcmp(str, uuid_str, C_STRING_UUID_LEN));
+        assert(c_string_from_uuid(raw, uuid_str, C_STRING_UUID_LEN));
+        assert(!memcmp(raw, uuid_raw, 16));
+        assert(c_string_from_uuid(raw, "F81D4FAE-7DEC-11D0-A765-00A0C91E6BF6", C_STRING_UUID_LEN));
+        assert(!memcmp(raw, uuid_raw, 16));
+        assert(!c_string_from_uuid(raw, uuid_str, C_STRING_UUID_LEN - 1));
+        assert(!c_string_from_uuid(raw, "f81d4fae7dec11d0a76500a0c91e6bf6", 32));
+
+        /* a damaged character at any position is detected */
+        for (i = 0; i < C_STRING_UUID_LEN; ++i) {
+                memcpy(str, uuid_str, C_STRING_UUID_LEN);
+                str[i] = (str[i] == '-') ? '0' : '-';
+                assert(!c_string_from_uuid(raw, str, C_STRING_UUID_LEN));
+                str[i] = (char)0xe6;
+                assert(!c_string_from_uuid(raw, str, C_STRING_UUID_LEN));
+        }
+
+        c_string_to_mac("\x00\x1a\x2b\x3c\x4d\xff", str);
+        assert(!memcmp(str, "00:1a:2b:3c:4d:ff", C_STRING_MAC_LEN));
+        assert(c_string_from_mac(raw, "00:1A:2b:3c:4d:FF", C_STRING_MAC_LEN));
+        assert(!memcmp(raw, "\x00\x1a\x2b\x3c\x4d\xff", 6));
+        assert(c_string_from_mac(raw, "00-1a-2b-3c-4d-ff", C_STRING_MAC_LEN));
+        assert(!memcmp(raw, "\x00\x1a\x2b\x3c\x4d\xff", 6));
+        assert(!c_string_from_mac(raw, "00:1a-2b:3c:4d:ff", C_STRING_MAC_LEN));
+        assert(!c_string_from_mac(raw, "00.1a.2b.3c.4d.ff", C_STRING_MAC_LEN));
+        assert(!c_string_from_mac(raw, "00:1a:2b:3c:4d:f", C_STRING_MAC_LEN - 1));
+        assert(!c_string_from_mac(raw, "00:1a:2b:3c:4d:fx", C_STRING_MAC_LEN));
+}
+
+static void test_base64_one(const char *raw, const char *b64, unsigned int flags) {
+        char buf[64];
+        size_t n;
+        bool b;
+
+        n = c_string_to_base64(raw, strlen(raw), buf, flags);
+        assert(n == strlen(b64));
+        assert(n <= C_STRING_BASE64_MAX(strlen(raw)));
+        assert(!memcmp(buf, b64, n));
+
+        b = c_string_from_base64(buf, &n, b64, strlen(b64), flags);
+        assert(b);
+        assert(n == strlen(raw));
+        assert(n <= C_STRING_BASE64_DECODED_MAX(strlen(b64)));
+        assert(!memcmp(buf, raw, n));
+}
+
+static bool test_base64_decode(const char *b64, unsigned int flags) {
+        char buf[64];
+        size_t n;
+
+        return c_string_from_base64(buf, &n, b64, strlen(b64), flags);
+}
+
+/* test base64 en/de-coders */
+static void test_base64(void) {
+        /* RFC 4648 test vectors */
+        test_base64_one("", "", 0);
+        test_base64_one("f", "Zg==", 0);
+        test_base64_one("fo", "Zm8=", 0);
+        test_base64_one("foo", "Zm9v", 0);
+        test_base64_one("foob", "Zm9vYg==", 0);
+        test_base64_one("fooba", "Zm9vYmE=", 0);
+        test_base64_one("foobar", "Zm9vYmFy", 0);
+
+        test_base64_one("f", "Zg", C_STRING_BASE64_NOPAD);
+        test_base64_one("fo", "Zm8", C_STRING_BASE64_NOPAD);
+        test_base64_one("\xfb\xff", "+/8=", 0);
+        test_base64_one("\xfb\xff", "-_8=", C_STRING_BASE64_URL);
+        test_base64_one("\xfb\xff", "-_8", C_STRING_BASE64_URL | C_STRING_BASE64_NOPAD);
+
+        /* padding */
+        assert(!test_base64_decode("Zg", 0));
+        assert(!test_base64_decode("Zg=", 0));
+        assert(!test_base64_decode("Zg===", 0));
+        assert(!test_base64_decode("Zg==", C_STRING_BASE64_NOPAD));
+        assert(!test_base64_decode("Z===", 0));
+        assert(!test_base64_decode("Z", C_STRING_BASE64_NOPAD));
+        assert(!test_base64_decode("=", C_STRING_BASE64_LENIENT));
+        assert(!test_base64_decode("Zg==Zg==", 0));
+        assert(test_base64_decode("Zg", C_STRING_BASE64_LENIENT));
+        assert(test_base64_decode("Zg==", C_STRING_BASE64_LENIENT | C_STRING_BASE64_NOPAD));
+
+        /* alphabets */
+        assert(!test_base64_decode("-_8=", 0));
+        assert(!test_base64_decode("+/8=", C_STRING_BASE64_URL));
+
+        /* unused bits */
+        assert(!test_base64_decode("Zh==", 0));
+        assert(!test_base64_decode("Zm9=", 0));
+        assert(test_base64_decode("Zh==", C_STRING_BASE64_LENIENT));
+
+        /* whitespace */
+        assert(!test_base64_decode("Zm9v\nYmFy", 0));
+        assert(!test_base64_decode(" Zm9vYmFy", 0));
+        assert(test_base64_decode(" Zm9v\r\nYm\tFy\n", C_STRING_BASE64_LENIENT));
+        assert(test_base64_decode("Zg= =\n", C_STRING_BASE64_LENIENT));
+        assert(!test_base64_decode("Zm9v.YmFy", C_STRING_BASE64_LENIENT));
+}
+
+static void test_base64_backends_one(const char *raw, size_t n, unsigned int flags) {
+        char ref[512], b64[512], dec[384], wrapped[1024];
+        size_t n_ref, n_b64, n_dec, n_wrapped, i;
+        const CInternalStringBase64 *alphabet = c_internal_string_base64(flags);
+        bool b;
+
+        assert(n <= sizeof(dec));
+
+        n_ref = c_internal_string_to_base64_scalar(raw, n, ref, flags, alphabet);
+        assert(n_ref <= C_STRING_BASE64_MAX(n));
+
+        n_b64 = c_string_to_base64(raw, n, b64, flags);
+        assert(n_b64 == n_ref && !memcmp(b64, ref, n_ref));
+
+#if C_INTERNAL_STRING_X86
+        if (__builtin_cpu_supports("ssse3")) {
+                n_b64 = c_internal_string_to_base64_ssse3(raw, n, b64, alphabet);
+                n_b64 = n_b64 / 3 * 4 + c_internal_string_to_base64_scalar(raw + n_b64, n - n_b64, b64 + n_b64 / 3 * 4, flags, alphabet);
+                assert(n_b64 == n_ref && !memcmp(b64, ref, n_ref));
+
+                b = c_internal_string_from_base64(dec, &n_dec, ref, n_ref, flags, c_internal_string_from_base64_ssse3);
+                assert(b && n_dec == n && !memcmp(dec, raw, n));
+
+                /* the bulk decoder must accept all full blocks */
+                i = n_ref;
+                while (i && ref[i - 1] == '=')
+                        --i;
+                assert(c_internal_string_from_base64_ssse3(dec, ref, i, alphabet) == i / 16 * 16);
+        }
+
+        if (__builtin_cpu_supports("avx2")) {
+                n_b64 = c_internal_string_to_base64_avx2(raw, n, b64, alphabet);
+                n_b64 = n_b64 / 3 * 4 + c_internal_string_to_base64_scalar(raw + n_b64, n - n_b64, b64 + n_b64 / 3 * 4, flags, alphabet);
+                assert(n_b64 == n_ref && !memcmp(b64, ref, n_ref));
+
+                b = c_internal_string_from_base64(dec, &n_dec, ref, n_ref, flags, c_internal_string_from_base64_avx2);
+                assert(b && n_dec == n && !memcmp(dec, raw, n));
+
+                i = n_ref;
+                while (i && ref[i - 1] == '=')
+                        --i;
+                assert(c_internal_string_from_base64_avx2(dec, ref, i, alphabet) == i / 16 * 16);
+        }
+#endif
+
+        b = c_internal_string_from_base64(dec, &n_dec, ref, n_ref, flags, NULL);
+        assert(b && n_dec == n && !memcmp(dec, raw, n));
+
+        b = c_string_from_base64(dec, &n_dec, ref, n_ref, flags);
+        assert(b && n_dec == n && !memcmp(dec, raw, n));
+
+        /* wrap lines at 76 characters and decode leniently */
+        for (i = 0, n_wrapped = 0; i < n_ref; ++i) {
+                wrapped[n_wrapped++] = ref[i];
+                if (i % 76 == 75) {
+                        wrapped[n_wrapped++] = '\r';
+                        wrapped[n_wrapped++] = '\n';
+                }
+        }
+
+        b = c_string_from_base64(dec, &n_dec, wrapped, n_wrapped, flags | C_STRING_BASE64_LENIENT);
+        assert(b && n_dec == n && !memcmp(dec, raw, n));
+        if (n_wrapped != n_ref)
+                assert(!c_string_from_base64(dec, &n_dec, wrapped, n_wrapped, flags));
+
+        /* every invalid character must be caught by every decoder */
+        for (i = 0; i < n_ref; i += 7) {
+                char saved = ref[i];
+
+                ref[i] = '.';
+                assert(!c_internal_string_from_base64(dec, &n_dec, ref, n_ref, flags | C_STRING_BASE64_LENIENT, NULL));
+                assert(!c_string_from_base64(dec, &n_dec, ref, n_ref, flags | C_STRING_BASE64_LENIENT));
+                ref[i] = (flags & C_STRING_BASE64_URL) ? '/' : '_';
+                assert(!c_string_from_base64(dec, &n_dec, ref, n_ref, flags));
+                ref[i] = saved;
+        }
+}
+
+/* verify all base64 codecs against the reference */
+static void test_base64_backends(void) {
+        static const unsigned int flags[] = {
+                0,
+                C_STRING_BASE64_NOPAD,
+                C_STRING_BASE64_URL,
+                C_STRING_BASE64_URL | C_STRING_BASE64_NOPAD,
+        };
+        char raw[300];
+        size_t i, n;
+
+        srand(0xba5e64);
+        for (i = 0; i < sizeof(raw); ++i)
+                raw[i] = rand();
+
+        /* make sure all characters of the alphabets occur */
+        c_string_from_base64(raw, &n, c_internal_string_base64(0)->encode, 64, 0);
+        assert(n == 48);
+
+        for (i = 0; i < C_ARRAY_SIZE(flags); ++i)
+                for (n = 0; n <= sizeof(raw); ++n)
+                        test_base64_backends_one(raw, n, flags[i]);
+}
+
 static void test_ascii(void) {
         char str[0x100];
         char *p = str;
@@ -102,6 +1032,208 @@ static void test_ascii(void) {
         assert(len == sizeof(str) - 0x7F - 1);
 }
 
+static void test_ascii_compare(char *str, size_t len) {
+        char *p_ref = str, *p;
+        size_t n_ref = len, n;
+
+        c_internal_string_verify_ascii_scalar(&p_ref, &n_ref);
+        assert(p_ref + n_ref == str + len);
+
+        p = str;
+        n = len;
+        c_internal_string_verify_ascii_swar(&p, &n);
+        assert(p == p_ref && n == n_ref);
+
+#if C_INTERNAL_STRING_X86
+        p = str;
+        n = len;
+        c_internal_string_verify_ascii_sse2(&p, &n);
+        assert(p == p_ref && n == n_ref);
+
+        if (__builtin_cpu_supports("avx2")) {
+                p = str;
+                n = len;
+                c_internal_string_verify_ascii_avx2(&p, &n);
+                assert(p == p_ref && n == n_ref);
+        }
+#endif
+
+        p = str;
+        n = len;
+        c_string_verify_ascii(&p, &n);
+        assert(p == p_ref && n == n_ref);
+}
+
+/* verify all accelerated implementations against the reference */
+static void test_ascii_backends(void) {
+        static const unsigned char corruptions[] = { 0x00, 0x7f, 0x80, 0xc3, 0xff };
+        char buf[128];
+        size_t i, j, k;
+
+        for (i = 0; i < sizeof(buf); ++i)
+                buf[i] = 0x20 + i % 0x5f;
+
+        for (i = 0; i < sizeof(buf); ++i)
+                test_ascii_compare(buf + i, sizeof(buf) - i);
+
+        for (i = 0; i < sizeof(buf); ++i) {
+                for (j = 0; j < C_ARRAY_SIZE(corruptions); ++j) {
+                        k = buf[i];
+                        buf[i] = corruptions[j];
+
+                        test_ascii_compare(buf, sizeof(buf));
+                        test_ascii_compare(buf + 1, sizeof(buf) - 1);
+                        test_ascii_compare(buf, i);
+                        test_ascii_compare(buf, i + 1);
+
+                        buf[i] = k;
+                }
+        }
+}
+
+static int test_sign(int v) {
+        return (v > 0) - (v < 0);
+}
+
+static void test_ascii_ci(void) {
+        char str[] = "Hello World! 0123 @[`{ \xc3\x84";
+        char a[C_INTERNAL_STRING_CASECMP_HEAD + 3 * C_INTERNAL_STRING_CASECMP_BLOCK + 3], b[sizeof(a)];
+        size_t i, j;
+
+        assert(!c_string_compare_ascii_ci(NULL, NULL));
+        assert(c_string_compare_ascii_ci(NULL, "") < 0);
+        assert(c_string_compare_ascii_ci("", NULL) > 0);
+        assert(!c_string_compare_ascii_ci("", ""));
+        assert(!c_string_compare_ascii_ci("FooBar", "fOObAR"));
+        assert(c_string_compare_ascii_ci("foo", "FOOBAR") < 0);
+        assert(c_string_compare_ascii_ci("FOOBAR", "foo") > 0);
+        assert(c_string_compare_ascii_ci("a", "B") < 0);
+        assert(c_string_compare_ascii_ci("_", "a") < 0);
+        assert(c_string_compare_ascii_ci("_", "A") < 0);
+        assert(c_string_compare_ascii_ci("@", "`") < 0);
+        assert(c_string_compare_ascii_ci("\xc3\x84", "\xc3\xa4") < 0);
+
+        assert(c_string_equal_ascii_ci(NULL, NULL));
+        assert(!c_string_equal_ascii_ci(NULL, ""));
+        assert(!c_string_equal_ascii_ci("", NULL));
+        assert(c_string_equal_ascii_ci("FooBar", "fOObAR"));
+        assert(!c_string_equal_ascii_ci("foo", "FOOBAR"));
+        assert(!c_string_equal_ascii_ci("[", "{"));
+
+        /* strings spanning several blocks, differing in length or content anywhere */
+        for (i = 0; i < sizeof(a) - 1; ++i) {
+                for (j = 0; j < sizeof(a) - 1; ++j) {
+                        memset(a, 'x', i);
+                        a[i] = 0;
+                        memset(b, 'X', j);
+                        b[j] = 0;
+                        assert(test_sign(c_string_compare_ascii_ci(a, b)) == test_sign(strcasecmp(a, b)));
+                        assert(c_string_equal_ascii_ci(a, b) == (i == j));
+                }
+
+                memset(a, 'x', sizeof(a) - 1);
+                memset(b, 'X', sizeof(b) - 1);
+                a[sizeof(a) - 1] = 0;
+                b[sizeof(b) - 1] = 0;
+                b[i] = 'y';
+                assert(c_string_compare_ascii_ci(a, b) < 0);
+                assert(c_string_compare_ascii_ci(b, a) > 0);
+                assert(!c_string_equal_ascii_ci(a, b));
+        }
+
+        assert(!strcmp(c_string_prefix_ascii_ci("Content-Type: text", "content-type:"), " text"));
+        assert(!strcmp(c_string_prefix_ascii_ci("foo", ""), "foo"));
+        assert(!strcmp(c_string_prefix_ascii_ci("FOO", "foo"), ""));
+        assert(!c_string_prefix_ascii_ci("fo", "foo"));
+        assert(!c_string_prefix_ascii_ci("fox", "FOO"));
+
+        c_string_ascii_lower(str, strlen(str));
+        assert(!strcmp(str, "hello world! 0123 @[`{ \xc3\x84"));
+        c_string_ascii_upper(str, strlen(str));
+        assert(!strcmp(str, "HELLO WORLD! 0123 @[`{ \xc3\x84"));
+}
+
+static void test_ascii_ci_compare(const char *a, const char *b, size_t n) {
+        int r_ref;
+
+        r_ref = c_internal_string_casecmp_scalar(a, b, n);
+        assert(test_sign(r_ref) == test_sign(strncasecmp(a, b, n)) || memchr(a, 0, n) || memchr(b, 0, n));
+
+#if C_INTERNAL_STRING_X86
+        assert(c_internal_string_casecmp_sse2(a, b, n) == r_ref);
+        if (__builtin_cpu_supports("avx2"))
+                assert(c_internal_string_casecmp_avx2(a, b, n) == r_ref);
+#endif
+
+        assert(c_internal_string_casecmp(a, b, n) == r_ref);
+}
+
+static void test_ascii_case_compare(const char *str, size_t n) {
+        char ref[256], buf[256];
+
+        memcpy(ref, str, n);
+        memcpy(buf, str, n);
+        c_internal_string_case_scalar(ref, n, false);
+#if C_INTERNAL_STRING_X86
+        c_internal_string_case_sse2(buf, n, false);
+        assert(!memcmp(buf, ref, n));
+        if (__builtin_cpu_supports("avx2")) {
+                memcpy(buf, str, n);
+                c_internal_string_case_avx2(buf, n, false);
+                assert(!memcmp(buf, ref, n));
+        }
+#endif
+        memcpy(buf, str, n);
+        c_string_ascii_lower(buf, n);
+        assert(!memcmp(buf, ref, n));
+
+        memcpy(ref, str, n);
+        memcpy(buf, str, n);
+        c_internal_string_case_scalar(ref, n, true);
+#if C_INTERNAL_STRING_X86
+        c_internal_string_case_sse2(buf, n, true);
+        assert(!memcmp(buf, ref, n));
+        if (__builtin_cpu_supports("avx2")) {
+                memcpy(buf, str, n);
+                c_internal_string_case_avx2(buf, n, true);
+                assert(!memcmp(buf, ref, n));
+        }
+#endif
+        memcpy(buf, str, n);
+        c_string_ascii_upper(buf, n);
+        assert(!memcmp(buf, ref, n));
+}
+
+/* verify all accelerated implementations against the reference */
+static void test_ascii_ci_backends(void) {
+        char a[256], b[256];
+        size_t i, j;
+
+        /* every byte value, at every position of the vector */
+        for (i = 0; i < sizeof(a); ++i)
+                a[i] = i;
+        for (i = 0; i < 64; ++i)
+                test_ascii_case_compare(a + i, sizeof(a) - i);
+
+        for (i = 0; i < sizeof(a); ++i) {
+                a[i] = 'A' + i % 26;
+                b[i] = 'a' + i % 26;
+        }
+
+        for (i = 0; i <= 80; ++i)
+                test_ascii_ci_compare(a, b, i);
+
+        for (i = 0; i < 80; ++i) {
+                for (j = 0; j < 256; ++j) {
+                        b[i] = j;
+                        test_ascii_ci_compare(a, b, 80);
+                        test_ascii_ci_compare(b, a, 80);
+                        test_ascii_ci_compare(a + 1, b + 1, 79);
+                }
+                b[i] = 'a' + i % 26;
+        }
+}
+
 static void test_utf8(void) {
         /* verify a mix of greek, czech and chinese */
         {
@@ -223,11 +1355,458 @@ static void test_utf8(void) {
         }
 }
 
+static void test_utf8_count_compare(char *str, size_t len) {
+        CStringUtf8Stats ref = {}, stats;
+        char *p_ref = str, *p;
+        size_t n_ref = len, n;
+
+        c_internal_string_verify_utf8_scalar(&p_ref, &n_ref);
+        c_internal_string_utf8_stats_add(&ref, str, p_ref - str);
+
+        p = str;
+        n = len;
+        stats = (CStringUtf8Stats){};
+        c_internal_string_count_utf8_swar(&p, &n, &stats);
+        assert(p == p_ref && n == n_ref);
+        assert(!memcmp(&stats, &ref, sizeof(stats)));
+
+#if C_INTERNAL_STRING_X86
+        if (__builtin_cpu_supports("sse4.1")) {
+                p = str;
+                n = len;
+                stats = (CStringUtf8Stats){};
+                c_internal_string_count_utf8_sse41(&p, &n, &stats);
+                assert(p == p_ref && n == n_ref);
+                assert(!memcmp(&stats, &ref, sizeof(stats)));
+        }
+
+        if (__builtin_cpu_supports("avx2")) {
+                p = str;
+                n = len;
+                stats = (CStringUtf8Stats){};
+                c_internal_string_count_utf8_avx2(&p, &n, &stats);
+                assert(p == p_ref && n == n_ref);
+                assert(!memcmp(&stats, &ref, sizeof(stats)));
+        }
+#endif
+
+        p = str;
+        n = len;
+        c_string_verify_utf8_count(&p, &n, &stats);
+        assert(p == p_ref && n == n_ref);
+        assert(!memcmp(&stats, &ref, sizeof(stats)));
+}
+
+static void test_utf8_compare(char *str, size_t len) {
+        char *p_ref = str, *p;
+        size_t n_ref = len, n;
+
+        c_internal_string_verify_utf8_scalar(&p_ref, &n_ref);
+        assert(p_ref + n_ref == str + len);
+
+        p = str;
+        n = len;
+        c_internal_string_verify_utf8_swar(&p, &n);
+        assert(p == p_ref && n == n_ref);
+
+#if C_INTERNAL_STRING_X86
+        if (__builtin_cpu_supports("sse4.1")) {
+                p = str;
+                n = len;
+                c_internal_string_verify_utf8_sse41(&p, &n);
+                assert(p == p_ref && n == n_ref);
+        }
+
+        if (__builtin_cpu_supports("avx2")) {
+                p = str;
+                n = len;
+                c_internal_string_verify_utf8_avx2(&p, &n);
+                assert(p == p_ref && n == n_ref);
+        }
+#endif
+
+        p = str;
+        n = len;
+        c_string_verify_utf8(&p, &n);
+        assert(p == p_ref && n == n_ref);
+
+        test_utf8_count_compare(str, len);
+}
+
+/* verify all accelerated implementations against the reference */
+static void test_utf8_backends(void) {
+        static const char *fragments[] = {
+                "a", "Z", " ", "\n", "ß", "é", "€", "中", "\xef\xbf\xbf",
+                "\xf0\x90\x80\x80", "\xf4\x8f\xbf\xbf", "😀", "\xed\x9f\xbf",
+                "\xe0\xa0\x80", "\xc2\x80", "\xdf\xbf",
+        };
+        static const unsigned char corruptions[] = {
+                0x00, 'a', 0x80, 0x8f, 0x90, 0xa0, 0xbf, 0xc0, 0xc1, 0xc2,
+                0xdf, 0xe0, 0xed, 0xef, 0xf0, 0xf4, 0xf5, 0xf8, 0xff,
+        };
+        char buf[256], copy[256];
+        size_t i, j, n, l;
+
+        /* fill the buffer with valid characters of all sizes */
+        for (i = 0, n = 0; ; ++i) {
+                l = strlen(fragments[i % C_ARRAY_SIZE(fragments)]);
+                if (n + l > sizeof(buf))
+                        break;
+
+                memcpy(buf + n, fragments[i % C_ARRAY_SIZE(fragments)], l);
+                n += l;
+        }
+        memset(buf + n, 'a', sizeof(buf) - n);
+
+        test_utf8_compare(buf, sizeof(buf));
+        for (i = 0; i < sizeof(buf); ++i)
+                test_utf8_compare(buf + i, sizeof(buf) - i);
+
+        /* corrupt every single position with every interesting byte */
+        for (i = 0; i < sizeof(buf); ++i) {
+                for (j = 0; j < C_ARRAY_SIZE(corruptions); ++j) {
+                        memcpy(copy, buf, sizeof(buf));
+                        copy[i] = corruptions[j];
+
+                        test_utf8_compare(copy, sizeof(copy));
+                        test_utf8_compare(copy + 1, sizeof(copy) - 1);
+                        test_utf8_compare(copy, c_min(i + 3, sizeof(copy)));
+                }
+        }
+
+        /* random concatenations of valid and invalid fragments */
+        srand(0xc0ffee);
+        for (i = 0; i < 10000; ++i) {
+                for (n = 0; n + 4 <= sizeof(buf); ) {
+                        if (rand() % 64) {
+                                j = rand() % C_ARRAY_SIZE(fragments);
+                                l = strlen(fragments[j]);
+                                memcpy(buf + n, fragments[j], l);
+                                n += l;
+                        } else {
+                                buf[n++] = corruptions[rand() % C_ARRAY_SIZE(corruptions)];
+                        }
+                }
+
+                test_utf8_compare(buf, n);
+        }
+}
+
+static void test_utf8_count(void) {
+        CStringUtf8Stats stats;
+        char str[] = "Česko,\núředním názvem Česká republika\n中華民國十年\n😀";
+        char *p = str;
+        size_t n = sizeof(str) - 1;
+
+        c_string_verify_utf8_count(&p, &n, &stats);
+        assert(!n);
+        assert(stats.n_chars == 46);
+        assert(stats.n_lines == 3);
+        assert(stats.max_len == 4);
+
+        p = str;
+        n = 0;
+        c_string_verify_utf8_count(&p, &n, &stats);
+        assert(!stats.n_chars && !stats.n_lines && !stats.max_len);
+
+        p = str;
+        n = 2;
+        c_string_verify_utf8_count(&p, &n, &stats);
+        assert(stats.n_chars == 1 && !stats.n_lines && stats.max_len == 2);
+}
+
+static void test_utf8_stream_compare(char *str, size_t len, size_t step) {
+        CStringUtf8State state = C_STRING_UTF8_STATE_INIT;
+        char *p = str;
+        size_t i, n = len;
+        bool valid = true;
+
+        c_internal_string_verify_utf8_scalar(&p, &n);
+
+        for (i = 0; i < len && valid; i += step)
+                valid = c_string_verify_utf8_feed(&state, str + i, c_min(step, len - i));
+        valid = c_string_verify_utf8_finish(&state) && valid;
+
+        assert(valid == !n);
+        assert(state.n_valid == (size_t)(p - str));
+}
+
+/* verify incremental verification behaves like the one-shot variant */
+static void test_utf8_stream(void) {
+        static const char *fragments[] = {
+                "a", "ß", "€", "中", "😀", "\xf4\x8f\xbf\xbf", "\xed\x9f\xbf", "\xe0\xa0\x80",
+        };
+        static const unsigned char corruptions[] = {
+                0x00, 'a', 0x80, 0xa0, 0xbf, 0xc1, 0xc2, 0xe0, 0xed, 0xf0, 0xf4, 0xf5,
+        };
+        char buf[96], copy[96];
+        size_t i, j, k, n, l;
+
+        for (i = 0, n = 0; n + 4 <= sizeof(buf); ++i) {
+                l = strlen(fragments[i % C_ARRAY_SIZE(fragments)]);
+                memcpy(buf + n, fragments[i % C_ARRAY_SIZE(fragments)], l);
+                n += l;
+        }
+
+        for (k = 1; k <= 40; ++k)
+                test_utf8_stream_compare(buf, n, k);
+
+        for (i = 0; i < n; ++i) {
+                for (j = 0; j < C_ARRAY_SIZE(corruptions); ++j) {
+                        memcpy(copy, buf, n);
+                        copy[i] = corruptions[j];
+
+                        for (k = 1; k <= 5; ++k) {
+                                test_utf8_stream_compare(copy, n, k);
+                                test_utf8_stream_compare(copy, i + 1, k);
+                        }
+                        test_utf8_stream_compare(copy, n, 33);
+                }
+        }
+
+        /* chunks split in the middle of a character are fine */
+        {
+                CStringUtf8State state = C_STRING_UTF8_STATE_INIT;
+
+                assert(c_string_verify_utf8_feed(&state, "a\xf0", 2));
+                assert(state.n_valid == 1);
+                assert(c_string_verify_utf8_feed(&state, "\x9f", 1));
+                assert(c_string_verify_utf8_feed(&state, "", 0));
+                assert(c_string_verify_utf8_feed(&state, "\x98\x80" "b", 3));
+                assert(state.n_valid == 6);
+                assert(c_string_verify_utf8_finish(&state));
+        }
+
+        /* truncated streams fail */
+        {
+                CStringUtf8State state = C_STRING_UTF8_STATE_INIT;
+
+                assert(c_string_verify_utf8_feed(&state, "ab\xe2\x82", 4));
+                assert(!c_string_verify_utf8_finish(&state));
+                assert(state.n_valid == 2);
+                assert(!c_string_verify_utf8_feed(&state, "\xac", 1));
+        }
+}
+
+static void test_sanitize_one(const char *str, size_t n, const char *expected, size_t n_expected) {
+        char buf[C_STRING_UTF8_SANITIZED_MAX(64)];
+        size_t l;
+
+        assert(!c_string_sanitize_utf8(str, n, NULL, &l));
+        assert(l == n_expected && l <= C_STRING_UTF8_SANITIZED_MAX(n));
+        assert(!c_string_sanitize_utf8(str, n, buf, &l));
+        assert(l == n_expected && !memcmp(buf, expected, l));
+}
+
+static void test_sanitize(void) {
+        char str[512], buf[C_STRING_UTF8_SANITIZED_MAX(sizeof(str))];
+        size_t i, j, l, n;
+        char *p;
+
+        assert(c_string_sanitize_utf8("", 0, NULL, &l) && l == 0);
+        assert(c_string_sanitize_utf8("f\0o\xc3\xa4", 5, NULL, &l) && l == 5);
+
+        /* example of the Unicode Standard, Table 3-8 */
+        test_sanitize_one("\x61\xf1\x80\x80\xe1\x80\xc2\x62\x80\x63\x80\xbf\x64", 13,
+                          "\x61\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd\x62\xef\xbf\xbd\x63\xef\xbf\xbd\xef\xbf\xbd\x64", 22);
+        /* surrogates, overlong sequences and out-of-range code points */
+        test_sanitize_one("\xed\xa0\x80", 3, "\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd", 9);
+        test_sanitize_one("\xc0\xaf", 2, "\xef\xbf\xbd\xef\xbf\xbd", 6);
+        test_sanitize_one("\xe0\x80\xaf", 3, "\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd", 9);
+        test_sanitize_one("\xf4\x90\x80\x80", 4, "\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd", 12);
+        test_sanitize_one("\xff", 1, "\xef\xbf\xbd", 3);
+        /* truncated characters are replaced as a whole */
+        test_sanitize_one("a\xe2\x82", 3, "a\xef\xbf\xbd", 4);
+        test_sanitize_one("\xf0\x9f\x98\0", 4, "\xef\xbf\xbd\0", 4);
+        test_sanitize_one("\xf0\x9f\x98\xf0\x9f\x98\x80", 7, "\xef\xbf\xbd\xf0\x9f\x98\x80", 7);
+
+        /* random data always sanitizes to valid UTF-8, with long valid runs */
+        srand(0);
+        for (i = 0; i < 256; ++i) {
+                n = rand() % sizeof(str);
+                for (j = 0; j < n; ++j)
+                        str[j] = (rand() % 16) ? "a\xc3\xa4\xe2\x82\xac"[j % 6] : rand();
+
+                if (c_string_sanitize_utf8(str, n, buf, &l)) {
+                        assert(l == n);
+                        continue;
+                }
+
+                assert(l <= C_STRING_UTF8_SANITIZED_MAX(n));
+                assert(c_string_sanitize_utf8(buf, l, NULL, &j) && j == l);
+
+                p = buf;
+                for (j = 0; j < l; ++j)
+                        if (!buf[j])
+                                buf[j] = ' ';
+                c_string_verify_utf8(&p, &l);
+                assert(!l);
+        }
+}
+
+/* verify all code points survive a round-trip through all transcoders */
+static void test_transcode_roundtrip(void) {
+        _c_cleanup_(c_freep) uint32_t *cps = NULL, *cps2 = NULL;
+        _c_cleanup_(c_freep) uint16_t *u16 = NULL;
+        _c_cleanup_(c_freep) char *u8 = NULL, *u8b = NULL;
+        size_t i, n_cps = 0, n_u8, n_u16, n, n2;
+        bool b;
+
+        /* room for all code points plus the interleaved ASCII runs */
+        cps = calloc(2 * 0x110000, sizeof(*cps));
+        cps2 = calloc(2 * 0x110000, sizeof(*cps2));
+        u16 = calloc(2 * 2 * 0x110000, sizeof(*u16));
+        u8 = calloc(4 * 2, 0x110000);
+        u8b = calloc(4 * 2, 0x110000);
+        assert(cps && cps2 && u16 && u8 && u8b);
+
+        /* interleave ASCII runs to exercise the bulk copies */
+        for (i = 1; i < 0x110000; ++i) {
+                if (i >= 0xD800 && i <= 0xDFFF)
+                        continue;
+
+                cps[n_cps++] = i;
+                if (!(i % 97))
+                        for (n = 0; n < 40; ++n)
+                                cps[n_cps++] = 'a' + n % 26;
+        }
+
+        b = c_string_utf32_to_utf8(cps, n_cps, NULL, &n_u8);
+        assert(b);
+        b = c_string_utf32_to_utf8(cps, n_cps, u8, &n);
+        assert(b && n == n_u8);
+
+        b = c_string_utf8_to_utf32(u8, n_u8, NULL, &n);
+        assert(b && n == n_cps);
+        b = c_string_utf8_to_utf32(u8, n_u8, cps2, &n);
+        assert(b && n == n_cps);
+        assert(!memcmp(cps, cps2, n_cps * sizeof(*cps)));
+
+        b = c_string_utf8_to_utf16(u8, n_u8, NULL, &n_u16);
+        assert(b);
+        b = c_string_utf8_to_utf16(u8, n_u8, u16, &n);
+        assert(b && n == n_u16);
+
+        b = c_string_utf16_to_utf8(u16, n_u16, NULL, &n);
+        assert(b && n == n_u8);
+        b = c_string_utf16_to_utf8(u16, n_u16, u8b, &n);
+        assert(b && n == n_u8);
+        assert(!memcmp(u8, u8b, n_u8));
+
+        /* the UTF-8 result must pass verification */
+        {
+                char *p = u8;
+
+                n = n_u8;
+                c_string_verify_utf8(&p, &n);
+                assert(!n);
+        }
+
+        /* spot-check the encoding */
+        b = c_string_utf8_to_utf16("a\xf0\x9f\x98\x80" "b", 6, u16, &n);
+        assert(b && n == 4);
+        assert(u16[0] == 'a' && u16[1] == 0xD83D && u16[2] == 0xDE00 && u16[3] == 'b');
+
+        /* verify arbitrary cuts of valid UTF-8 behave like the verifier */
+        for (i = 0; i < 4096; ++i) {
+                char *p = u8 + 1000;
+
+                n = i;
+                c_string_verify_utf8(&p, &n);
+
+                b = c_string_utf8_to_utf16(u8 + 1000, i, u16, &n2);
+                assert(b == !n);
+                b = c_string_utf8_to_utf32(u8 + 1000, i, cps2, &n2);
+                assert(b == !n);
+        }
+}
+
+/* verify invalid input is rejected by the transcoders */
+static void test_transcode_invalid(void) {
+        uint16_t u16[40];
+        uint32_t u32[40];
+        char u8[160];
+        size_t i, n;
+
+        assert(!c_string_utf8_to_utf16("a\0b", 3, NULL, &n));
+        assert(!c_string_utf8_to_utf16("\xc0\x80", 2, NULL, &n));
+        assert(!c_string_utf8_to_utf16("\xed\xa0\x80", 3, NULL, &n));
+        assert(!c_string_utf8_to_utf32("\xf4\x90\x80\x80", 4, NULL, &n));
+        assert(!c_string_utf8_to_utf32("\xe2\x82", 2, NULL, &n));
+
+        for (i = 0; i < C_ARRAY_SIZE(u16); ++i)
+                u16[i] = 'x';
+        for (i = 0; i < C_ARRAY_SIZE(u16); ++i) {
+                u16[i] = 0;
+                assert(!c_string_utf16_to_utf8(u16, C_ARRAY_SIZE(u16), u8, &n));
+                u16[i] = 0xD800;
+                assert(!c_string_utf16_to_utf8(u16, C_ARRAY_SIZE(u16), u8, &n));
+                u16[i] = 0xDC00;
+                assert(!c_string_utf16_to_utf8(u16, C_ARRAY_SIZE(u16), u8, &n));
+                u16[i] = 0xFFFF;
+                assert(c_string_utf16_to_utf8(u16, C_ARRAY_SIZE(u16), u8, &n));
+                assert(n == C_ARRAY_SIZE(u16) + 2);
+                u16[i] = 0x80;
+                assert(c_string_utf16_to_utf8(u16, C_ARRAY_SIZE(u16), u8, &n));
+                assert(n == C_ARRAY_SIZE(u16) + 1);
+                u16[i] = 'x';
+        }
+
+        /* surrogate pairs must be in order */
+        u16[3] = 0xDC00;
+        u16[4] = 0xD800;
+        assert(!c_string_utf16_to_utf8(u16, C_ARRAY_SIZE(u16), u8, &n));
+        u16[3] = 0xD800;
+        u16[4] = 0xDC00;
+        assert(c_string_utf16_to_utf8(u16, C_ARRAY_SIZE(u16), u8, &n));
+        assert(n == C_ARRAY_SIZE(u16) - 2 + 4);
+        assert(!memcmp(u8 + 3, "\xf0\x90\x80\x80", 4));
+
+        for (i = 0; i < C_ARRAY_SIZE(u32); ++i)
+                u32[i] = 'x';
+        for (i = 0; i < C_ARRAY_SIZE(u32); ++i) {
+                u32[i] = 0;
+                assert(!c_string_utf32_to_utf8(u32, C_ARRAY_SIZE(u32), u8, &n));
+                u32[i] = 0xDFFF;
+                assert(!c_string_utf32_to_utf8(u32, C_ARRAY_SIZE(u32), u8, &n));
+                u32[i] = 0x110000;
+                assert(!c_string_utf32_to_utf8(u32, C_ARRAY_SIZE(u32), u8, &n));
+                u32[i] = 0x80000000;
+                assert(!c_string_utf32_to_utf8(u32, C_ARRAY_SIZE(u32), u8, &n));
+                u32[i] = 0x10FFFF;
+                assert(c_string_utf32_to_utf8(u32, C_ARRAY_SIZE(u32), u8, &n));
+                assert(n == C_ARRAY_SIZE(u32) + 3);
+                u32[i] = 'x';
+        }
+}
+
 int main(int argc, char **argv) {
         test_compare();
         test_equal();
+        test_lcp();
+        test_prefix();
+        test_view();
+        test_split();
+        test_integer();
+        test_escape();
+        test_uri();
+        test_buf();
         test_hex();
+        test_hex_backends();
+        test_from_hex_backends();
+        test_hex_sep();
+        test_base64();
+        test_base64_backends();
         test_ascii();
+        test_ascii_backends();
+        test_ascii_ci();
+        test_ascii_ci_backends();
         test_utf8();
+        test_utf8_backends();
+        test_utf8_count();
+        test_utf8_stream();
+        test_sanitize();
+        test_transcode_roundtrip();
+        test_transcode_invalid();
         return 0;
 }
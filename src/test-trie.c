@@ -0,0 +1,147 @@
+/*
+ * Tests for Prefix Tries
+ * Bunch of tests for the prefix trie module, comparing it against plain
+ * c_string_prefix() calls.
+ */
+
+#include <stdlib.h>
+#include "c-macro.h"
+#include "c-string.h"
+#include "c-trie.h"
+
+static char *test_lookup_reference(const char * const *prefixes, size_t n_prefixes, const char *str, size_t *idp) {
+        char *end = NULL, *p;
+        size_t i;
+
+        for (i = 0; i < n_prefixes; ++i) {
+                p = (c_string_prefix)(str, prefixes[i]);
+                if (p && (!end || p > end)) {
+                        end = p;
+                        *idp = i;
+                }
+        }
+
+        return end;
+}
+
+static void test_lookup_compare(const CTrie *trie, const char * const *prefixes, size_t n_prefixes, const char *str) {
+        _c_cleanup_(c_freep) char *dup = NULL;
+        size_t id1 = -1, id2 = -1;
+        char *p1, *p2;
+
+        /* heap copy, so ASAN catches reads beyond the terminator */
+        dup = strdup(str);
+        assert(dup);
+
+        p1 = test_lookup_reference(prefixes, n_prefixes, dup, &id1);
+        p2 = c_trie_lookup(trie, dup, &id2);
+        assert(p1 == p2);
+        assert(id1 == id2);
+}
+
+static void test_basic(void) {
+        static const char * const prefixes[] = {
+                "foo",
+                "foobar",
+                "fo",
+                "bar",
+                "foo",
+                "\xff\x80",
+        };
+        _c_cleanup_(c_trie_freep) CTrie *trie = NULL;
+        const char *str;
+        size_t id;
+        int r;
+
+        r = c_trie_new(&trie, prefixes, C_ARRAY_SIZE(prefixes));
+        assert(!r);
+
+        str = "foobarbaz";
+        assert(c_trie_lookup(trie, str, &id) == str + 6 && id == 1);
+        str = "foobaz";
+        assert(c_trie_lookup(trie, str, &id) == str + 3 && id == 0);
+        str = "fob";
+        assert(c_trie_lookup(trie, str, &id) == str + 2 && id == 2);
+        str = "\xff\x80\x80";
+        assert(c_trie_lookup(trie, str, &id) == str + 2 && id == 5);
+        str = "bar";
+        assert(c_trie_lookup(trie, str, NULL) == str + 3);
+
+        id = 71;
+        assert(!c_trie_lookup(trie, "", &id));
+        assert(!c_trie_lookup(trie, "f", &id));
+        assert(!c_trie_lookup(trie, "ba", &id));
+        assert(!c_trie_lookup(trie, "xfoo", &id));
+        assert(id == 71);
+}
+
+static void test_empty(void) {
+        static const char * const prefixes[] = {
+                "foo",
+                "",
+        };
+        _c_cleanup_(c_trie_freep) CTrie *trie = NULL;
+        const char *str;
+        size_t id;
+        int r;
+
+        r = c_trie_new(&trie, NULL, 0);
+        assert(!r);
+        assert(!c_trie_lookup(trie, "", NULL));
+        assert(!c_trie_lookup(trie, "foo", NULL));
+        trie = c_trie_free(trie);
+
+        r = c_trie_new(&trie, prefixes, C_ARRAY_SIZE(prefixes));
+        assert(!r);
+
+        str = "foo";
+        assert(c_trie_lookup(trie, str, &id) == str + 3 && id == 0);
+        str = "fo";
+        assert(c_trie_lookup(trie, str, &id) == str && id == 1);
+        str = "";
+        assert(c_trie_lookup(trie, str, &id) == str && id == 1);
+}
+
+static void test_random(void) {
+        static const char alphabet[] = "abc/.";
+        _c_cleanup_(c_trie_freep) CTrie *trie = NULL;
+        char storage[64][8], *prefixes[64], str[16];
+        size_t i, j, l;
+        int r;
+
+        /*
+         * Use a tiny alphabet, so the prefixes share many heads and the
+         * random strings hit lots of them.
+         */
+        srand(0xc7);
+
+        for (i = 0; i < C_ARRAY_SIZE(storage); ++i) {
+                l = rand() % sizeof(storage[i]);
+                for (j = 0; j < l; ++j)
+                        storage[i][j] = alphabet[rand() % (sizeof(alphabet) - 1)];
+                storage[i][l] = 0;
+                prefixes[i] = storage[i];
+        }
+
+        r = c_trie_new(&trie, (const char * const *)prefixes, C_ARRAY_SIZE(prefixes));
+        assert(!r);
+
+        for (i = 0; i < 4096; ++i) {
+                l = rand() % sizeof(str);
+                for (j = 0; j < l; ++j)
+                        str[j] = alphabet[rand() % (sizeof(alphabet) - 1)];
+                str[l] = 0;
+
+                test_lookup_compare(trie, (const char * const *)prefixes, C_ARRAY_SIZE(prefixes), str);
+        }
+
+        for (i = 0; i < C_ARRAY_SIZE(prefixes); ++i)
+                test_lookup_compare(trie, (const char * const *)prefixes, C_ARRAY_SIZE(prefixes), prefixes[i]);
+}
+
+int main(int argc, char **argv) {
+        test_basic();
+        test_empty();
+        test_random();
+        return 0;
+}